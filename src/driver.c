@@ -42,29 +42,39 @@ typedef enum
 {
     OPTION_SW_CURSOR,
     OPTION_DEVICE_PATH,
+    OPTION_ASYNC_BO_FREE,
     OPTION_EXA_DISABLED,
     OPTION_EXA_COMPOSITING,
+    OPTION_EXA_TRAPEZOIDS,
     OPTION_EXA_POOL_ALLOC,
+    OPTION_EXA_BO_WARMUP_FILE,
     OPTION_EXA_REFRIGERATOR,
     OPTION_EXA_COMPRESSION_LZ4,
     OPTION_EXA_COMPRESSION_JPEG,
     OPTION_EXA_COMPRESSION_JPEG_QUALITY,
     OPTION_EXA_COMPRESSION_PNG,
     OPTION_EXA_ERASE_PIXMAPS,
+    OPTION_XV_PACKED_TO_PLANAR,
+    OPTION_XV_QUEUED_PRESENTATION,
 } TegraOptions;
 
 static const OptionInfoRec Options[] = {
     { OPTION_SW_CURSOR, "SWcursor", OPTV_BOOLEAN, { 0 }, FALSE },
     { OPTION_DEVICE_PATH, "device", OPTV_STRING, { 0 }, FALSE },
+    { OPTION_ASYNC_BO_FREE, "AsyncBOFree", OPTV_BOOLEAN, { 0 }, FALSE },
     { OPTION_EXA_DISABLED, "NoAccel", OPTV_BOOLEAN, { 0 }, FALSE },
     { OPTION_EXA_COMPOSITING, "AccelCompositing", OPTV_BOOLEAN, { 0 }, FALSE },
+    { OPTION_EXA_TRAPEZOIDS, "AccelTrapezoids", OPTV_BOOLEAN, { 0 }, FALSE },
     { OPTION_EXA_POOL_ALLOC, "DisablePoolAllocator", OPTV_BOOLEAN, { 0 }, FALSE },
+    { OPTION_EXA_BO_WARMUP_FILE, "BOWarmupFile", OPTV_STRING, { 0 }, FALSE },
     { OPTION_EXA_REFRIGERATOR, "DisablePixmapRefrigerator", OPTV_BOOLEAN, { 0 }, FALSE },
     { OPTION_EXA_COMPRESSION_LZ4, "DisableCompressionLZ4", OPTV_BOOLEAN, { 0 }, FALSE },
     { OPTION_EXA_COMPRESSION_JPEG, "DisableCompressionJPEG", OPTV_BOOLEAN, { 0 }, FALSE },
     { OPTION_EXA_COMPRESSION_JPEG_QUALITY, "JPEGCompressionQuality", OPTV_INTEGER, { 0 }, FALSE },
     { OPTION_EXA_COMPRESSION_PNG, "DisableCompressionPNG", OPTV_BOOLEAN, { 0 }, FALSE },
     { OPTION_EXA_ERASE_PIXMAPS, "SecureErasePixmaps", OPTV_BOOLEAN, { 0 }, FALSE },
+    { OPTION_XV_PACKED_TO_PLANAR, "XvPackedToPlanar", OPTV_BOOLEAN, { 0 }, FALSE },
+    { OPTION_XV_QUEUED_PRESENTATION, "XvQueuedPresentation", OPTV_BOOLEAN, { 0 }, FALSE },
     { -1, NULL, OPTV_NONE, { 0 }, FALSE }
 };
 
@@ -253,6 +263,7 @@ TegraPreInit(ScrnInfoPtr pScrn, int flags)
     int defaultdepth, defaultbpp;
     Gamma zeros = { 0.0, 0.0, 0.0 };
     const char *path;
+    Bool async_bo_free;
 
     if (pScrn->numEntities != 1)
         return FALSE;
@@ -373,6 +384,21 @@ TegraPreInit(ScrnInfoPtr pScrn, int flags)
     xf86DrvMsg(pScrn->scrnIndex, X_INFO, "HW Cursor: enabled %s\n",
                tegra->drmmode.sw_cursor ? "NO" : "YES");
 
+    async_bo_free = xf86ReturnOptValBool(tegra->Options, OPTION_ASYNC_BO_FREE,
+                                         FALSE);
+    if (async_bo_free) {
+        ret = drm_tegra_bo_reaper_start(tegra->drm);
+        if (ret < 0) {
+            xf86DrvMsg(pScrn->scrnIndex, X_WARNING,
+                       "Failed to start BO reaper thread: %s\n",
+                       strerror(-ret));
+            async_bo_free = FALSE;
+        }
+    }
+
+    xf86DrvMsg(pScrn->scrnIndex, X_INFO, "Async BO release: enabled %s\n",
+               async_bo_free ? "YES" : "NO");
+
     tegra->cursor_width = 64;
     tegra->cursor_height = 64;
     ret = drmGetCap(tegra->fd, DRM_CAP_CURSOR_WIDTH, &value);
@@ -422,6 +448,14 @@ TegraPreInit(ScrnInfoPtr pScrn, int flags)
                   "EXA Compositing: enabled %s\n",
                    tegra->exa_compositing ? "YES" : "NO");
 
+        tegra->exa_trapezoids = xf86ReturnOptValBool(tegra->Options,
+                                                     OPTION_EXA_TRAPEZOIDS,
+                                                     FALSE);
+
+        xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                  "EXA GR3D trapezoids: enabled %s\n",
+                   tegra->exa_trapezoids ? "YES" : "NO");
+
         tegra->exa_pool_alloc = !xf86ReturnOptValBool(tegra->Options,
                                                       OPTION_EXA_POOL_ALLOC,
                                                       FALSE);
@@ -430,6 +464,13 @@ TegraPreInit(ScrnInfoPtr pScrn, int flags)
                   "EXA pool allocator: enabled %s\n",
                    tegra->exa_pool_alloc ? "YES" : "NO");
 
+        tegra->exa_bo_warmup_path = xf86GetOptValString(tegra->Options,
+                                                OPTION_EXA_BO_WARMUP_FILE);
+
+        xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                  "EXA BO warm-up: enabled %s\n",
+                   tegra->exa_bo_warmup_path ? "YES" : "NO");
+
         tegra->exa_refrigerator = !xf86ReturnOptValBool(tegra->Options,
                                                         OPTION_EXA_REFRIGERATOR,
                                                         FALSE);
@@ -488,6 +529,22 @@ TegraPreInit(ScrnInfoPtr pScrn, int flags)
                 "EXA secure erase pixmaps: enabled %s\n",
                 tegra->exa_erase_pixmaps ? "YES" : "NO");
 
+    tegra->xv_packed_to_planar = xf86ReturnOptValBool(tegra->Options,
+                                                      OPTION_XV_PACKED_TO_PLANAR,
+                                                      FALSE);
+
+    xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                "XV packed to planar conversion: enabled %s\n",
+                tegra->xv_packed_to_planar ? "YES" : "NO");
+
+    tegra->xv_queued_presentation = xf86ReturnOptValBool(tegra->Options,
+                                                OPTION_XV_QUEUED_PRESENTATION,
+                                                FALSE);
+
+    xf86DrvMsg(pScrn->scrnIndex, X_INFO,
+                "XV queued presentation: enabled %s\n",
+                tegra->xv_queued_presentation ? "YES" : "NO");
+
     /* Load the required sub modules */
     if (!xf86LoadSubModule(pScrn, "dri2") ||
         !xf86LoadSubModule(pScrn, "fb"))
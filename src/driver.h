@@ -85,6 +85,7 @@
 #include <xorg/list.h>
 #include <xorg/mipointer.h>
 #include <xorg/micmap.h>
+#include <xorg/mipict.h>
 #include <xorg/shadow.h>
 #include <xorg/xorgVersion.h>
 #include <xorg/xorg-server.h>
@@ -185,6 +186,8 @@ typedef struct _TegraRec
     struct drm_tegra *drm;
 
     Bool xv_blocks_hw_cursor;
+    Bool xv_packed_to_planar;
+    Bool xv_queued_presentation;
 
     Bool exa_erase_pixmaps;
     Bool exa_compress_png;
@@ -193,6 +196,8 @@ typedef struct _TegraRec
     Bool exa_compress_lz4;
     Bool exa_refrigerator;
     Bool exa_pool_alloc;
+    const char *exa_bo_warmup_path;
+    Bool exa_trapezoids;
     Bool exa_compositing;
     Bool exa_enabled;
 
@@ -208,6 +213,9 @@ void TegraXvScreenExit(ScreenPtr pScreen);
 
 Bool TegraEXAScreenInit(ScreenPtr pScreen);
 void TegraEXAScreenExit(ScreenPtr pScreen);
+Bool TegraEXATexturedVideo(DrawablePtr draw,
+                           const TegraTexturedVideoFrame *frame,
+                           struct tegra_fence **fence);
 
 Bool TegraDRI2ScreenInit(ScreenPtr pScreen);
 void TegraDRI2ScreenExit(ScreenPtr pScreen);
@@ -23,6 +23,7 @@
  */
 
 #include "driver.h"
+#include "memcpy-vfp/memcpy_vfp.h"
 
 #define HANDLE_INVALID  0
 
@@ -481,6 +482,78 @@ drm_overlay_fb * drm_create_fb_from_handle(struct drm_tegra *drm,
                                   bo_handles, pitches, offsets, TRUE);
 }
 
+/*
+ * Allocate planar YUV420 image that is suitable for sampling by GR3D, i.e.
+ * planes are laid out using the texture pitch. The image isn't backed by
+ * a DRM framebuffer and thus can't be displayed on overlay.
+ */
+drm_overlay_fb * drm_create_texture_fb(struct drm_tegra *drm,
+                                       uint32_t width, uint32_t height)
+{
+    struct drm_tegra_bo *bo = NULL;
+    drm_overlay_fb *fb;
+    uint32_t width_c, height_c;
+    uint32_t pitch_y, pitch_c;
+    uint32_t size_y, size_c;
+    uint8_t *map;
+    int err;
+
+    if (width == 0 || height == 0)
+        return NULL;
+
+    /* odd sizes get the trailing chroma sample, see convert_packed_to_fb() */
+    width_c  = fb_width_c(DRM_FORMAT_YUV420, TEGRA_ALIGN(width, 2));
+    height_c = fb_height_c(DRM_FORMAT_YUV420, TEGRA_ALIGN(height, 2));
+
+    if (width_c == 0 || height_c == 0)
+        return NULL;
+
+    pitch_y  = tegra_hw_pitch(width, height, 8);
+    pitch_c  = tegra_hw_pitch(width_c, height_c, 8);
+    size_y   = TEGRA_ALIGN(pitch_y * height, 128);
+    size_c   = TEGRA_ALIGN(pitch_c * height_c, 128);
+
+    err = drm_tegra_bo_new(&bo, drm, 0, size_y + size_c * 2);
+    if (err)
+        return NULL;
+
+    err = drm_tegra_bo_map(bo, (void **)&map);
+    if (err)
+        goto error_cleanup;
+
+    fb = calloc(1, sizeof(*fb));
+    if (!fb)
+        goto error_cleanup;
+
+    fb->fb_id           = HANDLE_INVALID;
+    fb->format          = DRM_FORMAT_YUV420;
+    fb->width           = width;
+    fb->height          = height;
+    fb->width_c         = width_c;
+    fb->height_c        = height_c;
+    fb->bpp             = fb_bpp(DRM_FORMAT_YUV420);
+    fb->bpp_c           = fb_bpp_c(DRM_FORMAT_YUV420);
+    fb->bo_y            = bo;
+    fb->bo_cb           = drm_tegra_bo_ref(bo);
+    fb->bo_cr           = drm_tegra_bo_ref(bo);
+    fb->pitch_y         = pitch_y;
+    fb->pitch_cb        = pitch_c;
+    fb->pitch_cr        = pitch_c;
+    fb->offset_y        = 0;
+    fb->offset_cb       = size_y;
+    fb->offset_cr       = size_y + size_c;
+    fb->bo_y_mmap       = map + fb->offset_y;
+    fb->bo_cb_mmap      = map + fb->offset_cb;
+    fb->bo_cr_mmap      = map + fb->offset_cr;
+
+    return fb;
+
+error_cleanup:
+    drm_tegra_bo_unref(bo);
+
+    return NULL;
+}
+
 drm_overlay_fb * drm_clone_fb(int drm_fd, drm_overlay_fb *fb)
 {
     uint32_t fb_id = HANDLE_INVALID;
@@ -535,9 +608,11 @@ void drm_free_overlay_fb(int drm_fd, drm_overlay_fb *fb)
     if (fb == NULL)
         return;
 
-    ret = drmModeRmFB(drm_fd, fb->fb_id);
-    if (ret < 0)
-        ErrorMsg("Failed to remove framebuffer %s\n", strerror(-ret));
+    if (fb->fb_id != HANDLE_INVALID) {
+        ret = drmModeRmFB(drm_fd, fb->fb_id);
+        if (ret < 0)
+            ErrorMsg("Failed to remove framebuffer %s\n", strerror(-ret));
+    }
 
     drm_tegra_bo_unref(fb->bo);
     drm_tegra_bo_unref(fb->bo_cb);
@@ -667,48 +742,157 @@ err:
     return -EFAULT;
 }
 
-static void copy_plane_data(uint8_t *dst, uint8_t *src,
-                            unsigned width, unsigned height,
-                            unsigned pitch_dst,
-                            unsigned pitch_src)
+static void convert_packed_row(uint8_t *y0, uint8_t *y1,
+                               uint8_t *cb, uint8_t *cr,
+                               const uint8_t *src0, const uint8_t *src1,
+                               unsigned width, uint32_t src_format)
 {
+    unsigned yo = (src_format == DRM_FORMAT_UYVY) ? 1 : 0;
+    unsigned co = (src_format == DRM_FORMAT_UYVY) ? 0 : 1;
     unsigned i;
 
-    if (pitch_dst == pitch_src)
-        memcpy(dst, src, height * pitch_dst);
-    else
-        for (i = 0; i < height; i++, dst += pitch_dst, src += pitch_src)
-            memcpy(dst, src, pitch_src);
-}
+    /* the leftover row of an odd-height frame takes chroma from itself */
+    if (!y1)
+        src1 = src0;
 
-void drm_copy_data_to_fb(drm_overlay_fb *fb, uint8_t *data, int swap)
-{
-    if (!format_planar(fb->format)) {
-        copy_plane_data(fb->bo_mmap, data,
-                        fb->width, fb->height,
-                        fb->pitch, fb_pitch(fb->format, fb->width));
-        return;
+    for (i = 0; i < width / 2; i++, src0 += 4, src1 += 4) {
+        y0[i * 2 + 0] = src0[yo + 0];
+        y0[i * 2 + 1] = src0[yo + 2];
+
+        if (y1) {
+            y1[i * 2 + 0] = src1[yo + 0];
+            y1[i * 2 + 1] = src1[yo + 2];
+        }
+
+        cb[i] = (src0[co + 0] + src1[co + 0] + 1) >> 1;
+        cr[i] = (src0[co + 2] + src1[co + 2] + 1) >> 1;
     }
 
-    copy_plane_data(fb->bo_y_mmap, data,
-                    fb->width, fb->height,
-                    fb->pitch_y, fb_pitch(fb->format, fb->width));
+    /*
+     * The last macropixel of an odd-width row is cut in half, it carries
+     * luma and Cb only. Cr is borrowed from the neighbouring macropixel.
+     */
+    if (width & 1) {
+        y0[i * 2] = src0[yo];
 
-    data += fb_size(fb->format, fb->width, fb->height);
+        if (y1)
+            y1[i * 2] = src1[yo];
 
-    copy_plane_data(swap ? fb->bo_cb_mmap : fb->bo_cr_mmap, data,
-                    fb_width_c(fb->format, fb->width),
-                    fb_height_c(fb->format, fb->height),
-                    swap ? fb->pitch_cb : fb->pitch_cr,
-                    fb_pitch_c(fb->format, fb->width));
+        cb[i] = (src0[co] + src1[co] + 1) >> 1;
+        cr[i] = i ? cr[i - 1] : 0x80;
+    }
+}
 
-    data += fb_size_c(fb->format, fb->width, fb->height);
+/*
+ * Convert packed YUYV / UYVY into planar YUV420 while copying. A band of
+ * lines is converted into a cached bounce buffer, which is then written
+ * out to the write-combined BO mappings using VFP.
+ */
+static void convert_packed_to_fb(drm_overlay_fb *fb, const uint8_t *data,
+                                 uint32_t src_format)
+{
+    static uint8_t bounce[48 * 1024] __attribute__((aligned(128)));
+    unsigned src_pitch = fb_pitch(src_format, fb->width);
+    unsigned y_pitch = TEGRA_ALIGN(fb->width, 128);
+    unsigned c_width = (fb->width + 1) / 2;
+    unsigned c_pitch = TEGRA_ALIGN(c_width, 128);
+    struct tegra_vfp_plane planes[3];
+    unsigned band_rows, rows, row, i;
+    uint8_t *band_y, *band_cb, *band_cr;
+    const uint8_t *src;
+
+    band_rows = (sizeof(bounce) / (y_pitch + c_pitch)) & ~1;
+    band_y    = bounce;
+    band_cb   = band_y + band_rows * y_pitch;
+    band_cr   = band_cb + band_rows / 2 * c_pitch;
+
+    for (row = 0; row < fb->height; row += rows, data += rows * src_pitch) {
+        rows = min(band_rows, fb->height - row);
+
+        for (i = 0, src = data; i < rows; i += 2, src += src_pitch * 2)
+            convert_packed_row(band_y + i * y_pitch,
+                               i + 1 < rows ? band_y + (i + 1) * y_pitch : NULL,
+                               band_cb + i / 2 * c_pitch,
+                               band_cr + i / 2 * c_pitch,
+                               src, src + src_pitch,
+                               fb->width, src_format);
+
+        planes[0].dst       = (char *)fb->bo_y_mmap + row * fb->pitch_y;
+        planes[0].src       = (char *)band_y;
+        planes[0].dst_pitch = fb->pitch_y;
+        planes[0].src_pitch = y_pitch;
+        planes[0].line_len  = fb->width;
+        planes[0].height    = rows;
+
+        planes[1].dst       = (char *)fb->bo_cb_mmap + row / 2 * fb->pitch_cb;
+        planes[1].src       = (char *)band_cb;
+        planes[1].dst_pitch = fb->pitch_cb;
+        planes[1].src_pitch = c_pitch;
+        planes[1].line_len  = c_width;
+        planes[1].height    = (rows + 1) / 2;
+
+        planes[2].dst       = (char *)fb->bo_cr_mmap + row / 2 * fb->pitch_cr;
+        planes[2].src       = (char *)band_cr;
+        planes[2].dst_pitch = fb->pitch_cr;
+        planes[2].src_pitch = c_pitch;
+        planes[2].line_len  = c_width;
+        planes[2].height    = (rows + 1) / 2;
+
+        tegra_memcpy_vfp_planes(planes, 3,
+                                tegra_memcpy_vfp_aligned_src_cached);
+    }
+}
+
+void drm_copy_data_to_fb(drm_overlay_fb *fb, uint8_t *data,
+                         uint32_t data_format, int swap)
+{
+    struct tegra_vfp_plane planes[3];
+    unsigned num_planes = 1;
+    uint8_t *data_c;
+
+    if (data_format != fb->format) {
+        if (fb->format == DRM_FORMAT_YUV420 &&
+            (data_format == DRM_FORMAT_YUYV ||
+             data_format == DRM_FORMAT_UYVY))
+            convert_packed_to_fb(fb, data, data_format);
+        else
+            ErrorMsg("Unsupported conversion 0x%08X -> 0x%08X\n",
+                     data_format, fb->format);
+        return;
+    }
+
+    planes[0].dst       = (char *)fb->bo_y_mmap;
+    planes[0].src       = (char *)data;
+    planes[0].dst_pitch = fb->pitch_y;
+    planes[0].src_pitch = fb_pitch(fb->format, fb->width);
+    planes[0].line_len  = planes[0].src_pitch;
+    planes[0].height    = fb->height;
+
+    if (format_planar(fb->format)) {
+        data_c = data + fb_size(fb->format, fb->width, fb->height);
+
+        /* YV12 stores Cr plane first, I420 stores Cb first */
+        planes[1].dst       = (char *)(swap ? fb->bo_cb_mmap : fb->bo_cr_mmap);
+        planes[1].src       = (char *)data_c;
+        planes[1].dst_pitch = swap ? fb->pitch_cb : fb->pitch_cr;
+        planes[1].src_pitch = fb_pitch_c(fb->format, fb->width);
+        planes[1].line_len  = planes[1].src_pitch;
+        planes[1].height    = fb_height_c(fb->format, fb->height);
+
+        data_c += fb_size_c(fb->format, fb->width, fb->height);
+
+        planes[2].dst       = (char *)(swap ? fb->bo_cr_mmap : fb->bo_cb_mmap);
+        planes[2].src       = (char *)data_c;
+        planes[2].dst_pitch = swap ? fb->pitch_cr : fb->pitch_cb;
+        planes[2].src_pitch = planes[1].src_pitch;
+        planes[2].line_len  = planes[1].line_len;
+        planes[2].height    = planes[1].height;
+
+        num_planes = 3;
+    }
 
-    copy_plane_data(swap ? fb->bo_cr_mmap : fb->bo_cb_mmap, data,
-                    fb_width_c(fb->format, fb->width),
-                    fb_height_c(fb->format, fb->height),
-                    swap ? fb->pitch_cr : fb->pitch_cb,
-                    fb_pitch_c(fb->format, fb->width));
+    tegra_memcpy_vfp_planes(planes, num_planes,
+                            tegra_memcpy_vfp_aligned_src_cached);
 }
 
 static int drm_set_plane_rotation(int drm_fd, int plane_id, int mode)
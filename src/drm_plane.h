@@ -92,6 +92,9 @@ drm_overlay_fb * drm_create_fb_from_handle(struct drm_tegra *drm,
                                            uint32_t *pitches,
                                            uint32_t *offsets);
 
+drm_overlay_fb * drm_create_texture_fb(struct drm_tegra *drm,
+                                       uint32_t width, uint32_t height);
+
 drm_overlay_fb * drm_clone_fb(int drm_fd, drm_overlay_fb *fb);
 
 void drm_free_overlay_fb(int drm_fd, drm_overlay_fb *fb);
@@ -101,7 +104,8 @@ int drm_get_overlay_plane(int drm_fd, int crtc_pipe, uint32_t format,
 
 int drm_get_primary_plane(int drm_fd, int crtc_pipe, uint32_t *plane_id);
 
-void drm_copy_data_to_fb(drm_overlay_fb *fb, uint8_t *data, int swap);
+void drm_copy_data_to_fb(drm_overlay_fb *fb, uint8_t *data,
+                         uint32_t data_format, int swap);
 
 int drm_set_planes_rotation(int drm_fd, uint32_t crtc_mask, uint32_t mode);
 
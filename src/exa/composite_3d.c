@@ -195,6 +195,22 @@ static const struct tegra_composite_config composite_cfgs[] = {
     },
 };
 
+/* radial gradient is sampled only by the dedicated programs */
+static const struct shader_program *
+tegra_exa_radial_gradient_program(int op)
+{
+    switch (op) {
+    case PictOpSrc:
+        return &prog_radial_gradient_src;
+
+    case PictOpOver:
+        return &prog_radial_gradient_over;
+
+    default:
+        return NULL;
+    }
+}
+
 #include "composite_3d_state_tracker.c"
 
 static bool
@@ -269,6 +285,20 @@ tegra_exa_pre_check_3d_program(struct tegra_3d_draw_state *draw_state)
     if (draw_state->op >= TEGRA_ARRAY_SIZE(composite_cfgs))
         return false;
 
+    if (draw_state->src.radial) {
+        prog = tegra_exa_radial_gradient_program(draw_state->op);
+        if (!prog) {
+            FALLBACK_MSG("no radial gradient shader for operation %d\n",
+                         draw_state->op);
+            return false;
+        }
+
+        ACCEL_MSG("got shader for operation %d radial gradient %s\n",
+                  draw_state->op, prog->name);
+
+        return true;
+    }
+
     prog = cfg->prog[PROG_SEL(draw_state->src.tex_sel,
                               draw_state->mask.tex_sel)];
     if (!prog) {
@@ -381,7 +411,11 @@ tegra_exa_attributes_buffer_is_full(struct tegra_exa_scratch * scratch)
 {
     unsigned attrs_num = 1 + !!scratch->src + !!scratch->mask;
 
-    if (scratch->attrib_itr * 2 + attrs_num * 24 > TEGRA_ATTRIB_BUFFER_SIZE)
+    /* buffer is released if job couldn't be continued after a split */
+    if (!scratch->attribs.map)
+        return true;
+
+    if (scratch->attrib_itr * 2 + attrs_num * 16 > TEGRA_ATTRIB_BUFFER_SIZE)
         return true;
 
     return false;
@@ -421,11 +455,22 @@ static bool tegra_exa_check_composite_3d(int op,
         if (src_picture->pDrawable) {
             if (!tegra_exa_check_texture(op, src_picture, NULL))
                 return false;
-        } else {
-            if (src_picture->pSourcePict->type != SourcePictTypeSolidFill) {
-                FALLBACK_MSG("unsupported fill type %u\n",
-                             src_picture->pSourcePict->type);
+        } else if (src_picture->pSourcePict->type != SourcePictTypeSolidFill) {
+            if (!tegra_exa_check_gradient(src_picture))
                 return false;
+
+            if (src_picture->pSourcePict->type == SourcePictTypeRadial) {
+                if (!tegra_exa_radial_gradient_program(op)) {
+                    FALLBACK_MSG("unsupported radial gradient operation %d\n",
+                                 op);
+                    return false;
+                }
+
+                if ((mask_picture && mask_picture->pDrawable) ||
+                    dst_picture->format == PICT_a8) {
+                    FALLBACK_MSG("unsupported radial gradient mask or dst\n");
+                    return false;
+                }
             }
         }
     }
@@ -510,6 +555,7 @@ static bool tegra_exa_prepare_composite_3d(int op,
     bool mask_tex = (mask_picture && mask_picture->pDrawable);
     bool src_tex = (src_picture && src_picture->pDrawable);
     struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
+    bool src_gradient = false;
     struct tegra_3d_draw_state draw_state;
     bool mask_tex_reduced = true;
     bool src_tex_reduced = true;
@@ -524,11 +570,24 @@ static bool tegra_exa_prepare_composite_3d(int op,
     if (!tegra_exa_check_texture(op, src_picture, psrc))
         return false;
 
+    /* lookup texture is uploaded before deferring the drawing */
+    if (src_picture && !src_picture->pDrawable &&
+        src_picture->pSourcePict->type != SourcePictTypeSolidFill) {
+        psrc = tegra_exa_gradient_lut(pdst->drawable.pScreen, tegra,
+                                      &src_picture->pSourcePict->gradient);
+        if (!psrc)
+            return false;
+
+        src_gradient = true;
+        src_tex = true;
+    }
+
     memset(&draw_state, 0, sizeof(draw_state));
 
     tegra_exa_enter_optimization_3d_state(tegra);
 
-    if (src_tex && tegra_exa_texture_optimized_out(src_picture, psrc, cfg))
+    if (src_tex && !src_gradient &&
+        tegra_exa_texture_optimized_out(src_picture, psrc, cfg))
         src_tex = false;
     else
         src_tex_reduced = false;
@@ -576,7 +635,18 @@ static bool tegra_exa_prepare_composite_3d(int op,
             draw_state.src.tex_sel  = src_sel;
             draw_state.src.pix      = psrc;
 
-            if (src_picture->transform) {
+            if (src_gradient) {
+                if (!tegra_exa_gradient_transform(src_picture, psrc,
+                                                  &tegra->scratch.transform_src,
+                                                  &tegra->scratch.radial_offset))
+                    goto fail;
+
+                draw_state.src.radial = (src_picture->pSourcePict->type ==
+                                         SourcePictTypeRadial);
+                draw_state.src.bilinear = true;
+                draw_state.src.coords_wrap = true;
+                draw_state.src.transform_coords = true;
+            } else if (src_picture->transform) {
                 tegra->scratch.transform_src = *src_picture->transform;
 
                 if (src_sel == TEX_CLIPPED)
@@ -711,6 +781,92 @@ fail:
     return false;
 }
 
+static void tegra_exa_flush_composite_3d(struct tegra_exa *tegra,
+                                         PixmapPtr pdst)
+{
+    struct tegra_fence *fence;
+
+    tegra_exa_finalize_3d_state(&tegra->gr3d_state);
+
+    tegra_exa_wait_pixmaps(TEGRA_2D, pdst, 2, tegra->scratch.src,
+                           tegra->scratch.mask);
+
+    fence = tegra_exa_submit_3d_state(&tegra->gr3d_state);
+
+    if (fence) {
+        /*
+        * XXX: Glitches may occur due to lack of support for waitchecks
+        *      by kernel driver, they are required for 3D engine to complete
+        *      data prefetching before starting to render. Alternative would
+        *      be to flush the job, but that impacts performance very
+        *      significantly and just happens to minimize the issue, so we
+        *      choose glitches to low performance. Mostly fonts rendering is
+        *      affected.
+        *
+        *      See TegraGR3D_DrawPrimitives() in gr3d.c
+        */
+        tegra_exa_replace_pixmaps_fence(TEGRA_3D, fence, &tegra->scratch, pdst,
+                                        2, tegra->scratch.src, tegra->scratch.mask);
+    }
+}
+
+/*
+ * Attributes buffer can't fit another quad. Draw the queued vertices and
+ * continue the job using next buffer of the ring.
+ */
+static bool tegra_exa_chain_attributes_buffer(struct tegra_exa *tegra)
+{
+    struct tegra_3d_state *state = &tegra->gr3d_state;
+    struct tegra_3d_draw_state draw_state = state->new;
+    struct tegra_attrib_ring_entry *entry;
+
+    if (state->clean || tegra->cmds->status != TEGRADRM_STREAM_CONSTRUCT)
+        return false;
+
+    entry = tegra_exa_get_attributes_buffer(state, tegra);
+    if (!entry)
+        return false;
+
+    tegra_exa_finalize_3d_state(state);
+
+    /* finalization adjusts the state for the next drawing operation */
+    state->new = draw_state;
+
+    tegra_exa_use_attributes_buffer(&tegra->scratch, entry);
+
+    return true;
+}
+
+/*
+ * None of the ring buffers is available. Submit the accumulated job,
+ * including the deferred jobs that share the buffer, and continue drawing
+ * with the same state in a new job.
+ */
+static bool tegra_exa_split_composite_3d(PixmapPtr pdst)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pdst->drawable.pScreen);
+    struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
+    struct tegra_3d_state *state = &tegra->gr3d_state;
+    struct tegra_3d_draw_state draw_state = state->appended;
+
+    if (state->clean)
+        return false;
+
+    if (tegra->cmds->status == TEGRADRM_STREAM_CONSTRUCT)
+        tegra_exa_flush_composite_3d(tegra, pdst);
+
+    if (tegra_exa_3d_state_deferred(state))
+        tegra_exa_submit_deferred_3d_jobs(state);
+
+    /*
+     * Re-append the caller's draw state, state->new was already altered
+     * by append and finalize.  State was reset by submission.
+     */
+    draw_state.dst_full_cover = 0;
+
+    return tegra_exa_3d_state_append(state, tegra, &draw_state);
+}
+
 static void tegra_exa_composite_3d(PixmapPtr pdst,
                                    int src_x, int src_y,
                                    int mask_x, int mask_y,
@@ -740,9 +896,10 @@ static void tegra_exa_composite_3d(PixmapPtr pdst,
     if (draw_state->optimized_out)
         goto degenerate;
 
-    /* if attributes buffer is full, do nothing for now (TODO better job) */
-    if (tegra_exa_attributes_buffer_is_full(&tegra->scratch)) {
-        ERROR_MSG("FIXME: attributes buffer is full\n");
+    if (tegra_exa_attributes_buffer_is_full(&tegra->scratch) &&
+        !tegra_exa_chain_attributes_buffer(tegra) &&
+        !tegra_exa_split_composite_3d(pdst)) {
+        ERROR_MSG("failed to continue composite job\n");
         return;
     }
 
@@ -880,7 +1037,7 @@ static void tegra_exa_composite_3d(PixmapPtr pdst,
     dst_bottom = (float) (dst.y0 * 2) / pdst->drawable.height - 1.0f;
     dst_top    = (float) (dst.y1 * 2) / pdst->drawable.height - 1.0f;
 
-    /* push first triangle of the quad to attributes buffer */
+    /* push vertices of the quad, triangles are formed by index buffer */
     TEGRA_PUSH_VTX_ATTR(dst_left,  dst_bottom,  true);
     TEGRA_PUSH_VTX_ATTR(src_left,  src_bottom,  push_src);
     TEGRA_PUSH_VTX_ATTR(mask_left, mask_bottom, push_mask);
@@ -893,20 +1050,11 @@ static void tegra_exa_composite_3d(PixmapPtr pdst,
     TEGRA_PUSH_VTX_ATTR(src_right,  src_top,  push_src);
     TEGRA_PUSH_VTX_ATTR(mask_right, mask_top, push_mask);
 
-    /* push second */
-    TEGRA_PUSH_VTX_ATTR(dst_right,  dst_top,  true);
-    TEGRA_PUSH_VTX_ATTR(src_right,  src_top,  push_src);
-    TEGRA_PUSH_VTX_ATTR(mask_right, mask_top, push_mask);
-
     TEGRA_PUSH_VTX_ATTR(dst_right,  dst_bottom,  true);
     TEGRA_PUSH_VTX_ATTR(src_right,  src_bottom,  push_src);
     TEGRA_PUSH_VTX_ATTR(mask_right, mask_bottom, push_mask);
 
-    TEGRA_PUSH_VTX_ATTR(dst_left,  dst_bottom,  true);
-    TEGRA_PUSH_VTX_ATTR(src_left,  src_bottom,  push_src);
-    TEGRA_PUSH_VTX_ATTR(mask_left, mask_bottom, push_mask);
-
-    tegra->scratch.vtx_cnt += 6;
+    tegra->scratch.vtx_cnt += 4;
     tegra->scratch.ops++;
 
     return;
@@ -921,32 +1069,9 @@ static void tegra_exa_done_composite_3d(PixmapPtr pdst)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pdst->drawable.pScreen);
     struct tegra_exa *tegra = TegraPTR(pScrn)->exa;
-    struct tegra_fence *fence = NULL;
 
     if (tegra->scratch.ops && tegra->cmds->status == TEGRADRM_STREAM_CONSTRUCT) {
-        tegra_exa_finalize_3d_state(&tegra->gr3d_state);
-
-        tegra_exa_wait_pixmaps(TEGRA_2D, pdst, 2, tegra->scratch.src,
-                               tegra->scratch.mask);
-
-        fence = tegra_exa_submit_3d_state(&tegra->gr3d_state);
-
-        if (fence) {
-            /*
-            * XXX: Glitches may occur due to lack of support for waitchecks
-            *      by kernel driver, they are required for 3D engine to complete
-            *      data prefetching before starting to render. Alternative would
-            *      be to flush the job, but that impacts performance very
-            *      significantly and just happens to minimize the issue, so we
-            *      choose glitches to low performance. Mostly fonts rendering is
-            *      affected.
-            *
-            *      See TegraGR3D_DrawPrimitives() in gr3d.c
-            */
-            tegra_exa_replace_pixmaps_fence(TEGRA_3D, fence, &tegra->scratch, pdst,
-                                            2, tegra->scratch.src, tegra->scratch.mask);
-        }
-
+        tegra_exa_flush_composite_3d(tegra, pdst);
     } else if (!tegra_exa_3d_state_deferred(&tegra->gr3d_state)) {
         tegra_exa_3d_state_reset(&tegra->gr3d_state);
     }
@@ -20,46 +20,193 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-static bool tegra_exa_allocate_attributes_buffer(struct tegra_3d_state *state,
-                                                 struct tegra_exa *exa)
+static bool tegra_exa_create_attributes_bo(struct tegra_exa_scratch *scratch,
+                                           struct tegra_exa *exa,
+                                           struct tegra_attrib_bo *attribs)
 {
-    struct tegra_exa_scratch *scratch = state->scratch;
     unsigned long flags;
     int drm_ver;
     int err;
 
-    if (scratch->attribs.bo)
-        return true;
-
     drm_ver = drm_tegra_version(scratch->drm);
     flags = exa->default_drm_bo_flags;
 
     if (drm_ver >= GRATE_KERNEL_DRM_VERSION && exa->has_iommu)
         flags |= DRM_TEGRA_GEM_CREATE_SPARSE;
 
-    err = drm_tegra_bo_new(&scratch->attribs.bo, scratch->drm, flags,
+    err = drm_tegra_bo_new(&attribs->bo, scratch->drm, flags,
                            TEGRA_ATTRIB_BUFFER_SIZE);
     if (err) {
-        scratch->attribs.bo = NULL;
+        attribs->bo = NULL;
+        return false;
+    }
+
+    err = drm_tegra_bo_map(attribs->bo, (void**)&attribs->map);
+    if (err) {
+        drm_tegra_bo_unref(attribs->bo);
+        attribs->map = NULL;
+        attribs->bo = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+/* index buffer is shared by all drawing contexts */
+static bool tegra_exa_create_quad_indices(struct tegra_exa *exa)
+{
+    unsigned long flags;
+    uint16_t *indices;
+    unsigned int i;
+    int drm_ver;
+    int err;
+
+    drm_ver = drm_tegra_version(exa->scratch.drm);
+    flags = exa->default_drm_bo_flags;
+
+    if (drm_ver >= GRATE_KERNEL_DRM_VERSION && exa->has_iommu)
+        flags |= DRM_TEGRA_GEM_CREATE_SPARSE;
+
+    err = drm_tegra_bo_new(&exa->quad_indices, exa->scratch.drm, flags,
+                           TEGRA_QUAD_INDEX_BUFFER_SIZE);
+    if (err) {
+        exa->quad_indices = NULL;
         return false;
     }
 
-    err = drm_tegra_bo_map(scratch->attribs.bo, (void**)&scratch->attribs.map);
+    err = drm_tegra_bo_map(exa->quad_indices, (void**)&indices);
     if (err) {
-        drm_tegra_bo_unref(scratch->attribs.bo);
-        scratch->attribs.map = NULL;
-        scratch->attribs.bo = NULL;
+        drm_tegra_bo_unref(exa->quad_indices);
+        exa->quad_indices = NULL;
         return false;
     }
 
+    /* same winding as quads were drawn by two separate triangles */
+    for (i = 0; i < TEGRA_QUAD_INDEX_BUFFER_QUADS; i++) {
+        *indices++ = i * 4 + 0;
+        *indices++ = i * 4 + 1;
+        *indices++ = i * 4 + 2;
+        *indices++ = i * 4 + 2;
+        *indices++ = i * 4 + 3;
+        *indices++ = i * 4 + 0;
+    }
+
+    drm_tegra_bo_unmap(exa->quad_indices);
+
+    return true;
+}
+
+/*
+ * Returns buffer of the ring that isn't used by the current job, an idle
+ * buffer is preferred. Buffers are taken in a round-robin fashion, hence
+ * the first busy buffer is the least recently used one and it's awaited
+ * if all buffers are busy.
+ */
+static struct tegra_attrib_ring_entry *
+tegra_exa_get_attributes_buffer(struct tegra_3d_state *state,
+                                struct tegra_exa *exa)
+{
+    struct tegra_exa_scratch *scratch = state->scratch;
+    struct tegra_attrib_ring_entry *entry = NULL;
+    struct tegra_attrib_ring_entry *lru = NULL;
+    struct tegra_attrib_ring_entry *e;
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_ATTRIB_RING_SIZE; i++) {
+        e = &scratch->attrib_ring[(scratch->attrib_ring_next + i) %
+                                  TEGRA_ATTRIB_RING_SIZE];
+        if (e->in_job)
+            continue;
+
+        if (!e->attribs.bo || TEGRA_FENCE_COMPLETED(e->fence)) {
+            entry = e;
+            break;
+        }
+
+        if (!lru)
+            lru = e;
+    }
+
+    if (!entry)
+        entry = lru;
+
+    if (!entry)
+        return NULL;
+
+    TEGRA_WAIT_AND_PUT_FENCE(entry->fence);
+
+    if (!entry->attribs.bo &&
+        !tegra_exa_create_attributes_bo(scratch, exa, &entry->attribs))
+        return NULL;
+
+    entry->in_job = true;
+    scratch->attrib_ring_next = (entry - scratch->attrib_ring + 1) %
+                                TEGRA_ATTRIB_RING_SIZE;
+
+    return entry;
+}
+
+static void tegra_exa_use_attributes_buffer(struct tegra_exa_scratch *scratch,
+                                            struct tegra_attrib_ring_entry *entry)
+{
+    scratch->attribs = entry->attribs;
+    scratch->attrib_offset = 0;
+    scratch->attrib_itr = 0;
+}
+
+static bool tegra_exa_allocate_attributes_buffer(struct tegra_3d_state *state,
+                                                 struct tegra_exa *exa)
+{
+    struct tegra_exa_scratch *scratch = state->scratch;
+    struct tegra_attrib_ring_entry *entry;
+
+    if (!exa->quad_indices && !tegra_exa_create_quad_indices(exa))
+        return false;
+
+    if (scratch->attribs.bo)
+        return true;
+
+    entry = tegra_exa_get_attributes_buffer(state, exa);
+    if (!entry)
+        return false;
+
+    tegra_exa_use_attributes_buffer(scratch, entry);
+
     return true;
 }
 
+/* GPU reads buffers of the submitted job until the job's fence is signalled */
+static void tegra_exa_attributes_buffers_submitted(struct tegra_3d_state *state,
+                                                   struct tegra_fence *fence)
+{
+    struct tegra_exa_scratch *scratch = state->scratch;
+    struct tegra_attrib_ring_entry *entry;
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_ATTRIB_RING_SIZE; i++) {
+        entry = &scratch->attrib_ring[i];
+
+        if (!entry->in_job)
+            continue;
+
+        TEGRA_FENCE_PUT(entry->fence);
+        entry->fence = TEGRA_FENCE_GET(fence, NULL);
+        entry->in_job = false;
+    }
+}
+
 static void tegra_exa_release_attributes_buffer(struct tegra_3d_state *state)
 {
     struct tegra_exa_scratch *scratch = state->scratch;
+    unsigned int i;
+
+    /*
+     * Buffers of a canceled job weren't touched by GPU, the previous
+     * fences are still valid for them.
+     */
+    for (i = 0; i < TEGRA_ATTRIB_RING_SIZE; i++)
+        scratch->attrib_ring[i].in_job = false;
 
-    drm_tegra_bo_unref(scratch->attribs.bo);
     scratch->attribs.map = NULL;
     scratch->attribs.bo = NULL;
     scratch->attrib_offset = 0;
@@ -67,6 +214,30 @@ static void tegra_exa_release_attributes_buffer(struct tegra_3d_state *state)
     scratch->vtx_cnt = 0;
 }
 
+static void tegra_exa_free_attributes_ring(struct tegra_exa_scratch *scratch)
+{
+    struct tegra_attrib_ring_entry *entry;
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_ATTRIB_RING_SIZE; i++) {
+        entry = &scratch->attrib_ring[i];
+
+        TEGRA_WAIT_AND_PUT_FENCE(entry->fence);
+        drm_tegra_bo_unref(entry->attribs.bo);
+        entry->attribs.map = NULL;
+        entry->attribs.bo = NULL;
+        entry->in_job = false;
+    }
+
+    scratch->attrib_ring_next = 0;
+}
+
+static void tegra_exa_free_quad_indices(struct tegra_exa *exa)
+{
+    drm_tegra_bo_unref(exa->quad_indices);
+    exa->quad_indices = NULL;
+}
+
 static void tegra_exa_3d_state_reset(struct tegra_3d_state *state)
 {
     struct tegra_exa *exa = state->exa;
@@ -99,6 +270,28 @@ tegra_exa_reselect_program(struct tegra_3d_state *state)
     return tegra_exa_select_optimized_gr3d_program(state, true);
 }
 
+/*
+ * Index count of a single draw is limited to 4096 by hardware, large
+ * batches are split into multiple draws and index pointer is advanced
+ * for each of them, vertex indices are relative to attributes pointers.
+ */
+#define TEGRA_QUADS_PER_DRAW    640
+
+static void tegra_exa_draw_quads(struct tegra_stream *cmds,
+                                 struct tegra_exa *exa,
+                                 unsigned int num_quads)
+{
+    unsigned int first, count;
+
+    for (first = 0; first < num_quads; first += count) {
+        count = min(num_quads - first, TEGRA_QUADS_PER_DRAW);
+
+        tgr3d_set_index_buf(cmds, exa->quad_indices,
+                            first * 6 * sizeof(uint16_t), false);
+        tgr3d_draw_primitives(cmds, 0, count * 6);
+    }
+}
+
 static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
 {
     struct tegra_exa_scratch *scratch = state->scratch;
@@ -155,7 +348,7 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
     } else {
         const_id++;
 
-        assert(state->num_jobs > 0);
+        /* job is deferred or continued with a chained attributes buffer */
 
         /*
          * Apparently GR3D has two caches for vertices: one for fetched memory,
@@ -177,7 +370,7 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
     }
 
     tgr3d_set_draw_params(cmds, TGR3D_PRIMITIVE_TYPE_TRIANGLES,
-                          TGR3D_INDEX_MODE_NONE, 0,
+                          TGR3D_INDEX_MODE_UINT16, 0,
                           vtx_mem_cache_invalidate,
                           vtx_gpu_cache_invalidate);
 
@@ -306,6 +499,10 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
             tgr3d_upload_const_fp(cmds, 5, FX10x2(tex->alpha, 0));
         }
 
+        /* distance to the inner circle and row of the lookup texture */
+        if (tex->radial)
+            tgr3d_upload_const_fp(cmds, 4, FX10x2(scratch->radial_offset, 0.5f));
+
         if (tex->transform_coords) {
             tgr3d_upload_const_vp(cmds, const_id++,
                                   pixman_fixed_to_double(scratch->transform_src.matrix[0][0]),
@@ -424,7 +621,7 @@ static void tegra_exa_finalize_3d_state(struct tegra_3d_state *state)
     if (state->new.prog != state->cur.prog)
         tgr3d_upload_program(cmds, state->new.prog);
 
-    tgr3d_draw_primitives(cmds, 0, scratch->vtx_cnt);
+    tegra_exa_draw_quads(cmds, state->exa, scratch->vtx_cnt / 4);
 
     scratch->vtx_cnt = 0;
     state->cur = state->new;
@@ -442,6 +639,7 @@ static bool tegra_exa_3d_state_append(struct tegra_3d_state *state,
     struct tegra_pixmap *priv;
     int err;
 
+    state->appended = *draw_state;
     state->new = *draw_state;
     state->scratch = scratch;
     state->clean = false;
@@ -498,7 +696,8 @@ static bool tegra_exa_3d_state_append(struct tegra_3d_state *state,
     }
 
     if (begin) {
-        err = tegra_stream_begin(cmds, tegra->gr3d);
+        err = tegra_stream_begin_predicted(cmds, tegra->gr3d,
+                                           &tegra->composite_3d_size);
         if (err) {
             tegra_exa_3d_state_reset(state);
             return false;
@@ -564,6 +763,8 @@ tegra_exa_submit_3d_state(struct tegra_3d_state *state)
     tegra = TegraPTR(pScrn)->exa;
 
     tegra->stats.num_3d_jobs_bytes += tegra_stream_pushbuf_size(state->cmds);
+    tegra_stream_predictor_update(&tegra->composite_3d_size,
+                                  state->cmds->num_pushed_words);
 
     /*
      * We can't batch up draw calls using upstream host1x driver because it
@@ -580,6 +781,8 @@ tegra_exa_submit_3d_state(struct tegra_3d_state *state)
     fence = tegra_exa_stream_submit(tegra, TEGRA_3D, explicit_fence);
     PROFILE_STOP(gr3d);
 
+    tegra_exa_attributes_buffers_submitted(state, fence);
+
     TEGRA_FENCE_PUT(explicit_fence);
 
     tegra->stats.num_3d_jobs++;
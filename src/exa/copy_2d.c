@@ -141,7 +141,8 @@ tegra_exa_prepare_copy_2d_ext(PixmapPtr src_pixmap, PixmapPtr dst_pixmap,
               dst_pixmap->devKind,
               priv->scanout);
 
-    err = tegra_stream_begin(tegra->cmds, tegra->gr2d);
+    err = tegra_stream_begin_predicted(tegra->cmds, tegra->gr2d,
+                                       &tegra->copy_2d_size);
     if (err < 0)
         return false;
 
@@ -405,6 +406,8 @@ static void tegra_exa_done_copy_2d(PixmapPtr dst_pixmap)
 
     if (tegra->scratch.ops && tegra->cmds->status == TEGRADRM_STREAM_CONSTRUCT) {
         tegra->stats.num_2d_copy_jobs_bytes += tegra_stream_pushbuf_size(tegra->cmds);
+        tegra_stream_predictor_update(&tegra->copy_2d_size,
+                                      tegra->cmds->num_pushed_words);
         tegra_stream_end(tegra->cmds);
 
         tegra_exa_wait_pixmaps(TEGRA_3D, dst_pixmap, 1, tegra->scratch.src);
@@ -251,4 +251,11 @@ void TegraEXAScreenExit(ScreenPtr pScreen)
     }
 }
 
+Bool TegraEXATexturedVideo(DrawablePtr draw,
+                           const TegraTexturedVideoFrame *frame,
+                           struct tegra_fence **fence)
+{
+    return tegra_exa_textured_video(draw, frame, fence);
+}
+
 /* vim: set et sts=4 sw=4 ts=4: */
@@ -45,6 +45,29 @@
 #define TEGRA_EXA_OFFSET_ALIGN  128
 
 #define TEGRA_ATTRIB_BUFFER_SIZE    (256 * 1024)
+#define TEGRA_ATTRIB_RING_SIZE      4
+
+/*
+ * Rectangles are drawn as indexed triangles, 4 vertices per quad. Index
+ * buffer is static and covers the largest number of quads that fits into
+ * attributes buffer, the smallest vertex is a single fp16 x/y pair.
+ */
+#define TEGRA_QUAD_INDEX_BUFFER_QUADS   (TEGRA_ATTRIB_BUFFER_SIZE / (4 * 4))
+#define TEGRA_QUAD_INDEX_BUFFER_SIZE    (TEGRA_QUAD_INDEX_BUFFER_QUADS * 6 * 2)
+
+#define TEGRA_GLYPH_ATLAS_WIDTH     1024
+#define TEGRA_GLYPH_ATLAS_HEIGHT    512
+#define TEGRA_GLYPH_CELL_SIZE       32
+#define TEGRA_GLYPH_ATLAS_CELLS     ((TEGRA_GLYPH_ATLAS_WIDTH  / TEGRA_GLYPH_CELL_SIZE) * \
+                                     (TEGRA_GLYPH_ATLAS_HEIGHT / TEGRA_GLYPH_CELL_SIZE))
+
+#define TEGRA_TRAPS_ATTRIB_BUFFER_SIZE  (64 * 1024)
+
+#define TEGRA_GRADIENT_LUT_WIDTH    256
+#define TEGRA_GRADIENT_LUT_NUM      8
+
+#define TEGRA_VIDEO_ATTRIB_SLOTS        2
+#define TEGRA_VIDEO_ATTRIB_SLOT_SIZE    (16 * 1024)
 
 #if 0
 #define FALLBACK_MSG(fmt, args...) \
@@ -160,6 +183,7 @@ struct tegra_texture_state {
     bool alpha : 1;
     bool pow2 : 1;
     bool transform_coords : 1;
+    bool radial : 1;
 };
 
 struct tegra_3d_draw_state {
@@ -187,6 +211,8 @@ struct tegra_3d_state {
     struct tegra_stream *cmds;
     struct tegra_3d_draw_state new;
     struct tegra_3d_draw_state cur;
+    /* draw state as given to append, before optimizations altered it */
+    struct tegra_3d_draw_state appended;
     struct tegra_fence *explicit_fence;
     unsigned int pixmaps_mmap_size;
     unsigned int num_pixmaps;
@@ -196,8 +222,9 @@ struct tegra_3d_state {
     bool inited : 1;
     bool clean : 1;
 
-    /* (textures + render targets) minus one buffer for vertex attributes */
-    struct tegra_pixmap_3d_state pixmaps[DRM_TEGRA_BO_TABLE_MAX_ENTRIES_NUM - 1];
+    /* (textures + render targets) minus vertex attributes and index buffers */
+    struct tegra_pixmap_3d_state pixmaps[DRM_TEGRA_BO_TABLE_MAX_ENTRIES_NUM -
+                                         TEGRA_ATTRIB_RING_SIZE - 1];
 };
 
 struct tegra_attrib_bo {
@@ -205,6 +232,54 @@ struct tegra_attrib_bo {
     __fp16 *map;
 };
 
+/*
+ * Attributes buffers are reused once GPU is done with them. Job may use
+ * multiple buffers, the next buffer is chained when current one is full.
+ */
+struct tegra_attrib_ring_entry {
+    struct tegra_attrib_bo attribs;
+    struct tegra_fence *fence;
+    bool in_job;
+};
+
+/*
+ * Colour stops of a gradient are interpolated into a one-dimensional
+ * lookup texture, textures are reused by gradients with the same stops.
+ */
+struct tegra_gradient_lut {
+    PixmapPtr pixmap;
+    PictGradientStop *stops;
+    int nstops;
+    unsigned int serial;    /* for LRU eviction */
+};
+
+enum tegra_glyph_atlas_format {
+    TEGRA_GLYPH_ATLAS_A8,
+    TEGRA_GLYPH_ATLAS_ARGB,
+    TEGRA_GLYPH_ATLAS_NUM,
+};
+
+struct tegra_glyph_atlas;
+
+struct tegra_glyph_cell {
+    struct xorg_list lru;
+    struct tegra_glyph_atlas *atlas;
+    GlyphPtr glyph;
+    unsigned int serial;    /* glyphs run that used the cell last time */
+    int x;
+    int y;
+};
+
+/*
+ * Glyphs are cached in fixed-size cells of the atlas, cells are evicted
+ * in LRU order. The least recently used cell is the first in the list.
+ */
+struct tegra_glyph_atlas {
+    PicturePtr picture;
+    struct xorg_list lru;
+    struct tegra_glyph_cell cells[TEGRA_GLYPH_ATLAS_CELLS];
+};
+
 enum tegra_2d_orientation {
     TEGRA2D_FLIP_X,
     TEGRA2D_FLIP_Y,
@@ -226,6 +301,8 @@ struct tegra_exa_scratch {
     enum tegra_2d_orientation orientation;
     enum tegra_2d_composite_op op2d;
     struct tegra_attrib_bo attribs;
+    struct tegra_attrib_ring_entry attrib_ring[TEGRA_ATTRIB_RING_SIZE];
+    unsigned attrib_ring_next;
     union {
         PictTransform transform;
 
@@ -236,6 +313,7 @@ struct tegra_exa_scratch {
             PictTransform transform_mask_inv;
         };
     };
+    float radial_offset;
     struct drm_tegra *drm;
     unsigned attrib_offset;
     unsigned attrib_itr;
@@ -313,8 +391,15 @@ struct tegra_exa_stats {
     uint64_t num_2d_solid_jobs_bytes;
     uint64_t num_3d_jobs;
     uint64_t num_3d_jobs_bytes;
+    uint64_t num_3d_video_jobs;
+    uint64_t num_3d_video_jobs_bytes;
+    uint64_t num_3d_traps_jobs;
+    uint64_t num_3d_traps_jobs_bytes;
     uint64_t num_cpu_read_accesses;
     uint64_t num_cpu_write_accesses;
+    uint64_t num_glyphs_uploaded;
+    uint64_t num_glyphs_fallbacks;
+    uint64_t num_gradient_luts_uploaded;
 };
 
 struct tegra_exa {
@@ -345,11 +430,36 @@ struct tegra_exa {
     CreatePictureProcPtr create_picture;
     ScreenBlockHandlerProcPtr block_handler;
     DestroyPixmapProcPtr destroy_pixmap;
+    GlyphsProcPtr glyphs;
+    UnrealizeGlyphProcPtr unrealize_glyph;
+    TrapezoidsProcPtr trapezoids;
+    TrianglesProcPtr triangles;
 
     struct xorg_list pixmaps_freelist;
 
     struct tegra_3d_state gr3d_state;
 
+    /*
+     * Attributes buffer of textured video, video frames are drawn using
+     * the slots in a round-robin fashion.
+     */
+    struct tegra_attrib_bo video_attribs;
+    struct tegra_fence *video_fence[TEGRA_VIDEO_ATTRIB_SLOTS];
+    unsigned int video_slot;
+
+    /* indices of the quads list, shared by all drawing contexts */
+    struct drm_tegra_bo *quad_indices;
+
+    /* vertices of the rasterized trapezoids and triangles */
+    struct tegra_attrib_bo traps_attribs;
+    struct tegra_fence *traps_fence;
+
+    struct tegra_glyph_atlas glyph_atlas[TEGRA_GLYPH_ATLAS_NUM];
+    unsigned int glyphs_serial;
+
+    struct tegra_gradient_lut gradient_luts[TEGRA_GRADIENT_LUT_NUM];
+    unsigned int gradients_serial;
+
     bool has_iommu_bug;
     bool has_iommu;
     bool has_gart;
@@ -359,6 +469,11 @@ struct tegra_exa {
 
     struct tegra_exa_stats stats;
 
+    /* predicted sizes of the jobs, reserved when job begins */
+    struct tegra_stream_size_predictor solid_2d_size;
+    struct tegra_stream_size_predictor copy_2d_size;
+    struct tegra_stream_size_predictor composite_3d_size;
+
     struct _TegraRec *tegra;
     bool prefer_sparse_bo_alloc;
 };
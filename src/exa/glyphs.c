@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Glyphs of a run are uploaded to the atlas first and then composited
+ * from it, hence all glyphs of the run share the same texture and the
+ * deferred 3D state merges the draws into a single job.
+ */
+
+static DevPrivateKeyRec tegra_exa_glyph_key;
+
+static struct tegra_glyph_cell **tegra_exa_glyph_cell_ptr(GlyphPtr glyph)
+{
+    return dixGetPrivateAddr(&glyph->devPrivates, &tegra_exa_glyph_key);
+}
+
+static int tegra_exa_glyph_atlas_format(PicturePtr picture)
+{
+    switch (picture->format) {
+    case PICT_a8:
+        return TEGRA_GLYPH_ATLAS_A8;
+
+    case PICT_a8r8g8b8:
+        return TEGRA_GLYPH_ATLAS_ARGB;
+
+    default:
+        return -1;
+    }
+}
+
+static bool tegra_exa_glyph_format_needs_component_alpha(CARD32 format)
+{
+    return PICT_FORMAT_A(format) != 0 && PICT_FORMAT_RGB(format) != 0;
+}
+
+static struct tegra_glyph_cell *
+tegra_exa_glyph_cached_cell(struct tegra_exa *exa, GlyphPtr glyph)
+{
+    struct tegra_glyph_cell *cell = *tegra_exa_glyph_cell_ptr(glyph);
+
+    /* glyph private is shared by screens */
+    if (!cell || cell->glyph != glyph)
+        return NULL;
+
+    if (cell->atlas < exa->glyph_atlas ||
+        cell->atlas >= exa->glyph_atlas + TEGRA_GLYPH_ATLAS_NUM)
+        return NULL;
+
+    return cell;
+}
+
+static bool tegra_exa_realize_glyph_atlas(ScreenPtr screen,
+                                          struct tegra_glyph_atlas *atlas,
+                                          PicturePtr glyph_picture)
+{
+    unsigned int columns = TEGRA_GLYPH_ATLAS_WIDTH / TEGRA_GLYPH_CELL_SIZE;
+    struct tegra_glyph_cell *cell;
+    CARD32 component_alpha;
+    PictFormatPtr format;
+    PixmapPtr pixmap;
+    unsigned int i;
+    int depth;
+    int error;
+
+    if (atlas->picture)
+        return true;
+
+    depth = glyph_picture->pDrawable->depth;
+
+    format = PictureMatchFormat(screen, depth, glyph_picture->format);
+    if (!format)
+        return false;
+
+    pixmap = screen->CreatePixmap(screen,
+                                  TEGRA_GLYPH_ATLAS_WIDTH,
+                                  TEGRA_GLYPH_ATLAS_HEIGHT,
+                                  depth, 0);
+    if (!pixmap)
+        return false;
+
+    component_alpha = tegra_exa_glyph_format_needs_component_alpha(format->format);
+
+    atlas->picture = CreatePicture(0, &pixmap->drawable, format,
+                                   CPComponentAlpha, &component_alpha,
+                                   serverClient, &error);
+
+    /* picture holds the pixmap reference */
+    screen->DestroyPixmap(pixmap);
+
+    if (!atlas->picture)
+        return false;
+
+    ValidatePicture(atlas->picture);
+
+    xorg_list_init(&atlas->lru);
+
+    for (i = 0; i < TEGRA_GLYPH_ATLAS_CELLS; i++) {
+        cell = &atlas->cells[i];
+        cell->atlas = atlas;
+        cell->glyph = NULL;
+        cell->serial = 0;
+        cell->x = (i % columns) * TEGRA_GLYPH_CELL_SIZE;
+        cell->y = (i / columns) * TEGRA_GLYPH_CELL_SIZE;
+
+        xorg_list_append(&cell->lru, &atlas->lru);
+    }
+
+    return true;
+}
+
+static struct tegra_glyph_cell *
+tegra_exa_cache_glyph(ScreenPtr screen, struct tegra_exa *exa,
+                      struct tegra_glyph_atlas *atlas, GlyphPtr glyph,
+                      PicturePtr glyph_picture)
+{
+    struct tegra_glyph_cell *cell;
+
+    cell = tegra_exa_glyph_cached_cell(exa, glyph);
+    if (!cell) {
+        cell = xorg_list_first_entry(&atlas->lru, struct tegra_glyph_cell, lru);
+
+        /* all cells are taken by the current run */
+        if (cell->serial == exa->glyphs_serial)
+            return NULL;
+
+        if (cell->glyph)
+            *tegra_exa_glyph_cell_ptr(cell->glyph) = NULL;
+
+        cell->glyph = glyph;
+        *tegra_exa_glyph_cell_ptr(glyph) = cell;
+
+        CompositePicture(PictOpSrc, glyph_picture, NULL, atlas->picture,
+                         0, 0, 0, 0, cell->x, cell->y,
+                         glyph->info.width, glyph->info.height);
+
+        exa->stats.num_glyphs_uploaded++;
+    }
+
+    cell->serial = exa->glyphs_serial;
+
+    xorg_list_del(&cell->lru);
+    xorg_list_append(&cell->lru, &atlas->lru);
+
+    return cell;
+}
+
+/*
+ * Uploads all glyphs of the run before compositing, so that uploading
+ * doesn't flush the deferred draws that read the atlas.
+ */
+static bool tegra_exa_cache_glyphs(ScreenPtr screen, struct tegra_exa *exa,
+                                   int nlist, GlyphListPtr list,
+                                   GlyphPtr *glyphs)
+{
+    struct tegra_glyph_atlas *atlas;
+    PicturePtr glyph_picture;
+    GlyphPtr glyph;
+    int format;
+    int n;
+
+    /* zero is never used, cells are initialized with it */
+    if (++exa->glyphs_serial == 0)
+        exa->glyphs_serial = 1;
+
+    while (nlist--) {
+        n = list->len;
+
+        while (n--) {
+            glyph = *glyphs++;
+
+            if (glyph->info.width == 0 || glyph->info.height == 0)
+                continue;
+
+            if (glyph->info.width > TEGRA_GLYPH_CELL_SIZE ||
+                glyph->info.height > TEGRA_GLYPH_CELL_SIZE)
+                return false;
+
+            glyph_picture = GetGlyphPicture(glyph, screen);
+            if (!glyph_picture)
+                return false;
+
+            format = tegra_exa_glyph_atlas_format(glyph_picture);
+            if (format < 0)
+                return false;
+
+            atlas = &exa->glyph_atlas[format];
+
+            if (!tegra_exa_realize_glyph_atlas(screen, atlas, glyph_picture))
+                return false;
+
+            if (!tegra_exa_cache_glyph(screen, exa, atlas, glyph, glyph_picture))
+                return false;
+        }
+
+        list++;
+    }
+
+    return true;
+}
+
+static PicturePtr tegra_exa_create_mask_picture(ScreenPtr screen,
+                                               PictFormatPtr mask_format,
+                                               int width, int height)
+{
+    CARD32 component_alpha;
+    PicturePtr mask;
+    PixmapPtr pixmap;
+    xRectangle rect;
+    GCPtr gc;
+    int error;
+
+    pixmap = screen->CreatePixmap(screen, width, height, mask_format->depth,
+                                  CREATE_PIXMAP_USAGE_SCRATCH);
+    if (!pixmap)
+        return NULL;
+
+    component_alpha = tegra_exa_glyph_format_needs_component_alpha(mask_format->format);
+
+    mask = CreatePicture(0, &pixmap->drawable, mask_format,
+                         CPComponentAlpha, &component_alpha,
+                         serverClient, &error);
+    if (!mask)
+        goto destroy_pixmap;
+
+    gc = GetScratchGC(pixmap->drawable.depth, screen);
+    if (!gc) {
+        FreePicture(mask, 0);
+        mask = NULL;
+        goto destroy_pixmap;
+    }
+
+    ValidateGC(&pixmap->drawable, gc);
+
+    rect.x = 0;
+    rect.y = 0;
+    rect.width = width;
+    rect.height = height;
+
+    gc->ops->PolyFillRect(&pixmap->drawable, gc, 1, &rect);
+    FreeScratchGC(gc);
+
+    ValidatePicture(mask);
+
+destroy_pixmap:
+    /* picture holds the pixmap reference */
+    screen->DestroyPixmap(pixmap);
+
+    return mask;
+}
+
+static void tegra_exa_glyphs(CARD8 op,
+                             PicturePtr src,
+                             PicturePtr dst,
+                             PictFormatPtr mask_format,
+                             INT16 x_src, INT16 y_src,
+                             int nlist, GlyphListPtr list,
+                             GlyphPtr *glyphs)
+{
+    ScreenPtr screen = dst->pDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(screen);
+    struct tegra_exa *exa = TegraPTR(pScrn)->exa;
+    struct tegra_glyph_cell *cell;
+    PicturePtr mask = NULL;
+    int width = 0, height = 0;
+    int x_dst, y_dst;
+    BoxRec extents;
+    GlyphPtr glyph;
+    int x, y;
+    int gx, gy;
+    int n;
+
+    if (!tegra_exa_cache_glyphs(screen, exa, nlist, list, glyphs)) {
+        exa->stats.num_glyphs_fallbacks++;
+        exa->glyphs(op, src, dst, mask_format, x_src, y_src,
+                    nlist, list, glyphs);
+        return;
+    }
+
+    x_dst = list->xOff;
+    y_dst = list->yOff;
+
+    if (mask_format) {
+        GlyphExtents(nlist, list, glyphs, &extents);
+
+        if (extents.x2 <= extents.x1 || extents.y2 <= extents.y1)
+            return;
+
+        width  = extents.x2 - extents.x1;
+        height = extents.y2 - extents.y1;
+
+        mask = tegra_exa_create_mask_picture(screen, mask_format,
+                                            width, height);
+        if (!mask) {
+            exa->stats.num_glyphs_fallbacks++;
+            exa->glyphs(op, src, dst, mask_format, x_src, y_src,
+                        nlist, list, glyphs);
+            return;
+        }
+
+        x = -extents.x1;
+        y = -extents.y1;
+    } else {
+        x = 0;
+        y = 0;
+    }
+
+    while (nlist--) {
+        x += list->xOff;
+        y += list->yOff;
+        n = list->len;
+
+        while (n--) {
+            glyph = *glyphs++;
+
+            if (glyph->info.width && glyph->info.height) {
+                cell = tegra_exa_glyph_cached_cell(exa, glyph);
+                gx = x - glyph->info.x;
+                gy = y - glyph->info.y;
+
+                if (mask)
+                    CompositePicture(PictOpAdd, cell->atlas->picture, NULL,
+                                     mask, cell->x, cell->y, 0, 0, gx, gy,
+                                     glyph->info.width, glyph->info.height);
+                else
+                    CompositePicture(op, src, cell->atlas->picture, dst,
+                                     x_src + gx - x_dst, y_src + gy - y_dst,
+                                     cell->x, cell->y, gx, gy,
+                                     glyph->info.width, glyph->info.height);
+            }
+
+            x += glyph->info.xOff;
+            y += glyph->info.yOff;
+        }
+
+        list++;
+    }
+
+    if (mask) {
+        CompositePicture(op, src, mask, dst,
+                         x_src + extents.x1 - x_dst,
+                         y_src + extents.y1 - y_dst,
+                         0, 0, extents.x1, extents.y1,
+                         width, height);
+
+        FreePicture(mask, 0);
+    }
+}
+
+static void tegra_exa_unrealize_glyph(ScreenPtr screen, GlyphPtr glyph)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(screen);
+    struct tegra_exa *exa = TegraPTR(pScrn)->exa;
+    struct tegra_glyph_cell *cell;
+
+    cell = tegra_exa_glyph_cached_cell(exa, glyph);
+    if (cell) {
+        *tegra_exa_glyph_cell_ptr(glyph) = NULL;
+        cell->glyph = NULL;
+
+        /* vacant cell is reused first */
+        xorg_list_del(&cell->lru);
+        xorg_list_add(&cell->lru, &cell->atlas->lru);
+    }
+
+    if (exa->unrealize_glyph)
+        exa->unrealize_glyph(screen, glyph);
+}
+
+static void tegra_exa_wrap_glyphs(PictureScreenPtr ps, struct tegra_exa *exa)
+{
+    if (!ps->Glyphs)
+        return;
+
+    if (!dixRegisterPrivateKey(&tegra_exa_glyph_key, PRIVATE_GLYPH,
+                               sizeof(struct tegra_glyph_cell *)))
+        return;
+
+    exa->glyphs = ps->Glyphs;
+    ps->Glyphs = tegra_exa_glyphs;
+
+    exa->unrealize_glyph = ps->UnrealizeGlyph;
+    ps->UnrealizeGlyph = tegra_exa_unrealize_glyph;
+}
+
+static void tegra_exa_unwrap_glyphs(PictureScreenPtr ps, struct tegra_exa *exa)
+{
+    struct tegra_glyph_atlas *atlas;
+    struct tegra_glyph_cell *cell;
+    unsigned int i, k;
+
+    if (!exa->glyphs)
+        return;
+
+    for (i = 0; i < TEGRA_GLYPH_ATLAS_NUM; i++) {
+        atlas = &exa->glyph_atlas[i];
+
+        if (!atlas->picture)
+            continue;
+
+        for (k = 0; k < TEGRA_GLYPH_ATLAS_CELLS; k++) {
+            cell = &atlas->cells[k];
+
+            if (cell->glyph)
+                *tegra_exa_glyph_cell_ptr(cell->glyph) = NULL;
+        }
+
+        FreePicture(atlas->picture, 0);
+        atlas->picture = NULL;
+    }
+
+    ps->Glyphs = exa->glyphs;
+    ps->UnrealizeGlyph = exa->unrealize_glyph;
+
+    exa->glyphs = NULL;
+    exa->unrealize_glyph = NULL;
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Gradient pictures are drawn as a texture of the interpolated colour
+ * stops. Texture coordinates of the linear gradient are computed by the
+ * vertex program using the texture transformation, radial gradient passes
+ * the distance to the center and the fragment program takes the length.
+ */
+
+/* uniform of the radial gradient programs is FX10 */
+#define TEGRA_GRADIENT_MAX_RADIAL_OFFSET    1.99
+
+static bool tegra_exa_gradient_transform_is_affine(PictTransformPtr t)
+{
+    if (!t)
+        return true;
+
+    return t->matrix[2][0] == 0 && t->matrix[2][1] == 0 &&
+           t->matrix[2][2] == pixman_fixed_1;
+}
+
+static bool tegra_exa_check_gradient(PicturePtr picture)
+{
+    SourcePictPtr source = picture->pSourcePict;
+    PictRadialGradient *radial;
+    PictLinearGradient *linear;
+    xFixed r1, r2;
+
+    if (source->type != SourcePictTypeLinear &&
+        source->type != SourcePictTypeRadial) {
+        FALLBACK_MSG("unsupported gradient type %u\n", source->type);
+        return false;
+    }
+
+    if (source->gradient.nstops < 1) {
+        FALLBACK_MSG("gradient without stops\n");
+        return false;
+    }
+
+    /* transparent area outside of the gradient isn't supported */
+    if (picture->repeatType == RepeatNone) {
+        FALLBACK_MSG("unsupported gradient repeat type %u\n",
+                     picture->repeatType);
+        return false;
+    }
+
+    if (!tegra_exa_gradient_transform_is_affine(picture->transform)) {
+        FALLBACK_MSG("unsupported gradient transform\n");
+        return false;
+    }
+
+    if (source->type == SourcePictTypeLinear) {
+        linear = &source->linear;
+
+        if (linear->p1.x == linear->p2.x &&
+            linear->p1.y == linear->p2.y) {
+            FALLBACK_MSG("degenerate linear gradient\n");
+            return false;
+        }
+
+        return true;
+    }
+
+    radial = &source->radial;
+    r1 = radial->c1.radius;
+    r2 = radial->c2.radius;
+
+    if (radial->c1.x != radial->c2.x || radial->c1.y != radial->c2.y) {
+        FALLBACK_MSG("non-concentric radial gradient\n");
+        return false;
+    }
+
+    if (r1 < 0 || r2 <= r1) {
+        FALLBACK_MSG("unsupported radial gradient radii\n");
+        return false;
+    }
+
+    if ((double) r1 / (r2 - r1) > TEGRA_GRADIENT_MAX_RADIAL_OFFSET) {
+        FALLBACK_MSG("too thin radial gradient\n");
+        return false;
+    }
+
+    return true;
+}
+
+static CARD32 tegra_exa_gradient_color(PictGradient *gradient, xFixed x)
+{
+    PictGradientStop *stops = gradient->stops;
+    PictGradientStop *left, *right;
+    double k, a, r, g, b;
+    int i;
+
+    for (i = 0; i < gradient->nstops; i++) {
+        if (stops[i].x >= x)
+            break;
+    }
+
+    /* colors of the first and last stops are extended */
+    left  = &stops[max(i - 1, 0)];
+    right = &stops[min(i, gradient->nstops - 1)];
+
+    if (right->x == left->x)
+        k = 0.0;
+    else
+        k = (double) (x - left->x) / (right->x - left->x);
+
+    /* pixman interpolates non-premultiplied colors */
+    a = left->color.alpha + (right->color.alpha - left->color.alpha) * k;
+    r = left->color.red   + (right->color.red   - left->color.red)   * k;
+    g = left->color.green + (right->color.green - left->color.green) * k;
+    b = left->color.blue  + (right->color.blue  - left->color.blue)  * k;
+
+    a /= 65535.0;
+
+    return (CARD32) (a * 255.0 + 0.5) << 24 |
+           (CARD32) (r * a / 257.0 + 0.5) << 16 |
+           (CARD32) (g * a / 257.0 + 0.5) << 8 |
+           (CARD32) (b * a / 257.0 + 0.5);
+}
+
+static bool tegra_exa_fill_gradient_lut(PixmapPtr pixmap,
+                                        PictGradient *gradient)
+{
+    CARD32 *texels;
+    xFixed x;
+    void *ptr;
+    int i;
+
+    if (!tegra_exa_prepare_cpu_access(pixmap, EXA_PREPARE_DEST, &ptr, true))
+        return false;
+
+    texels = ptr;
+
+    /* texel samples the gradient at its center */
+    for (i = 0; i < TEGRA_GRADIENT_LUT_WIDTH; i++) {
+        x = pixman_double_to_fixed((i + 0.5) / TEGRA_GRADIENT_LUT_WIDTH);
+        texels[i] = tegra_exa_gradient_color(gradient, x);
+    }
+
+    tegra_exa_finish_cpu_access(pixmap, EXA_PREPARE_DEST);
+
+    return true;
+}
+
+static void tegra_exa_release_gradient_lut(ScreenPtr screen,
+                                           struct tegra_gradient_lut *lut)
+{
+    if (lut->pixmap)
+        screen->DestroyPixmap(lut->pixmap);
+
+    free(lut->stops);
+
+    memset(lut, 0, sizeof(*lut));
+}
+
+static PixmapPtr tegra_exa_gradient_lut(ScreenPtr screen,
+                                        struct tegra_exa *exa,
+                                        PictGradient *gradient)
+{
+    size_t stops_size = gradient->nstops * sizeof(*gradient->stops);
+    struct tegra_gradient_lut *lut, *lru = NULL;
+    unsigned int i;
+
+    exa->gradients_serial++;
+
+    for (i = 0; i < TEGRA_GRADIENT_LUT_NUM; i++) {
+        lut = &exa->gradient_luts[i];
+
+        if (lut->pixmap && lut->nstops == gradient->nstops &&
+            !memcmp(lut->stops, gradient->stops, stops_size)) {
+            lut->serial = exa->gradients_serial;
+            return lut->pixmap;
+        }
+
+        if (!lru || !lut->pixmap ||
+            (lru->pixmap && lut->serial < lru->serial))
+            lru = lut;
+    }
+
+    tegra_exa_release_gradient_lut(screen, lru);
+
+    lru->stops = malloc(stops_size);
+    if (!lru->stops)
+        return NULL;
+
+    lru->pixmap = screen->CreatePixmap(screen, TEGRA_GRADIENT_LUT_WIDTH, 1,
+                                       32, 0);
+    if (!lru->pixmap)
+        goto release;
+
+    if (!tegra_exa_fill_gradient_lut(lru->pixmap, gradient))
+        goto release;
+
+    memcpy(lru->stops, gradient->stops, stops_size);
+    lru->nstops = gradient->nstops;
+    lru->serial = exa->gradients_serial;
+
+    exa->stats.num_gradient_luts_uploaded++;
+
+    return lru->pixmap;
+
+release:
+    tegra_exa_release_gradient_lut(screen, lru);
+
+    return NULL;
+}
+
+/*
+ * Computes texture transformation of the gradient, the first row yields
+ * the linear gradient parameter or the horizontal distance to the radial
+ * gradient center, the second row yields the vertical distance or the
+ * center of the texture row.
+ */
+static bool tegra_exa_gradient_transform(PicturePtr picture, PixmapPtr lut,
+                                         PictTransformPtr transform,
+                                         float *radial_offset)
+{
+    SourcePictPtr source = picture->pSourcePict;
+    PictTransformPtr t = picture->transform;
+    double tm[2][3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 } };
+    double row[2][3], m[2][3], s;
+    double x1, y1, x2, y2, dx, dy, l2;
+    unsigned int i, j;
+
+    if (t) {
+        for (i = 0; i < 2; i++) {
+            for (j = 0; j < 3; j++)
+                tm[i][j] = pixman_fixed_to_double(t->matrix[i][j]);
+        }
+    }
+
+    if (source->type == SourcePictTypeLinear) {
+        x1 = pixman_fixed_to_double(source->linear.p1.x);
+        y1 = pixman_fixed_to_double(source->linear.p1.y);
+        x2 = pixman_fixed_to_double(source->linear.p2.x);
+        y2 = pixman_fixed_to_double(source->linear.p2.y);
+
+        dx = x2 - x1;
+        dy = y2 - y1;
+        l2 = dx * dx + dy * dy;
+
+        row[0][0] = dx / l2;
+        row[0][1] = dy / l2;
+        row[0][2] = -(x1 * dx + y1 * dy) / l2;
+
+        row[1][0] = 0.0;
+        row[1][1] = 0.0;
+        row[1][2] = 0.5;
+
+        *radial_offset = 0.0f;
+    } else {
+        x1 = pixman_fixed_to_double(source->radial.c1.x);
+        y1 = pixman_fixed_to_double(source->radial.c1.y);
+
+        s = 1.0 / pixman_fixed_to_double(source->radial.c2.radius -
+                                         source->radial.c1.radius);
+
+        row[0][0] = s;
+        row[0][1] = 0.0;
+        row[0][2] = -x1 * s;
+
+        row[1][0] = 0.0;
+        row[1][1] = s;
+        row[1][2] = -y1 * s;
+
+        *radial_offset = pixman_fixed_to_double(source->radial.c1.radius) * s;
+    }
+
+    /* gradient is evaluated in the picture space */
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < 3; j++)
+            m[i][j] = row[i][0] * tm[0][j] + row[i][1] * tm[1][j];
+
+        m[i][2] += row[i][2];
+    }
+
+    /* vertex program normalizes coordinates by the texture size */
+    for (j = 0; j < 3; j++) {
+        m[0][j] *= lut->drawable.width;
+        m[1][j] *= lut->drawable.height;
+    }
+
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < 3; j++) {
+            if (m[i][j] >= 32767.0 || m[i][j] <= -32767.0) {
+                FALLBACK_MSG("gradient transform overflow\n");
+                return false;
+            }
+
+            transform->matrix[i][j] = pixman_double_to_fixed(m[i][j]);
+        }
+    }
+
+    transform->matrix[2][0] = 0;
+    transform->matrix[2][1] = 0;
+    transform->matrix[2][2] = pixman_fixed_1;
+
+    return true;
+}
+
+static void tegra_exa_release_gradients(ScreenPtr screen,
+                                        struct tegra_exa *exa)
+{
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_GRADIENT_LUT_NUM; i++)
+        tegra_exa_release_gradient_lut(screen, &exa->gradient_luts[i]);
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
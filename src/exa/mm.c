@@ -29,7 +29,8 @@ static unsigned int tegra_exa_max_sparse_size(void)
 
     /* large BOs won't fit into GART on Tegra20 */
     max_sparse_size  = max_gart_size / max_bos_per_3d_job;
-    max_sparse_size -= TEGRA_ATTRIB_BUFFER_SIZE;
+    max_sparse_size -= TEGRA_ATTRIB_BUFFER_SIZE * TEGRA_ATTRIB_RING_SIZE;
+    max_sparse_size -= TEGRA_QUAD_INDEX_BUFFER_SIZE;
 
     return max_sparse_size;
 }
@@ -113,6 +114,92 @@ static bool tegra_exa_pixmap_allocate_from_sysmem(TegraPtr tegra,
     return true;
 }
 
+/*
+ * Sizes of BOs allocated during startup are saved into the warm-up file
+ * at exit, the next session preallocates BOs of the most demanded sizes
+ * into the BO cache. This covers pixmaps, pools, command buffers and
+ * attribute buffers since all of them come from the BO cache.
+ */
+#define TEGRA_EXA_WARMUP_MAX_ENTRIES    32
+#define TEGRA_EXA_WARMUP_MAX_BOS        8
+#define TEGRA_EXA_WARMUP_MAX_SIZE       (16 * 1024 * 1024)
+
+static void tegra_exa_warmup_bo_cache(TegraPtr tegra)
+{
+    const char *path = tegra->exa_bo_warmup_path;
+    unsigned long total_size = 0;
+    unsigned int size, flags, count;
+    unsigned int num_bos = 0;
+    unsigned int i;
+    FILE *file;
+    int ret;
+
+    file = fopen(path, "r");
+    if (!file) {
+        if (errno != ENOENT)
+            ERROR_MSG("failed to open %s: %s\n", path, strerror(errno));
+        return;
+    }
+
+    for (i = 0; i < TEGRA_EXA_WARMUP_MAX_ENTRIES; i++) {
+        if (fscanf(file, "%u %x %u", &size, &flags, &count) != 3)
+            break;
+
+        count = min(count, TEGRA_EXA_WARMUP_MAX_BOS);
+
+        if (total_size + (unsigned long)size * count > TEGRA_EXA_WARMUP_MAX_SIZE)
+            continue;
+
+        ret = drm_tegra_bo_cache_prefill(tegra->drm, flags, size, count);
+        if (ret < 0)
+            continue;
+
+        total_size += (unsigned long)size * ret;
+        num_bos += ret;
+    }
+
+    fclose(file);
+
+    INFO_MSG2("EXA preallocated %u BOs of %luKB total\n",
+              num_bos, total_size / 1024);
+}
+
+static void tegra_exa_save_bo_histogram(TegraPtr tegra)
+{
+    struct drm_tegra_bo_size_stat stats[TEGRA_EXA_WARMUP_MAX_ENTRIES];
+    const char *path = tegra->exa_bo_warmup_path;
+    char *tmp_path;
+    FILE *file;
+    int i, num;
+
+    num = drm_tegra_bo_cache_get_histogram(tegra->drm, stats,
+                                           TEGRA_ARRAY_SIZE(stats));
+    if (num <= 0)
+        return;
+
+    /* don't leave a truncated file behind if Xorg is killed */
+    if (Xasprintf(&tmp_path, "%s.tmp", path) < 0)
+        return;
+
+    file = fopen(tmp_path, "w");
+    if (!file) {
+        ERROR_MSG("failed to create %s: %s\n", tmp_path, strerror(errno));
+        free(tmp_path);
+        return;
+    }
+
+    for (i = 0; i < num; i++)
+        fprintf(file, "%u %x %u\n",
+                stats[i].size, stats[i].flags, stats[i].count);
+
+    if (fclose(file) || rename(tmp_path, path)) {
+        ERROR_MSG("failed to save %s: %s\n", path, strerror(errno));
+        unlink(tmp_path);
+    }
+
+    free(tmp_path);
+}
+
 static int tegra_exa_init_mm(TegraPtr tegra, struct tegra_exa *exa)
 {
     bool has_iommu = false;
@@ -194,6 +281,10 @@ static int tegra_exa_init_mm(TegraPtr tegra, struct tegra_exa *exa)
         }
     }
 
+    /* the large pool goes first since it needs a big contiguous chunk */
+    if (tegra->exa_bo_warmup_path)
+        tegra_exa_warmup_bo_cache(tegra);
+
     return 0;
 }
 
@@ -201,6 +292,9 @@ static void tegra_exa_release_mm(TegraPtr tegra, struct tegra_exa *exa)
 {
     tegra_exa_clean_up_pixmaps_freelist(tegra, true);
 
+    if (tegra->exa_bo_warmup_path)
+        tegra_exa_save_bo_histogram(tegra);
+
     if (exa->large_pool) {
         exa->large_pool->persistent = false;
 
@@ -38,6 +38,7 @@ static int tegra_exa_init_optimizations(TegraPtr tegra, struct tegra_exa *exa)
             goto fail;
         }
 
+        exa->opt_state[i].cmds->batch_2d = true;
         exa->opt_state[i].scratch.drm = tegra->drm;
         exa->opt_state[i].id = i;
 
@@ -59,6 +60,8 @@ static void tegra_exa_deinit_optimizations(struct tegra_exa *tegra)
     unsigned int i = TEGRA_OPT_NUM, k;
 
     while (i--) {
+        tegra_exa_free_attributes_ring(&tegra->opt_state[i].scratch);
+
         for (k = 0; k < TEGRA_ENGINES_NUM; k++) {
             if (tegra->opt_state[i].cmds->last_fence[k] == poisoned_fence)
                 tegra->opt_state[i].cmds->last_fence[k] = NULL;
@@ -40,6 +40,9 @@ tegra_exa_select_optimized_gr3d_program(struct tegra_3d_state *state,
    unsigned mask_sel = state->new.mask.tex_sel;
    unsigned src_sel  = state->new.src.tex_sel;
 
+   if (state->new.src.radial)
+      return tegra_exa_radial_gradient_program(state->new.op);
+
    /* pow2 texture can use more optimized shaders */
    if (state->new.src.pow2 && (src_sel == TEX_NORMAL ||
                                src_sel == TEX_MIRROR))
@@ -403,6 +406,8 @@ tegra_exa_submit_deferred_3d_jobs(struct tegra_3d_state *state)
         return NULL;
 
     exa->stats.num_3d_jobs_bytes += tegra_stream_pushbuf_size(state->cmds);
+    tegra_stream_predictor_update(&exa->composite_3d_size,
+                                  state->cmds->num_pushed_words);
 
     tegra_stream_end(state->cmds);
 
@@ -412,6 +417,8 @@ tegra_exa_submit_deferred_3d_jobs(struct tegra_3d_state *state)
     fence = tegra_exa_stream_submit(exa, TEGRA_3D, state->explicit_fence);
     PROFILE_STOP(deferred_gr3d);
 
+    tegra_exa_attributes_buffers_submitted(state, fence);
+
     tegra_exa_3d_state_reset(state);
 
     exa->stats.num_3d_jobs++;
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+pseq_to_dw_exec_nb = 1	// the number of 'EXEC' block where DW happens
+alu_buffer_size = 1	// number of .rgba regs carried through pipeline
+
+.uniforms
+	[0].l = "coverage";
+
+.asm
+
+EXEC
+	// fetch dst pixel to r2,r3
+	PSEQ:	0x0081000A
+
+	// dst = coverage.aaaa + dst.bgra
+	ALU:
+		ALU0:	MAD  r0.l, u0.l, #1, r2.l (sat)
+		ALU1:	MAD  r0.h, u0.l, #1, r2.h (sat)
+		ALU2:	MAD  r1.l, u0.l, #1, r3.l (sat)
+		ALU3:	MAD  r1.h, u0.l, #1, r3.h (sat)
+
+	DW:	store rt1, r0, r1
+;
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+pseq_to_dw_exec_nb = 3	// the number of 'EXEC' block where DW happens
+alu_buffer_size = 1	// number of .rgba regs carried through pipeline
+
+.uniforms
+	[0].l = "kyrgb";
+	[0].h = "yof";
+
+	// chroma coefficients are halved to fit fx10, result is scaled x2
+	[1].l = "kub";
+	[1].h = "kub_offset";
+	[2].l = "kug";
+	[2].h = "kug_offset";
+	[3].l = "kur";
+	[3].h = "kur_offset";
+	[4].l = "kvb";
+	[4].h = "kvb_offset";
+	[5].l = "kvg";
+	[5].h = "kvg_offset";
+	[6].l = "kvr";
+	[6].h = "kvr_offset";
+
+.asm
+
+EXEC
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t0.fp20, t0.fp20, NOP, NOP
+
+	// sample tex0 (Y plane)
+	TEX:	tex r2, r3, tex0, r0, r1, r2
+
+	// y = Y * kyrgb + yof
+	ALU:
+		ALU0:	MAD  r2.l, r2.l, u0.l, u0.h
+;
+
+EXEC
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t0.fp20, t0.fp20, NOP, NOP
+
+	// sample tex1 (U plane)
+	TEX:	tex r0, r1, tex1, r0, r1, r2
+
+	// ub = (U - 0.5) * kub
+	// ug = (U - 0.5) * kug
+	// ur = (U - 0.5) * kur
+	ALU:
+		ALU0:	MAD  r3.l, r0.l, u1.l, u1.h (x2)
+		ALU1:	MAD  r2.h, r0.l, u2.l, u2.h (x2)
+		ALU2:	MAD  r3.h, r0.l, u3.l, u3.h (x2)
+;
+
+EXEC
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t0.fp20, t0.fp20, NOP, NOP
+
+	// sample tex2 (V plane)
+	TEX:	tex r0, r1, tex2, r0, r1, r2
+
+	// vb = (V - 0.5) * kvb
+	// vg = (V - 0.5) * kvg
+	// vr = (V - 0.5) * kvr
+	ALU:
+		ALU0:	MAD  lp.lh, r0.l, u4.l, u4.h (x2)
+		ALU1:	MAD  lp.lh, r0.l, u5.l, u5.h (x2)
+		ALU2:	MAD  lp.lh, r0.l, u6.l, u6.h (x2)
+
+	// chroma = ub,ug,ur + vb,vg,vr
+	ALU:
+		ALU0:	MAD  lp.lh, alu0, #1, r3.l
+		ALU1:	MAD  lp.lh, alu1, #1, r2.h
+		ALU2:	MAD  lp.lh, alu2, #1, r3.h
+
+	// dst.bgra = y + chroma, 1.0
+	ALU:
+		ALU0:	MAD  r0.l, alu0, #1, r2.l (sat)
+		ALU1:	MAD  r0.h, alu1, #1, r2.l (sat)
+		ALU2:	MAD  r1.l, alu2, #1, r2.l (sat)
+		ALU3:	MAD  r1.h,   #0, #0, #1
+
+	DW:	store rt1, r0, r1
+;
@@ -85,7 +85,8 @@ tegra_exa_prepare_solid_2d(PixmapPtr pixmap, int op, Pixel planemask,
         return false;
     }
 
-    err = tegra_stream_begin(tegra->cmds, tegra->gr2d);
+    err = tegra_stream_begin_predicted(tegra->cmds, tegra->gr2d,
+                                       &tegra->solid_2d_size);
     if (err < 0)
         return false;
 
@@ -160,6 +161,8 @@ static void tegra_exa_done_solid_2d(PixmapPtr pixmap)
 
     if (tegra->scratch.ops && tegra->cmds->status == TEGRADRM_STREAM_CONSTRUCT) {
         tegra->stats.num_2d_solid_jobs_bytes += tegra_stream_pushbuf_size(tegra->cmds);
+        tegra_stream_predictor_update(&tegra->solid_2d_size,
+                                      tegra->cmds->num_pushed_words);
         tegra_stream_end(tegra->cmds);
 
         tegra_exa_wait_pixmaps(TEGRA_3D, pixmap, 0);
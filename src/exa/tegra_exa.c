@@ -29,8 +29,12 @@
 #include "solid_2d.c"
 #include "mm_pool.c"
 #include "composite_2d.c"
+#include "gradients.c"
 #include "composite_3d.c"
 #include "composite.c"
+#include "textured_video.c"
+#include "glyphs.c"
+#include "trapezoids.c"
 #include "cpu_access.c"
 #include "load_screen.c"
 #include "mm.c"
@@ -78,6 +82,9 @@ static void tegra_exa_block_handler(BLOCKHANDLER_ARGS_DECL)
     pScreen->BlockHandler(BLOCKHANDLER_ARGS);
     pScreen->BlockHandler = tegra_exa_block_handler;
 
+    /* don't leave batched jobs pending while server sleeps */
+    tegra_stream_flush_queue(exa->cmds);
+
     clock_gettime(CLOCK_MONOTONIC, &time);
     tegra_exa_freeze_pixmaps(tegra, time.tv_sec);
 
@@ -94,6 +101,11 @@ static void tegra_exa_wrap_proc(ScreenPtr pScreen)
     if (ps) {
         exa->create_picture = ps->CreatePicture;
         ps->CreatePicture = tegra_exa_create_picture;
+
+        tegra_exa_wrap_glyphs(ps, exa);
+
+        if (TegraPTR(pScrn)->exa_trapezoids)
+            tegra_exa_wrap_trapezoids(ps, exa);
     }
 
     exa->block_handler = pScreen->BlockHandler;
@@ -109,8 +121,12 @@ static void tegra_exa_unwrap_proc(ScreenPtr pScreen)
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
     struct tegra_exa *exa = TegraPTR(pScrn)->exa;
 
-    if (ps)
+    if (ps) {
+        tegra_exa_unwrap_trapezoids(ps, exa);
+        tegra_exa_unwrap_glyphs(ps, exa);
+        tegra_exa_release_gradients(pScreen, exa);
         ps->CreatePicture = exa->create_picture;
+    }
 
     pScreen->BlockHandler = exa->block_handler;
     pScreen->DestroyPixmap = exa->destroy_pixmap;
@@ -151,6 +167,9 @@ static int tegra_exa_init_gpu(TegraPtr tegra, struct tegra_exa *exa)
         goto close_gr3d;
     }
 
+    /* consecutive 2D jobs are submitted at once, if supported by stream */
+    exa->cmds->batch_2d = true;
+
     tegra_exa_3d_state_reset(&exa->gr3d_state);
 
     return 0;
@@ -165,7 +184,11 @@ close_gr2d:
 
 static void tegra_exa_deinit_gpu(struct tegra_exa *exa)
 {
+    tegra_exa_release_textured_video(exa);
+    tegra_exa_release_trapezoids(exa);
     tegra_exa_3d_state_reset(&exa->gr3d_state);
+    tegra_exa_free_attributes_ring(&exa->scratch);
+    tegra_exa_free_quad_indices(exa);
     tegra_stream_destroy(exa->cmds);
     drm_tegra_channel_close(exa->gr2d);
     drm_tegra_channel_close(exa->gr3d);
@@ -340,8 +363,15 @@ static void tegra_exa_stats(ScreenPtr screen)
     PRINT_STATS_2(num_2d_solid_jobs_bytes);
     PRINT_STATS_1(num_3d_jobs);
     PRINT_STATS_2(num_3d_jobs_bytes);
+    PRINT_STATS_1(num_3d_video_jobs);
+    PRINT_STATS_2(num_3d_video_jobs_bytes);
+    PRINT_STATS_1(num_3d_traps_jobs);
+    PRINT_STATS_2(num_3d_traps_jobs_bytes);
     PRINT_STATS_1(num_cpu_read_accesses);
     PRINT_STATS_1(num_cpu_write_accesses);
+    PRINT_STATS_1(num_glyphs_uploaded);
+    PRINT_STATS_1(num_glyphs_fallbacks);
+    PRINT_STATS_1(num_gradient_luts_uploaded);
 
 #ifdef FENCE_DEBUG
     PRINT_STATS_3(tegra_fences_created);
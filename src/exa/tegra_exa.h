@@ -110,6 +110,8 @@ static void tegra_exa_optimize_alpha_component(struct tegra_3d_draw_state *state
 static void tegra_exa_release_optimized_3d_state(struct tegra_3d_state *state);
 static void tegra_exa_flush_deferred_3d_state(struct tegra_3d_state *state);
 static struct tegra_fence *
+tegra_exa_submit_deferred_3d_jobs(struct tegra_3d_state *state);
+static struct tegra_fence *
 tegra_exa_optimize_3d_submission(struct tegra_3d_state *state);
 static void
 tegra_exa_enter_optimization_3d_state(struct tegra_exa *exa);
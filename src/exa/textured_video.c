@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Textured video draws YUV420 frames into the destination drawable using
+ * GR3D, the colour conversion is done by the yuv420_to_rgb fragment program
+ * that samples the three planes of the frame as separate L8 textures.
+ */
+
+#define TEGRA_VIDEO_QUAD_SIZE   (6 * 4 * sizeof(__fp16))
+#define TEGRA_VIDEO_CHROMA_ZERO (128.0f / 255.0f)
+
+#define TEGRA_PUSH_VIDEO_VTX(x, y, s, t)    \
+{                                           \
+    *attribs++ = x;                         \
+    *attribs++ = y;                         \
+    *attribs++ = s;                         \
+    *attribs++ = t;                         \
+}
+
+static bool tegra_exa_allocate_video_attributes(struct tegra_exa *exa,
+                                                struct drm_tegra *drm)
+{
+    int err;
+
+    if (exa->video_attribs.bo)
+        return true;
+
+    err = drm_tegra_bo_new(&exa->video_attribs.bo, drm,
+                           exa->default_drm_bo_flags,
+                           TEGRA_VIDEO_ATTRIB_SLOTS *
+                           TEGRA_VIDEO_ATTRIB_SLOT_SIZE);
+    if (err) {
+        exa->video_attribs.bo = NULL;
+        return false;
+    }
+
+    err = drm_tegra_bo_map(exa->video_attribs.bo,
+                           (void**)&exa->video_attribs.map);
+    if (err) {
+        drm_tegra_bo_unref(exa->video_attribs.bo);
+        exa->video_attribs.map = NULL;
+        exa->video_attribs.bo = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static void tegra_exa_release_textured_video(struct tegra_exa *exa)
+{
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_VIDEO_ATTRIB_SLOTS; i++)
+        TEGRA_WAIT_AND_PUT_FENCE(exa->video_fence[i]);
+
+    drm_tegra_bo_unref(exa->video_attribs.bo);
+    exa->video_attribs.map = NULL;
+    exa->video_attribs.bo = NULL;
+    exa->video_slot = 0;
+}
+
+static uint32_t tegra_exa_video_csc_const(float k)
+{
+    /*
+     * Coefficients are halved in order to fit them into FX10 and the
+     * fragment program scales the result back, the chroma offset is
+     * pre-multiplied.
+     */
+    k = max(min(k / 2.0f, 1.99f), -1.99f);
+
+    return FX10x2(k, -TEGRA_VIDEO_CHROMA_ZERO * k);
+}
+
+static void tegra_exa_upload_video_csc(struct tegra_stream *cmds,
+                                       const TegraTexturedVideoFrame *frame)
+{
+    float kyrgb = max(min(frame->csc[0][0], 1.99f), 0.0f);
+    float yof = max(min(frame->yof * kyrgb, 1.99f), -1.99f);
+
+    tgr3d_upload_const_fp(cmds, 0, FX10x2(kyrgb, yof));
+    tgr3d_upload_const_fp(cmds, 1, tegra_exa_video_csc_const(frame->csc[2][1]));
+    tgr3d_upload_const_fp(cmds, 2, tegra_exa_video_csc_const(frame->csc[1][1]));
+    tgr3d_upload_const_fp(cmds, 3, tegra_exa_video_csc_const(frame->csc[0][1]));
+    tgr3d_upload_const_fp(cmds, 4, tegra_exa_video_csc_const(frame->csc[2][2]));
+    tgr3d_upload_const_fp(cmds, 5, tegra_exa_video_csc_const(frame->csc[1][2]));
+    tgr3d_upload_const_fp(cmds, 6, tegra_exa_video_csc_const(frame->csc[0][2]));
+}
+
+static bool
+tegra_exa_textured_video_job(struct tegra_exa *exa, PixmapPtr pixmap,
+                             const TegraTexturedVideoFrame *frame,
+                             BoxPtr boxes, unsigned int num_boxes,
+                             int x_off, int y_off)
+{
+    struct tegra_stream *cmds = exa->cmds;
+    drm_overlay_fb *fb = frame->fb;
+    struct tegra_fence *explicit_fence;
+    struct tegra_fence *fence;
+    unsigned int slot, offset, i;
+    float dst_left, dst_right, dst_bottom, dst_top;
+    float src_left, src_right, src_bottom, src_top;
+    float scale_x, scale_y;
+    __fp16 *attribs;
+    int err;
+
+    slot = exa->video_slot;
+    offset = slot * TEGRA_VIDEO_ATTRIB_SLOT_SIZE;
+
+    /* vertices of the slot may be still in use by the previous job */
+    TEGRA_WAIT_AND_PUT_FENCE(exa->video_fence[slot]);
+
+    attribs = exa->video_attribs.map + offset / sizeof(__fp16);
+
+    scale_x = (float) frame->src_w / frame->dst_w;
+    scale_y = (float) frame->src_h / frame->dst_h;
+
+    /*
+     * Texture coordinates are pushed normalized since FP16 isn't precise
+     * enough to address pixels of a large frame.
+     */
+    for (i = 0; i < num_boxes; i++) {
+        dst_left   = (float) ((boxes[i].x1 + x_off) * 2) / pixmap->drawable.width  - 1.0f;
+        dst_right  = (float) ((boxes[i].x2 + x_off) * 2) / pixmap->drawable.width  - 1.0f;
+        dst_bottom = (float) ((boxes[i].y1 + y_off) * 2) / pixmap->drawable.height - 1.0f;
+        dst_top    = (float) ((boxes[i].y2 + y_off) * 2) / pixmap->drawable.height - 1.0f;
+
+        src_left   = (frame->src_x + (boxes[i].x1 - frame->dst_x) * scale_x) / fb->width;
+        src_right  = (frame->src_x + (boxes[i].x2 - frame->dst_x) * scale_x) / fb->width;
+        src_bottom = (frame->src_y + (boxes[i].y1 - frame->dst_y) * scale_y) / fb->height;
+        src_top    = (frame->src_y + (boxes[i].y2 - frame->dst_y) * scale_y) / fb->height;
+
+        TEGRA_PUSH_VIDEO_VTX(dst_left,  dst_bottom, src_left,  src_bottom);
+        TEGRA_PUSH_VIDEO_VTX(dst_left,  dst_top,    src_left,  src_top);
+        TEGRA_PUSH_VIDEO_VTX(dst_right, dst_top,    src_right, src_top);
+
+        TEGRA_PUSH_VIDEO_VTX(dst_right, dst_top,    src_right, src_top);
+        TEGRA_PUSH_VIDEO_VTX(dst_right, dst_bottom, src_right, src_bottom);
+        TEGRA_PUSH_VIDEO_VTX(dst_left,  dst_bottom, src_left,  src_bottom);
+    }
+
+    err = tegra_stream_begin(cmds, exa->gr3d);
+    if (err)
+        return false;
+
+    tegra_stream_prep(cmds, 1);
+    tegra_stream_push_setclass(cmds, HOST1X_CLASS_GR3D);
+
+    tgr3d_initialize(cmds);
+    tgr3d_upload_const_vp(cmds, 0, 0.0f, 0.0f, 0.0f, 1.0f);
+    tgr3d_upload_const_vp(cmds, 1, 1.0f, 0.0f, 0.0f, 1.0f);
+    tgr3d_upload_const_vp(cmds, 2, 0.0f, 1.0f, 0.0f, 1.0f);
+    tgr3d_upload_const_vp(cmds, 3, 1.0f, 0.0f, 0.0f, 1.0f);
+    tgr3d_upload_const_vp(cmds, 4, 0.0f, 1.0f, 0.0f, 1.0f);
+    tgr3d_enable_render_targets(cmds, 1 << 1);
+
+    tgr3d_set_draw_params(cmds, TGR3D_PRIMITIVE_TYPE_TRIANGLES,
+                          TGR3D_INDEX_MODE_NONE, 0, true, true);
+
+    tgr3d_set_vp_attributes_inout_mask(cmds, 0x3, 0x3);
+
+    tgr3d_set_vp_attrib_buf(cmds, 0, exa->video_attribs.bo, offset,
+                            TGR3D_ATTRIB_TYPE_FLOAT16, 2, 8, false);
+
+    tgr3d_set_vp_attrib_buf(cmds, 1, exa->video_attribs.bo, offset + 4,
+                            TGR3D_ATTRIB_TYPE_FLOAT16, 2, 8, false);
+
+    /*
+     * Bilinear filtering isn't supported by GR3D for non-power-of-two
+     * textures, frame sizes are arbitrary and hence nearest filtering
+     * is used.
+     */
+    tgr3d_set_texture_desc(cmds, 0, fb->bo_y, fb->offset_y,
+                           fb->width, fb->height,
+                           TGR3D_PIXEL_FORMAT_L8,
+                           false, false, false, true, false, false);
+
+    tgr3d_set_texture_desc(cmds, 1, fb->bo_cb, fb->offset_cb,
+                           fb->width_c, fb->height_c,
+                           TGR3D_PIXEL_FORMAT_L8,
+                           false, false, false, true, false, false);
+
+    tgr3d_set_texture_desc(cmds, 2, fb->bo_cr, fb->offset_cr,
+                           fb->width_c, fb->height_c,
+                           TGR3D_PIXEL_FORMAT_L8,
+                           false, false, false, true, false, false);
+
+    tegra_exa_upload_video_csc(cmds, frame);
+
+    tgr3d_set_scissor(cmds, 0, 0,
+                      pixmap->drawable.width,
+                      pixmap->drawable.height);
+
+    tgr3d_set_viewport_bias_scale(cmds, 0.0f, 0.0f, 0.5f,
+                                  pixmap->drawable.width,
+                                  pixmap->drawable.height,
+                                  0.5f);
+
+    tgr3d_set_render_target(cmds, 1,
+                            tegra_exa_pixmap_bo(pixmap),
+                            tegra_exa_pixmap_offset(pixmap),
+                            TGR3D_PIXEL_FORMAT_RGBA8888,
+                            exaGetPixmapPitch(pixmap),
+                            tegra_exa_pixmap_is_from_pool(pixmap));
+
+    tgr3d_upload_program(cmds, &prog_yuv420_to_rgb);
+    tgr3d_draw_primitives(cmds, 0, num_boxes * 6);
+
+    if (cmds->status != TEGRADRM_STREAM_CONSTRUCT) {
+        tegra_stream_cleanup(cmds);
+        return false;
+    }
+
+    exa->stats.num_3d_video_jobs_bytes += tegra_stream_pushbuf_size(cmds);
+    tegra_stream_end(cmds);
+
+    tegra_exa_wait_pixmaps(TEGRA_2D, pixmap, 0);
+
+    explicit_fence = tegra_exa_get_explicit_fence(TEGRA_2D, pixmap, 0);
+    fence = tegra_exa_stream_submit(exa, TEGRA_3D, explicit_fence);
+    TEGRA_FENCE_PUT(explicit_fence);
+
+    tegra_exa_replace_pixmaps_fence(TEGRA_3D, fence, &exa->scratch, pixmap, 0);
+
+    exa->video_fence[slot] = TEGRA_FENCE_GET(fence, NULL);
+    exa->video_slot = (slot + 1) % TEGRA_VIDEO_ATTRIB_SLOTS;
+    exa->stats.num_3d_video_jobs++;
+
+    return true;
+}
+
+static bool tegra_exa_textured_video(DrawablePtr draw,
+                                     const TegraTexturedVideoFrame *frame,
+                                     struct tegra_fence **fence)
+{
+    ScreenPtr screen = draw->pScreen;
+    ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
+    struct tegra_exa *exa = TegraPTR(scrn)->exa;
+    struct tegra_pixmap *priv;
+    unsigned int max_boxes, chunk;
+    int num_boxes, x_off, y_off;
+    PixmapPtr pixmap;
+    BoxPtr boxes;
+    bool ret = true;
+
+    if (!exa)
+        return false;
+
+    if (draw->type == DRAWABLE_WINDOW)
+        pixmap = screen->GetWindowPixmap((WindowPtr) draw);
+    else
+        pixmap = (PixmapPtr) draw;
+
+#ifdef COMPOSITE
+    x_off = -pixmap->screen_x;
+    y_off = -pixmap->screen_y;
+#else
+    x_off = 0;
+    y_off = 0;
+#endif
+
+    if (pixmap->drawable.bitsPerPixel != 32) {
+        FALLBACK_MSG("unsupported dst pixmap bpp %d\n",
+                     pixmap->drawable.bitsPerPixel);
+        return false;
+    }
+
+    tegra_exa_thaw_pixmap2(pixmap, THAW_ACCEL, THAW_ALLOC);
+
+    priv = exaGetPixmapDriverPrivate(pixmap);
+    if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK) {
+        FALLBACK_MSG("unaccelerateable dst pixmap %d:%d:%d\n",
+                     pixmap->drawable.width,
+                     pixmap->drawable.height,
+                     pixmap->drawable.bitsPerPixel);
+        return false;
+    }
+
+    if (!tegra_exa_allocate_video_attributes(exa, TegraPTR(scrn)->drm))
+        return false;
+
+    tegra_exa_flush_deferred_operations(pixmap, true, true, true);
+
+    ACCEL_MSG("frame %ux%u src %dx%d dst %dx%d w:h %d:%d\n",
+              frame->fb->width, frame->fb->height,
+              frame->src_x, frame->src_y,
+              frame->dst_x, frame->dst_y,
+              frame->dst_w, frame->dst_h);
+
+    max_boxes = TEGRA_VIDEO_ATTRIB_SLOT_SIZE / TEGRA_VIDEO_QUAD_SIZE;
+    num_boxes = REGION_NUM_RECTS(frame->clip);
+    boxes = REGION_RECTS(frame->clip);
+
+    while (num_boxes > 0) {
+        chunk = min(num_boxes, max_boxes);
+
+        if (!tegra_exa_textured_video_job(exa, pixmap, frame, boxes, chunk,
+                                          x_off, y_off)) {
+            ret = false;
+            break;
+        }
+
+        num_boxes -= chunk;
+        boxes += chunk;
+    }
+
+    priv->state.alpha_0 = 0;
+
+    tegra_exa_cool_pixmap(pixmap, true);
+
+    if (ret && fence) {
+        TEGRA_FENCE_PUT(*fence);
+        *fence = TEGRA_FENCE_GET(priv->fence_write[TEGRA_3D], NULL);
+    }
+
+    return ret;
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Trapezoids and triangles are rasterized by GR3D into an A8 mask that is
+ * composited afterwards. GR3D has no multisampling, hence the coverage is
+ * accumulated over a grid of sub-pixel shifted passes by the additive
+ * trapezoid_coverage fragment program.
+ */
+
+#define TEGRA_TRAPS_QUAD_SIZE   (4 * 2 * sizeof(float))
+#define TEGRA_TRAPS_GRID        4
+#define TEGRA_TRAPS_PASSES      (TEGRA_TRAPS_GRID * TEGRA_TRAPS_GRID)
+
+/* 1/16 is exact in fx10, a fully covered pixel sums up to 1.0 */
+#define TEGRA_TRAPS_PASS_COVERAGE   (1.0f / TEGRA_TRAPS_PASSES)
+
+#define TEGRA_PUSH_TRAPS_VTX(x, y)          \
+{                                           \
+    *attribs++ = (x) * scale_x - 1.0f;      \
+    *attribs++ = (y) * scale_y - 1.0f;      \
+}
+
+static bool tegra_exa_allocate_traps_attributes(struct tegra_exa *exa,
+                                                struct drm_tegra *drm)
+{
+    int err;
+
+    if (exa->traps_attribs.bo)
+        return true;
+
+    err = drm_tegra_bo_new(&exa->traps_attribs.bo, drm,
+                           exa->default_drm_bo_flags,
+                           TEGRA_TRAPS_ATTRIB_BUFFER_SIZE);
+    if (err) {
+        exa->traps_attribs.bo = NULL;
+        return false;
+    }
+
+    err = drm_tegra_bo_map(exa->traps_attribs.bo,
+                           (void**)&exa->traps_attribs.map);
+    if (err) {
+        drm_tegra_bo_unref(exa->traps_attribs.bo);
+        exa->traps_attribs.map = NULL;
+        exa->traps_attribs.bo = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static void tegra_exa_release_trapezoids(struct tegra_exa *exa)
+{
+    TEGRA_WAIT_AND_PUT_FENCE(exa->traps_fence);
+
+    drm_tegra_bo_unref(exa->traps_attribs.bo);
+    exa->traps_attribs.map = NULL;
+    exa->traps_attribs.bo = NULL;
+}
+
+static float tegra_exa_line_x_at(const xLineFixed *line, xFixed y)
+{
+    double dx = line->p2.x - line->p1.x;
+    double dy = line->p2.y - line->p1.y;
+
+    return (line->p1.x + (y - line->p1.y) * dx / dy) / 65536.0;
+}
+
+static void tegra_exa_push_traps(float *attribs, xTrapezoid *traps,
+                                 unsigned int num_traps,
+                                 int x_off, int y_off,
+                                 float scale_x, float scale_y)
+{
+    float top, bottom, lt, rt, lb, rb;
+    unsigned int i;
+
+    for (i = 0; i < num_traps; i++, traps++) {
+        /* invalid trapezoid is pushed as a degenerate quad */
+        if (traps->left.p1.y == traps->left.p2.y ||
+            traps->right.p1.y == traps->right.p2.y ||
+            traps->bottom <= traps->top) {
+            TEGRA_PUSH_TRAPS_VTX(0.0f, 0.0f);
+            TEGRA_PUSH_TRAPS_VTX(0.0f, 0.0f);
+            TEGRA_PUSH_TRAPS_VTX(0.0f, 0.0f);
+            TEGRA_PUSH_TRAPS_VTX(0.0f, 0.0f);
+            continue;
+        }
+
+        top    = traps->top    / 65536.0f - y_off;
+        bottom = traps->bottom / 65536.0f - y_off;
+
+        lt = tegra_exa_line_x_at(&traps->left,  traps->top)    - x_off;
+        rt = tegra_exa_line_x_at(&traps->right, traps->top)    - x_off;
+        lb = tegra_exa_line_x_at(&traps->left,  traps->bottom) - x_off;
+        rb = tegra_exa_line_x_at(&traps->right, traps->bottom) - x_off;
+
+        TEGRA_PUSH_TRAPS_VTX(lt, top);
+        TEGRA_PUSH_TRAPS_VTX(rt, top);
+        TEGRA_PUSH_TRAPS_VTX(rb, bottom);
+        TEGRA_PUSH_TRAPS_VTX(lb, bottom);
+    }
+}
+
+static void tegra_exa_push_tris(float *attribs, xTriangle *tris,
+                                unsigned int num_tris,
+                                int x_off, int y_off,
+                                float scale_x, float scale_y)
+{
+    unsigned int i;
+    float x, y;
+
+    for (i = 0; i < num_tris; i++, tris++) {
+        TEGRA_PUSH_TRAPS_VTX(tris->p1.x / 65536.0f - x_off,
+                             tris->p1.y / 65536.0f - y_off);
+        TEGRA_PUSH_TRAPS_VTX(tris->p2.x / 65536.0f - x_off,
+                             tris->p2.y / 65536.0f - y_off);
+
+        /* triangle is a quad with the last vertex repeated */
+        x = tris->p3.x / 65536.0f - x_off;
+        y = tris->p3.y / 65536.0f - y_off;
+
+        TEGRA_PUSH_TRAPS_VTX(x, y);
+        TEGRA_PUSH_TRAPS_VTX(x, y);
+    }
+}
+
+static bool
+tegra_exa_trapezoids_job(struct tegra_exa *exa, PixmapPtr pixmap,
+                         xTrapezoid *traps, xTriangle *tris,
+                         unsigned int num, int x_off, int y_off)
+{
+    struct tegra_stream *cmds = exa->cmds;
+    struct tegra_fence *explicit_fence;
+    struct tegra_fence *fence;
+    float scale_x, scale_y;
+    float dx, dy;
+    unsigned int i;
+    int err;
+
+    /* vertices may be still in use by the previous job */
+    TEGRA_WAIT_AND_PUT_FENCE(exa->traps_fence);
+
+    scale_x = 2.0f / pixmap->drawable.width;
+    scale_y = 2.0f / pixmap->drawable.height;
+
+    if (traps)
+        tegra_exa_push_traps((float *) exa->traps_attribs.map, traps, num,
+                             x_off, y_off, scale_x, scale_y);
+    else
+        tegra_exa_push_tris((float *) exa->traps_attribs.map, tris, num,
+                            x_off, y_off, scale_x, scale_y);
+
+    err = tegra_stream_begin(cmds, exa->gr3d);
+    if (err)
+        return false;
+
+    tegra_stream_prep(cmds, 1);
+    tegra_stream_push_setclass(cmds, HOST1X_CLASS_GR3D);
+
+    tgr3d_initialize(cmds);
+    tgr3d_upload_const_vp(cmds, 0, 0.0f, 0.0f, 0.0f, 1.0f);
+    tgr3d_upload_const_vp(cmds, 1, 1.0f, 0.0f, 0.0f, 1.0f);
+    tgr3d_upload_const_vp(cmds, 2, 0.0f, 1.0f, 0.0f, 1.0f);
+    tgr3d_upload_const_vp(cmds, 3, 1.0f, 0.0f, 0.0f, 1.0f);
+    tgr3d_upload_const_vp(cmds, 4, 0.0f, 1.0f, 0.0f, 1.0f);
+    tgr3d_enable_render_targets(cmds, 1 << 1);
+
+    tgr3d_set_draw_params(cmds, TGR3D_PRIMITIVE_TYPE_TRIANGLES,
+                          TGR3D_INDEX_MODE_UINT16, 0, true, true);
+
+    tgr3d_set_vp_attributes_inout_mask(cmds, 0x1, 0x1);
+
+    tgr3d_set_vp_attrib_buf(cmds, 0, exa->traps_attribs.bo, 0,
+                            TGR3D_ATTRIB_TYPE_FLOAT32, 2, 8, false);
+
+    tgr3d_upload_const_fp(cmds, 0, FX10x2(TEGRA_TRAPS_PASS_COVERAGE,
+                                          TEGRA_TRAPS_PASS_COVERAGE));
+
+    tgr3d_set_scissor(cmds, 0, 0,
+                      pixmap->drawable.width,
+                      pixmap->drawable.height);
+
+    tgr3d_set_render_target(cmds, 1,
+                            tegra_exa_pixmap_bo(pixmap),
+                            tegra_exa_pixmap_offset(pixmap),
+                            TGR3D_PIXEL_FORMAT_A8,
+                            exaGetPixmapPitch(pixmap),
+                            tegra_exa_pixmap_is_from_pool(pixmap));
+
+    tgr3d_upload_program(cmds, &prog_trapezoid_coverage);
+
+    /* passes are shifted by the centers of the sub-pixel grid cells */
+    for (i = 0; i < TEGRA_TRAPS_PASSES; i++) {
+        dx = ((i % TEGRA_TRAPS_GRID) + 0.5f) / TEGRA_TRAPS_GRID - 0.5f;
+        dy = ((i / TEGRA_TRAPS_GRID) + 0.5f) / TEGRA_TRAPS_GRID - 0.5f;
+
+        tgr3d_set_viewport_bias_scale(cmds, dx, dy, 0.5f,
+                                      pixmap->drawable.width,
+                                      pixmap->drawable.height,
+                                      0.5f);
+
+        tegra_exa_draw_quads(cmds, exa, num);
+    }
+
+    if (cmds->status != TEGRADRM_STREAM_CONSTRUCT) {
+        tegra_stream_cleanup(cmds);
+        return false;
+    }
+
+    exa->stats.num_3d_traps_jobs_bytes += tegra_stream_pushbuf_size(cmds);
+    tegra_stream_end(cmds);
+
+    tegra_exa_wait_pixmaps(TEGRA_2D, pixmap, 0);
+
+    explicit_fence = tegra_exa_get_explicit_fence(TEGRA_2D, pixmap, 0);
+    fence = tegra_exa_stream_submit(exa, TEGRA_3D, explicit_fence);
+    TEGRA_FENCE_PUT(explicit_fence);
+
+    tegra_exa_replace_pixmaps_fence(TEGRA_3D, fence, &exa->scratch, pixmap, 0);
+
+    exa->traps_fence = TEGRA_FENCE_GET(fence, NULL);
+    exa->stats.num_3d_traps_jobs++;
+
+    return true;
+}
+
+static bool tegra_exa_rasterize_trapezoids(PicturePtr mask,
+                                           xTrapezoid *traps,
+                                           xTriangle *tris,
+                                           unsigned int num,
+                                           int x_off, int y_off)
+{
+    PixmapPtr pixmap = (PixmapPtr) mask->pDrawable;
+    ScrnInfoPtr scrn = xf86ScreenToScrn(pixmap->drawable.pScreen);
+    struct tegra_exa *exa = TegraPTR(scrn)->exa;
+    unsigned int max_quads, chunk;
+    struct tegra_pixmap *priv;
+    bool ret = true;
+
+    tegra_exa_thaw_pixmap2(pixmap, THAW_ACCEL, THAW_ALLOC);
+
+    priv = exaGetPixmapDriverPrivate(pixmap);
+    if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK) {
+        FALLBACK_MSG("unaccelerateable mask pixmap %d:%d:%d\n",
+                     pixmap->drawable.width,
+                     pixmap->drawable.height,
+                     pixmap->drawable.bitsPerPixel);
+        return false;
+    }
+
+    if (!exa->quad_indices && !tegra_exa_create_quad_indices(exa))
+        return false;
+
+    if (!tegra_exa_allocate_traps_attributes(exa, TegraPTR(scrn)->drm))
+        return false;
+
+    /* mask is cleared by the deferred solid fill */
+    tegra_exa_flush_deferred_operations(pixmap, true, true, true);
+
+    ACCEL_MSG("%u %s mask %dx%d\n", num, traps ? "traps" : "tris",
+              pixmap->drawable.width, pixmap->drawable.height);
+
+    max_quads = TEGRA_TRAPS_ATTRIB_BUFFER_SIZE / TEGRA_TRAPS_QUAD_SIZE;
+
+    while (num > 0) {
+        chunk = min(num, max_quads);
+
+        if (!tegra_exa_trapezoids_job(exa, pixmap, traps, tris, chunk,
+                                      x_off, y_off)) {
+            ret = false;
+            break;
+        }
+
+        if (traps)
+            traps += chunk;
+        else
+            tris += chunk;
+
+        num -= chunk;
+    }
+
+    priv->state.alpha_0 = 0;
+
+    tegra_exa_cool_pixmap(pixmap, true);
+
+    return ret;
+}
+
+static bool tegra_exa_clip_traps_bounds(PicturePtr dst, BoxPtr bounds)
+{
+    bounds->x1 = max(bounds->x1, 0);
+    bounds->y1 = max(bounds->y1, 0);
+    bounds->x2 = min(bounds->x2, dst->pDrawable->width);
+    bounds->y2 = min(bounds->y2, dst->pDrawable->height);
+
+    return bounds->x2 > bounds->x1 && bounds->y2 > bounds->y1;
+}
+
+static void tegra_exa_trapezoids(CARD8 op,
+                                 PicturePtr src,
+                                 PicturePtr dst,
+                                 PictFormatPtr mask_format,
+                                 INT16 x_src, INT16 y_src,
+                                 int ntrap, xTrapezoid *traps)
+{
+    ScreenPtr screen = dst->pDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(screen);
+    struct tegra_exa *exa = TegraPTR(pScrn)->exa;
+    PicturePtr mask;
+    BoxRec bounds;
+    int x_dst, y_dst;
+    int width, height;
+
+    if (!mask_format || mask_format->format != PICT_a8 || ntrap <= 0)
+        goto fallback;
+
+    miTrapezoidBounds(ntrap, traps, &bounds);
+
+    if (!tegra_exa_clip_traps_bounds(dst, &bounds))
+        return;
+
+    width  = bounds.x2 - bounds.x1;
+    height = bounds.y2 - bounds.y1;
+
+    mask = tegra_exa_create_mask_picture(screen, mask_format, width, height);
+    if (!mask)
+        goto fallback;
+
+    if (!tegra_exa_rasterize_trapezoids(mask, traps, NULL, ntrap,
+                                        bounds.x1, bounds.y1)) {
+        FreePicture(mask, 0);
+        goto fallback;
+    }
+
+    x_dst = traps[0].left.p1.x >> 16;
+    y_dst = traps[0].left.p1.y >> 16;
+
+    CompositePicture(op, src, mask, dst,
+                     x_src + bounds.x1 - x_dst,
+                     y_src + bounds.y1 - y_dst,
+                     0, 0, bounds.x1, bounds.y1,
+                     width, height);
+
+    FreePicture(mask, 0);
+
+    return;
+
+fallback:
+    exa->trapezoids(op, src, dst, mask_format, x_src, y_src, ntrap, traps);
+}
+
+static void tegra_exa_triangles(CARD8 op,
+                                PicturePtr src,
+                                PicturePtr dst,
+                                PictFormatPtr mask_format,
+                                INT16 x_src, INT16 y_src,
+                                int ntri, xTriangle *tris)
+{
+    ScreenPtr screen = dst->pDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(screen);
+    struct tegra_exa *exa = TegraPTR(pScrn)->exa;
+    PicturePtr mask;
+    BoxRec bounds;
+    int x_dst, y_dst;
+    int width, height;
+
+    if (!mask_format || mask_format->format != PICT_a8 || ntri <= 0)
+        goto fallback;
+
+    miTriangleBounds(ntri, tris, &bounds);
+
+    if (!tegra_exa_clip_traps_bounds(dst, &bounds))
+        return;
+
+    width  = bounds.x2 - bounds.x1;
+    height = bounds.y2 - bounds.y1;
+
+    mask = tegra_exa_create_mask_picture(screen, mask_format, width, height);
+    if (!mask)
+        goto fallback;
+
+    if (!tegra_exa_rasterize_trapezoids(mask, NULL, tris, ntri,
+                                        bounds.x1, bounds.y1)) {
+        FreePicture(mask, 0);
+        goto fallback;
+    }
+
+    x_dst = tris[0].p1.x >> 16;
+    y_dst = tris[0].p1.y >> 16;
+
+    CompositePicture(op, src, mask, dst,
+                     x_src + bounds.x1 - x_dst,
+                     y_src + bounds.y1 - y_dst,
+                     0, 0, bounds.x1, bounds.y1,
+                     width, height);
+
+    FreePicture(mask, 0);
+
+    return;
+
+fallback:
+    exa->triangles(op, src, dst, mask_format, x_src, y_src, ntri, tris);
+}
+
+static void tegra_exa_wrap_trapezoids(PictureScreenPtr ps,
+                                      struct tegra_exa *exa)
+{
+    if (ps->Trapezoids) {
+        exa->trapezoids = ps->Trapezoids;
+        ps->Trapezoids = tegra_exa_trapezoids;
+    }
+
+    if (ps->Triangles) {
+        exa->triangles = ps->Triangles;
+        ps->Triangles = tegra_exa_triangles;
+    }
+}
+
+static void tegra_exa_unwrap_trapezoids(PictureScreenPtr ps,
+                                        struct tegra_exa *exa)
+{
+    if (exa->trapezoids) {
+        ps->Trapezoids = exa->trapezoids;
+        exa->trapezoids = NULL;
+    }
+
+    if (exa->triangles) {
+        ps->Triangles = exa->triangles;
+        exa->triangles = NULL;
+    }
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -21,11 +21,71 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "gr3d.h"
 #include "tegra_stream.h"
 
 #define TGE3D_ARRAY_SIZE(x) (sizeof(x) / sizeof(*x))
 
+#define TGR3D_SHADOW_VP_CONST_NUM   32
+
+/*
+ * Shadow copy of the GR3D registers that were written by the current job.
+ * It's reset by tgr3d_initialize() that starts every 3D job, so the values
+ * are carried over the draws batched into a job, but never over jobs since
+ * other GR3D users may clobber the state in between.
+ */
+struct tgr3d_shadow {
+    const struct shader_program *prog;
+
+    uint32_t fp_const[TGR3D_FP_CONST__LEN];
+    uint32_t fp_const_valid;
+
+    uint32_t vp_const[TGR3D_SHADOW_VP_CONST_NUM][4];
+    uint32_t vp_const_valid;
+
+    uint32_t attrib_mode[TGR3D_ATTRIB_MODE__LEN];
+    uint32_t attrib_mode_valid;
+
+    uint32_t tex_desc[TGR3D_TEXTURE_DESC1__LEN][2];
+    uint32_t tex_desc_valid;
+
+    uint32_t rt_params[TGR3D_RT_PARAMS__LEN];
+    uint32_t rt_params_valid;
+
+    uint32_t scissor[2];
+    uint32_t viewport[6];
+    uint32_t inout_mask;
+    uint32_t rt_enable;
+
+    bool scissor_valid : 1;
+    bool viewport_valid : 1;
+    bool inout_mask_valid : 1;
+    bool rt_enable_valid : 1;
+};
+
+static inline uint32_t tgr3d_f2u(float f)
+{
+    union {
+        uint32_t u;
+        float f;
+    } value;
+
+    value.f = f;
+
+    return value.u;
+}
+
+static void tgr3d_reset_shadow(struct tegra_stream *cmds)
+{
+    if (!cmds->gr3d_shadow)
+        cmds->gr3d_shadow = calloc(1, sizeof(*cmds->gr3d_shadow));
+    else
+        memset(cmds->gr3d_shadow, 0, sizeof(*cmds->gr3d_shadow));
+}
+
 static const uint32_t state_reset[] = {
     /* Tegra114 specific stuff */
     HOST1X_OPCODE_IMM(0xe44, 0x00000000),
@@ -155,7 +215,8 @@ static const uint32_t state_reset[] = {
 static void tgr3d_init_state(struct tegra_stream *cmds)
 {
     tegra_stream_prep(cmds, TGE3D_ARRAY_SIZE(state_reset));
-    tegra_stream_push_words(cmds, state_reset, TGE3D_ARRAY_SIZE(state_reset), 0);
+    tegra_stream_push_words(cmds, state_reset, TGE3D_ARRAY_SIZE(state_reset),
+                            NULL, 0);
 
     if (cmds->tegra114) {
         tegra_stream_prep(cmds, 2);
@@ -167,23 +228,58 @@ static void tgr3d_init_state(struct tegra_stream *cmds)
 void tgr3d_upload_const_vp(struct tegra_stream *cmds, unsigned index,
                            float x, float y, float z, float w)
 {
-    tegra_stream_prep(cmds, 6);
+    struct tgr3d_shadow *shadow = cmds->gr3d_shadow;
+    uint32_t value[4] = {
+        tgr3d_f2u(x), tgr3d_f2u(y), tgr3d_f2u(z), tgr3d_f2u(w),
+    };
+    uint32_t *ptr;
+
+    if (shadow && index < TGR3D_SHADOW_VP_CONST_NUM) {
+        if ((shadow->vp_const_valid & (1u << index)) &&
+            !memcmp(shadow->vp_const[index], value, sizeof(value)))
+            return;
+
+        memcpy(shadow->vp_const[index], value, sizeof(value));
+        shadow->vp_const_valid |= 1u << index;
+    }
+
+    ptr = tegra_stream_reserve(cmds, 6);
+    if (!ptr)
+        return;
+
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_IMM(TGR3D_VP_UPLOAD_CONST_ID, index * 4));
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_NONINCR(TGR3D_VP_UPLOAD_CONST, 4));
 
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(TGR3D_VP_UPLOAD_CONST_ID, index * 4));
-    tegra_stream_push(cmds, HOST1X_OPCODE_NONINCR(TGR3D_VP_UPLOAD_CONST, 4));
+    TEGRA_STREAM_EMIT(ptr, value[0]);
+    TEGRA_STREAM_EMIT(ptr, value[1]);
+    TEGRA_STREAM_EMIT(ptr, value[2]);
+    TEGRA_STREAM_EMIT(ptr, value[3]);
 
-    tegra_stream_pushf(cmds, x);
-    tegra_stream_pushf(cmds, y);
-    tegra_stream_pushf(cmds, z);
-    tegra_stream_pushf(cmds, w);
+    tegra_stream_commit(cmds, ptr);
 }
 
 void tgr3d_upload_const_fp(struct tegra_stream *cmds, unsigned index,
                            uint32_t constant)
 {
-    tegra_stream_prep(cmds, 2);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_FP_CONST(index), 1));
-    tegra_stream_push(cmds, constant);
+    struct tgr3d_shadow *shadow = cmds->gr3d_shadow;
+    uint32_t *ptr;
+
+    if (shadow && index < TGR3D_FP_CONST__LEN) {
+        if ((shadow->fp_const_valid & (1u << index)) &&
+            shadow->fp_const[index] == constant)
+            return;
+
+        shadow->fp_const[index] = constant;
+        shadow->fp_const_valid |= 1u << index;
+    }
+
+    ptr = tegra_stream_reserve(cmds, 2);
+    if (!ptr)
+        return;
+
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_INCR(TGR3D_FP_CONST(index), 1));
+    TEGRA_STREAM_EMIT(ptr, constant);
+    tegra_stream_commit(cmds, ptr);
 }
 
 void tgr3d_set_scissor(struct tegra_stream *cmds,
@@ -192,21 +288,33 @@ void tgr3d_set_scissor(struct tegra_stream *cmds,
                        unsigned scissor_width,
                        unsigned scissor_heigth)
 {
-    uint32_t value;
+    struct tgr3d_shadow *shadow = cmds->gr3d_shadow;
+    uint32_t value[2];
+    uint32_t *ptr;
 
-    tegra_stream_prep(cmds, 3);
+    value[0]  = TGR3D_VAL(SCISSOR_HORIZ, MIN, scissor_x);
+    value[0] |= TGR3D_VAL(SCISSOR_HORIZ, MAX, scissor_x + scissor_width);
 
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_SCISSOR_HORIZ, 2));
+    value[1]  = TGR3D_VAL(SCISSOR_VERT, MIN, scissor_y);
+    value[1] |= TGR3D_VAL(SCISSOR_VERT, MAX, scissor_y + scissor_heigth);
 
-    value  = TGR3D_VAL(SCISSOR_HORIZ, MIN, scissor_x);
-    value |= TGR3D_VAL(SCISSOR_HORIZ, MAX, scissor_x + scissor_width);
+    if (shadow) {
+        if (shadow->scissor_valid &&
+            !memcmp(shadow->scissor, value, sizeof(value)))
+            return;
 
-    tegra_stream_push(cmds, value);
+        memcpy(shadow->scissor, value, sizeof(value));
+        shadow->scissor_valid = true;
+    }
 
-    value  = TGR3D_VAL(SCISSOR_VERT, MIN, scissor_y);
-    value |= TGR3D_VAL(SCISSOR_VERT, MAX, scissor_y + scissor_heigth);
+    ptr = tegra_stream_reserve(cmds, 3);
+    if (!ptr)
+        return;
 
-    tegra_stream_push(cmds, value);
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_INCR(TGR3D_SCISSOR_HORIZ, 2));
+    TEGRA_STREAM_EMIT(ptr, value[0]);
+    TEGRA_STREAM_EMIT(ptr, value[1]);
+    tegra_stream_commit(cmds, ptr);
 }
 
 static void tgr3d_set_guardband(struct tegra_stream *cmds)
@@ -376,14 +484,37 @@ void tgr3d_set_viewport_bias_scale(struct tegra_stream *cmds,
                                    float viewport_y_scale,
                                    float viewport_z_scale)
 {
-    tegra_stream_prep(cmds, 7);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_VIEWPORT_X_BIAS, 6));
-    tegra_stream_pushf(cmds, viewport_x_bias * 16.0f + viewport_x_scale * 8.0f);
-    tegra_stream_pushf(cmds, viewport_y_bias * 16.0f + viewport_y_scale * 8.0f);
-    tegra_stream_pushf(cmds, viewport_z_bias - 4.76837158203125e-07);
-    tegra_stream_pushf(cmds, viewport_x_scale * 8.0f);
-    tegra_stream_pushf(cmds, viewport_y_scale * 8.0f);
-    tegra_stream_pushf(cmds, viewport_z_scale - 4.76837158203125e-07);
+    struct tgr3d_shadow *shadow = cmds->gr3d_shadow;
+    uint32_t value[6] = {
+        tgr3d_f2u(viewport_x_bias * 16.0f + viewport_x_scale * 8.0f),
+        tgr3d_f2u(viewport_y_bias * 16.0f + viewport_y_scale * 8.0f),
+        tgr3d_f2u(viewport_z_bias - 4.76837158203125e-07),
+        tgr3d_f2u(viewport_x_scale * 8.0f),
+        tgr3d_f2u(viewport_y_scale * 8.0f),
+        tgr3d_f2u(viewport_z_scale - 4.76837158203125e-07),
+    };
+    uint32_t *ptr;
+    unsigned int i;
+
+    if (shadow) {
+        if (shadow->viewport_valid &&
+            !memcmp(shadow->viewport, value, sizeof(value)))
+            return;
+
+        memcpy(shadow->viewport, value, sizeof(value));
+        shadow->viewport_valid = true;
+    }
+
+    ptr = tegra_stream_reserve(cmds, 7);
+    if (!ptr)
+        return;
+
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_INCR(TGR3D_VIEWPORT_X_BIAS, 6));
+
+    for (i = 0; i < 6; i++)
+        TEGRA_STREAM_EMIT(ptr, value[i]);
+
+    tegra_stream_commit(cmds, ptr);
 }
 
 static void tgr3d_set_cullface_and_linker_inst_num(struct tegra_stream *cmds,
@@ -410,6 +541,7 @@ void tgr3d_set_vp_attrib_buf(struct tegra_stream *cmds,
                              unsigned size, unsigned stride,
                              bool explicit_fencing)
 {
+    struct tgr3d_shadow *shadow = cmds->gr3d_shadow;
     uint32_t value = 0;
 
     tegra_stream_prep(cmds, 3);
@@ -418,18 +550,57 @@ void tgr3d_set_vp_attrib_buf(struct tegra_stream *cmds,
     value |= TGR3D_VAL(ATTRIB_MODE, SIZE, size);
     value |= TGR3D_VAL(ATTRIB_MODE, STRIDE, stride);
 
+    /* pointer is always re-written since it kicks off the data fetching */
+    if (shadow && (shadow->attrib_mode_valid & (1u << index)) &&
+        shadow->attrib_mode[index] == value) {
+        tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_ATTRIB_PTR(index), 1));
+        tegra_stream_push_reloc(cmds, bo, offset, false, explicit_fencing);
+        return;
+    }
+
+    if (shadow) {
+        shadow->attrib_mode[index] = value;
+        shadow->attrib_mode_valid |= 1u << index;
+    }
+
     tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_ATTRIB_PTR(index), 2));
     tegra_stream_push_reloc(cmds, bo, offset, false, explicit_fencing);
     tegra_stream_push(cmds, value);
 }
 
+void tgr3d_set_index_buf(struct tegra_stream *cmds,
+                         struct drm_tegra_bo *bo,
+                         unsigned offset,
+                         bool explicit_fencing)
+{
+    tegra_stream_prep(cmds, 2);
+    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_INDEX_PTR, 1));
+    tegra_stream_push_reloc(cmds, bo, offset, false, explicit_fencing);
+}
+
 void tgr3d_set_vp_attributes_inout_mask(struct tegra_stream *cmds,
                                         uint32_t in_mask,
                                         uint32_t out_mask)
 {
-    tegra_stream_prep(cmds, 2);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_VP_ATTRIB_IN_OUT_SELECT, 1));
-    tegra_stream_push(cmds, in_mask << 16 | out_mask);
+    struct tgr3d_shadow *shadow = cmds->gr3d_shadow;
+    uint32_t value = in_mask << 16 | out_mask;
+    uint32_t *ptr;
+
+    if (shadow) {
+        if (shadow->inout_mask_valid && shadow->inout_mask == value)
+            return;
+
+        shadow->inout_mask = value;
+        shadow->inout_mask_valid = true;
+    }
+
+    ptr = tegra_stream_reserve(cmds, 2);
+    if (!ptr)
+        return;
+
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_INCR(TGR3D_VP_ATTRIB_IN_OUT_SELECT, 1));
+    TEGRA_STREAM_EMIT(ptr, value);
+    tegra_stream_commit(cmds, ptr);
 }
 
 void tgr3d_set_render_target(struct tegra_stream *cmds,
@@ -440,6 +611,7 @@ void tgr3d_set_render_target(struct tegra_stream *cmds,
                              unsigned pitch,
                              bool explicit_fencing)
 {
+    struct tgr3d_shadow *shadow = cmds->gr3d_shadow;
     uint32_t value = 0;
 
     tegra_stream_prep(cmds, 4);
@@ -448,8 +620,16 @@ void tgr3d_set_render_target(struct tegra_stream *cmds,
     value |= TGR3D_VAL(RT_PARAMS, PITCH, pitch);
     value |= TGR3D_BOOL(RT_PARAMS, TILED, 0);
 
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_RT_PARAMS(index), 1));
-    tegra_stream_push(cmds, value);
+    if (!shadow || !(shadow->rt_params_valid & (1u << index)) ||
+        shadow->rt_params[index] != value) {
+        tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_RT_PARAMS(index), 1));
+        tegra_stream_push(cmds, value);
+    }
+
+    if (shadow) {
+        shadow->rt_params[index] = value;
+        shadow->rt_params_valid |= 1u << index;
+    }
 
     tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_RT_PTR(index), 1));
     tegra_stream_push_reloc(cmds, bo, offset, true, explicit_fencing);
@@ -457,9 +637,24 @@ void tgr3d_set_render_target(struct tegra_stream *cmds,
 
 void tgr3d_enable_render_targets(struct tegra_stream *cmds, uint32_t mask)
 {
-    tegra_stream_prep(cmds, 2);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_RT_ENABLE, 1));
-    tegra_stream_push(cmds, mask);
+    struct tgr3d_shadow *shadow = cmds->gr3d_shadow;
+    uint32_t *ptr;
+
+    if (shadow) {
+        if (shadow->rt_enable_valid && shadow->rt_enable == mask)
+            return;
+
+        shadow->rt_enable = mask;
+        shadow->rt_enable_valid = true;
+    }
+
+    ptr = tegra_stream_reserve(cmds, 2);
+    if (!ptr)
+        return;
+
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_INCR(TGR3D_RT_ENABLE, 1));
+    TEGRA_STREAM_EMIT(ptr, mask);
+    tegra_stream_commit(cmds, ptr);
 }
 
 void tgr3d_set_texture_desc(struct tegra_stream *cmds,
@@ -476,10 +671,11 @@ void tgr3d_set_texture_desc(struct tegra_stream *cmds,
                             bool mirrored_repeat,
                             bool explicit_fencing)
 {
-    uint32_t value = 0;
+    struct tgr3d_shadow *shadow = cmds->gr3d_shadow;
+    uint32_t desc[2];
+    uint32_t value;
 
     tegra_stream_prep(cmds, 5);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_TEXTURE_DESC1(index), 2));
 
     value  = TGR3D_VAL(TEXTURE_DESC1, FORMAT, pixel_format);
     value |= TGR3D_BOOL(TEXTURE_DESC1, MINFILTER_LINEAR_WITHIN, min_filter_linear);
@@ -490,7 +686,7 @@ void tgr3d_set_texture_desc(struct tegra_stream *cmds,
     value |= TGR3D_BOOL(TEXTURE_DESC1, WRAP_T_MIRRORED_REPEAT, mirrored_repeat);
     value |= TGR3D_BOOL(TEXTURE_DESC1, WRAP_S_MIRRORED_REPEAT, mirrored_repeat);
 
-    tegra_stream_push(cmds, value);
+    desc[0] = value;
 
     value = TGR3D_BOOL(TEXTURE_DESC2, MIPMAP_DISABLE, 1);
 
@@ -502,8 +698,22 @@ void tgr3d_set_texture_desc(struct tegra_stream *cmds,
         value |= TGR3D_VAL(TEXTURE_DESC2, WIDTH, width);
         value |= TGR3D_VAL(TEXTURE_DESC2, HEIGHT, height);
     }
-    tegra_stream_push(cmds, value);
 
+    desc[1] = value;
+
+    if (!shadow || !(shadow->tex_desc_valid & (1u << index)) ||
+        memcmp(shadow->tex_desc[index], desc, sizeof(desc))) {
+        tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_TEXTURE_DESC1(index), 2));
+        tegra_stream_push(cmds, desc[0]);
+        tegra_stream_push(cmds, desc[1]);
+    }
+
+    if (shadow) {
+        memcpy(shadow->tex_desc[index], desc, sizeof(desc));
+        shadow->tex_desc_valid |= 1u << index;
+    }
+
+    /* pointer is always re-written, it's needed for the texture cache flush */
     tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_TEXTURE_POINTER(index), 1));
     tegra_stream_push_reloc(cmds, bo, offset, false, explicit_fencing);
 }
@@ -515,9 +725,12 @@ void tgr3d_set_draw_params(struct tegra_stream *cmds,
                            bool vtx_mem_cache_invalidate,
                            bool vtx_gpu_cache_invalidate)
 {
+    uint32_t *ptr;
     uint32_t value = 0;
 
-    tegra_stream_prep(cmds, 2);
+    ptr = tegra_stream_reserve(cmds, 2);
+    if (!ptr)
+        return;
 
     value |= TGR3D_VAL(DRAW_PARAMS, INDEX_MODE, index_mode);
     value |= TGR3D_VAL(DRAW_PARAMS, PROVOKING_VERTEX, 0);
@@ -526,24 +739,31 @@ void tgr3d_set_draw_params(struct tegra_stream *cmds,
     value |= TGR3D_BOOL(DRAW_PARAMS, VTX_MEM_CACHE_INVALIDATE, vtx_mem_cache_invalidate);
     value |= TGR3D_BOOL(DRAW_PARAMS, VTX_GPU_CACHE_INVALIDATE, vtx_gpu_cache_invalidate);
 
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_DRAW_PARAMS, 1));
-    tegra_stream_push(cmds, value);
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_INCR(TGR3D_DRAW_PARAMS, 1));
+    TEGRA_STREAM_EMIT(ptr, value);
+    tegra_stream_commit(cmds, ptr);
 }
 
 void tgr3d_draw_primitives(struct tegra_stream *cmds,
                            unsigned first_index, unsigned count)
 {
+    uint32_t *ptr;
     uint32_t value = 0;
 
+    ptr = tegra_stream_reserve(cmds, 5);
+    if (!ptr)
+        return;
+
     /*
      * Tegra30 has glitches without this, probably some cache / internal
      * state maintenance.
      */
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xb00, 0x00000001));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xe41, 0x00000001));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xb00, 0x00000002));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xe41, 0x00000003));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xb00, 0x00000003));
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_IMM(0xb00, 0x00000001));
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_IMM(0xe41, 0x00000001));
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_IMM(0xb00, 0x00000002));
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_IMM(0xe41, 0x00000003));
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_IMM(0xb00, 0x00000003));
+    tegra_stream_commit(cmds, ptr);
 
     /*
      * XXX: This requires proper waitcheck barrier, expect graphical
@@ -551,13 +771,16 @@ void tgr3d_draw_primitives(struct tegra_stream *cmds,
      */
     tegra_stream_sync(cmds, DRM_TEGRA_SYNCPT_COND_RD_DONE, true);
 
-    tegra_stream_prep(cmds, 2);
+    ptr = tegra_stream_reserve(cmds, 2);
+    if (!ptr)
+        return;
 
     value |= TGR3D_VAL(DRAW_PRIMITIVES, INDEX_COUNT, count - 1);
     value |= TGR3D_VAL(DRAW_PRIMITIVES, OFFSET, first_index);
 
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_DRAW_PRIMITIVES, 1));
-    tegra_stream_push(cmds, value);
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_INCR(TGR3D_DRAW_PRIMITIVES, 1));
+    TEGRA_STREAM_EMIT(ptr, value);
+    tegra_stream_commit(cmds, ptr);
 
     tegra_stream_sync(cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE, true);
 }
@@ -565,30 +788,49 @@ void tgr3d_draw_primitives(struct tegra_stream *cmds,
 void tgr3d_upload_program(struct tegra_stream *cmds,
                           const struct shader_program *prog)
 {
+    struct tgr3d_shadow *shadow = cmds->gr3d_shadow;
+    uint32_t *ptr;
+
+    if (shadow) {
+        if (shadow->prog == prog)
+            return;
+
+        shadow->prog = prog;
+    }
+
     tgr3d_set_pseq_dw_cfg(cmds, prog->fs_pseq_to_dw);
     tgr3d_set_alu_buffer_size(cmds, prog->fs_alu_buf_size);
     tgr3d_startup_pseq_engine(cmds, prog->fs_pseq_inst_nb);
     tgr3d_set_used_tram_rows_num(cmds, prog->used_tram_rows_nb);
     tgr3d_set_cullface_and_linker_inst_num(cmds, prog->linker_inst_nb);
 
-    tegra_stream_prep(cmds, 4);
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(TGR3D_VP_UPLOAD_INST_ID, 0));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(TGR3D_FP_UPLOAD_INST_ID_COMMON, 0));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(TGR3D_FP_UPLOAD_MFU_INST_ID, 0));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(TGR3D_FP_UPLOAD_ALU_INST_ID, 0));
+    ptr = tegra_stream_reserve(cmds, 4);
+    if (!ptr)
+        return;
+
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_IMM(TGR3D_VP_UPLOAD_INST_ID, 0));
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_IMM(TGR3D_FP_UPLOAD_INST_ID_COMMON, 0));
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_IMM(TGR3D_FP_UPLOAD_MFU_INST_ID, 0));
+    TEGRA_STREAM_EMIT(ptr, HOST1X_OPCODE_IMM(TGR3D_FP_UPLOAD_ALU_INST_ID, 0));
+    tegra_stream_commit(cmds, ptr);
 
-    tegra_stream_push_words(cmds, prog->vs_prog_words, prog->vs_prog_words_nb, 0);
+    tegra_stream_push_words(cmds, prog->vs_prog_words, prog->vs_prog_words_nb,
+                            NULL, 0);
 
     if (cmds->tegra114)
-        tegra_stream_push_words(cmds, prog->fs_prog_words_t114, prog->fs_prog_words_nb, 0);
+        tegra_stream_push_words(cmds, prog->fs_prog_words_t114,
+                                prog->fs_prog_words_nb, NULL, 0);
     else
-        tegra_stream_push_words(cmds, prog->fs_prog_words, prog->fs_prog_words_nb, 0);
+        tegra_stream_push_words(cmds, prog->fs_prog_words,
+                                prog->fs_prog_words_nb, NULL, 0);
 
-    tegra_stream_push_words(cmds, prog->linker_words,  prog->linker_words_nb, 0);
+    tegra_stream_push_words(cmds, prog->linker_words, prog->linker_words_nb,
+                            NULL, 0);
 }
 
 void tgr3d_initialize(struct tegra_stream *cmds)
 {
+    tgr3d_reset_shadow(cmds);
     tgr3d_init_state(cmds);
     tgr3d_set_guardband(cmds);
     tgr3d_set_late_test(cmds);
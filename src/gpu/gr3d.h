@@ -96,6 +96,11 @@ void tgr3d_set_vp_attrib_buf(struct tegra_stream *cmds,
                              unsigned size, unsigned stride,
                              bool explicit_fencing);
 
+void tgr3d_set_index_buf(struct tegra_stream *cmds,
+                         struct drm_tegra_bo *bo,
+                         unsigned offset,
+                         bool explicit_fencing);
+
 void tgr3d_set_vp_attributes_inout_mask(struct tegra_stream *cmds,
                                         uint32_t in_mask,
                                         uint32_t out_mask);
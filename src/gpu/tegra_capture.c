@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "driver.h"
+#include "tegra_capture.h"
+
+#define ErrorMsg(fmt, args...) \
+    xf86DrvMsg(-1, X_ERROR, "%s:%d/%s(): " fmt, \
+               __FILE__, __LINE__, __func__, ##args)
+
+#define InfoMsg(fmt, args...) \
+    xf86DrvMsg(-1, X_INFO, "%s:%d/%s(): " fmt, \
+               __FILE__, __LINE__, __func__, ##args)
+
+FILE *tegra_capture_file;
+
+static bool tegra_capture_initialized;
+
+void tegra_capture_init(struct drm_tegra *drm)
+{
+    struct tegra_capture_file_header hdr;
+    const char *path;
+
+    if (tegra_capture_initialized)
+        return;
+
+    tegra_capture_initialized = true;
+
+    path = getenv("OPENTEGRA_CAPTURE");
+    if (!path)
+        return;
+
+    tegra_capture_file = fopen(path, "wb");
+    if (!tegra_capture_file) {
+        ErrorMsg("failed to open %s: %s\n", path, strerror(errno));
+        return;
+    }
+
+    hdr.magic = TEGRA_CAPTURE_MAGIC;
+    hdr.version = TEGRA_CAPTURE_VERSION;
+    hdr.soc_id = drm_tegra_get_soc_id(drm);
+    hdr.drm_version = drm_tegra_version(drm);
+
+    if (fwrite(&hdr, sizeof(hdr), 1, tegra_capture_file) != 1) {
+        ErrorMsg("failed to write %s\n", path);
+        fclose(tegra_capture_file);
+        tegra_capture_file = NULL;
+        return;
+    }
+
+    InfoMsg("capturing jobs to %s\n", path);
+}
+
+/*
+ * Capture is stopped as a whole if job can't be recorded completely, job
+ * with missing relocations would be replayed wrongly.  Jobs captured so
+ * far are kept.
+ */
+static void tegra_capture_stop(void)
+{
+    fclose(tegra_capture_file);
+    tegra_capture_file = NULL;
+}
+
+void tegra_capture_push_reloc(struct tegra_capture *capture,
+                              uint32_t word,
+                              struct drm_tegra_bo *bo,
+                              uint32_t offset,
+                              bool write,
+                              bool explicit_fencing)
+{
+    struct tegra_capture_reloc *relocs;
+    unsigned int max_relocs;
+
+    if (capture->num_relocs == capture->max_relocs) {
+        max_relocs = capture->max_relocs ? capture->max_relocs * 2 : 64;
+
+        relocs = realloc(capture->relocs, max_relocs * sizeof(*relocs));
+        if (!relocs) {
+            ErrorMsg("failed to allocate %u relocations, capture stopped\n",
+                     max_relocs);
+            tegra_capture_stop();
+            tegra_capture_reset(capture);
+            return;
+        }
+
+        capture->relocs = relocs;
+        capture->max_relocs = max_relocs;
+    }
+
+    relocs = &capture->relocs[capture->num_relocs++];
+    relocs->bo = bo;
+    relocs->word = word;
+    relocs->offset = offset;
+    relocs->flags = 0;
+
+    if (write)
+        relocs->flags |= TEGRA_CAPTURE_RELOC_WRITE;
+
+    if (explicit_fencing)
+        relocs->flags |= TEGRA_CAPTURE_RELOC_EXPLICIT_FENCE;
+}
+
+/* FNV-1a, BO contents hash only tells whether data differs between jobs */
+static uint64_t tegra_capture_hash_bo(struct drm_tegra_bo *bo, uint32_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const uint8_t *data;
+    void *ptr;
+    uint32_t i;
+
+    if (drm_tegra_bo_map(bo, &ptr))
+        return 0;
+
+    for (i = 0, data = ptr; i < size; i++)
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+
+    drm_tegra_bo_unmap(bo);
+
+    return hash;
+}
+
+void tegra_capture_job(struct tegra_capture *capture,
+                       enum host1x_engine engine,
+                       unsigned int uapi,
+                       const uint32_t *words,
+                       unsigned int num_words,
+                       struct tegra_fence *explicit_fence,
+                       struct tegra_fence *fence)
+{
+    struct tegra_capture_reloc_entry entry;
+    struct tegra_capture_job_header hdr;
+    struct tegra_capture_reloc *reloc;
+    struct timespec time;
+    unsigned int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    hdr.timestamp_ns = time.tv_sec * 1000000000ull + time.tv_nsec;
+    hdr.fence = (uintptr_t)fence;
+    hdr.explicit_fence = (uintptr_t)explicit_fence;
+    hdr.engine = engine;
+    hdr.uapi = uapi;
+    hdr.num_words = num_words;
+    hdr.num_relocs = capture->num_relocs;
+
+    fwrite(&hdr, sizeof(hdr), 1, tegra_capture_file);
+
+    for (i = 0; i < capture->num_relocs; i++) {
+        reloc = &capture->relocs[i];
+
+        memset(&entry, 0, sizeof(entry));
+        drm_tegra_bo_get_handle(reloc->bo, &entry.bo_handle);
+        drm_tegra_bo_get_size(reloc->bo, &entry.bo_size);
+        entry.bo_hash = tegra_capture_hash_bo(reloc->bo, entry.bo_size);
+        entry.bo_offset = reloc->offset;
+        entry.word = reloc->word;
+        entry.flags = reloc->flags;
+
+        fwrite(&entry, sizeof(entry), 1, tegra_capture_file);
+    }
+
+    fwrite(words, sizeof(*words), num_words, tegra_capture_file);
+
+    /* keep the capture usable if GPU hangs the machine */
+    fflush(tegra_capture_file);
+
+    tegra_capture_reset(capture);
+}
+
+void tegra_capture_fini(struct tegra_capture *capture)
+{
+    free(capture->relocs);
+    capture->relocs = NULL;
+    capture->num_relocs = 0;
+    capture->max_relocs = 0;
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef TEGRA_CAPTURE_H_
+#define TEGRA_CAPTURE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "host1x.h"
+
+/*
+ * Capture file consists of the file header followed by the job records.
+ * Each record is the job header, followed by num_relocs relocations and
+ * num_words of the cmdstream. Relocated words are left as is, they hold
+ * UAPI-specific data that replayer overwrites. Fences are identified by
+ * an opaque ID that is unique among the alive fences. All values are in
+ * the native byte order.
+ */
+#define TEGRA_CAPTURE_MAGIC                 0x50414354 /* "TCAP" */
+#define TEGRA_CAPTURE_VERSION               1
+
+#define TEGRA_CAPTURE_RELOC_WRITE           (1 << 0)
+#define TEGRA_CAPTURE_RELOC_EXPLICIT_FENCE  (1 << 1)
+
+struct tegra_capture_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t soc_id;
+    uint32_t drm_version;
+};
+
+struct tegra_capture_job_header {
+    uint64_t timestamp_ns;
+    uint64_t fence;
+    uint64_t explicit_fence;
+    uint32_t engine;
+    uint32_t uapi;
+    uint32_t num_words;
+    uint32_t num_relocs;
+};
+
+struct tegra_capture_reloc_entry {
+    uint64_t bo_hash;
+    uint32_t word;
+    uint32_t bo_handle;
+    uint32_t bo_size;
+    uint32_t bo_offset;
+    uint32_t flags;
+    uint32_t pad;
+};
+
+struct drm_tegra;
+struct drm_tegra_bo;
+struct tegra_fence;
+
+struct tegra_capture_reloc {
+    struct drm_tegra_bo *bo;
+    uint32_t word;
+    uint32_t offset;
+    uint32_t flags;
+};
+
+/* relocations of the job under construction, owned by stream */
+struct tegra_capture {
+    struct tegra_capture_reloc *relocs;
+    unsigned int num_relocs;
+    unsigned int max_relocs;
+};
+
+extern FILE *tegra_capture_file;
+
+/*
+ * Capturing is enabled by the OPENTEGRA_CAPTURE environment variable that
+ * specifies the output file path.
+ */
+void tegra_capture_init(struct drm_tegra *drm);
+
+static inline bool tegra_capture_enabled(void)
+{
+    return tegra_capture_file != NULL;
+}
+
+void tegra_capture_push_reloc(struct tegra_capture *capture,
+                              uint32_t word,
+                              struct drm_tegra_bo *bo,
+                              uint32_t offset,
+                              bool write,
+                              bool explicit_fencing);
+
+void tegra_capture_job(struct tegra_capture *capture,
+                       enum host1x_engine engine,
+                       unsigned int uapi,
+                       const uint32_t *words,
+                       unsigned int num_words,
+                       struct tegra_fence *explicit_fence,
+                       struct tegra_fence *fence);
+
+static inline void tegra_capture_reset(struct tegra_capture *capture)
+{
+    capture->num_relocs = 0;
+}
+
+void tegra_capture_fini(struct tegra_capture *capture);
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -51,3 +51,132 @@ void tegra_fences_debug_dump(unsigned int max)
     }
 }
 #endif
+
+#define TEGRA_FENCE_POOL_SIZE   64
+
+struct tegra_fence_pool_entry {
+    struct tegra_fence_pool_entry *next;
+};
+
+static struct tegra_fence_pool_entry *tegra_fence_pool;
+static unsigned int tegra_fence_pool_num;
+static size_t tegra_fence_pool_obj_size;
+
+void *tegra_fence_alloc(size_t size)
+{
+    struct tegra_fence_pool_entry *entry = tegra_fence_pool;
+
+    if (!entry || size != tegra_fence_pool_obj_size)
+        return calloc(1, size);
+
+    tegra_fence_pool = entry->next;
+    tegra_fence_pool_num--;
+
+    memset(entry, 0, size);
+
+    return entry;
+}
+
+void tegra_fence_release(void *f, size_t size)
+{
+    struct tegra_fence_pool_entry *entry = f;
+
+    if (tegra_fence_pool_num == TEGRA_FENCE_POOL_SIZE ||
+        (tegra_fence_pool && size != tegra_fence_pool_obj_size)) {
+        free(f);
+        return;
+    }
+
+    entry->next = tegra_fence_pool;
+    tegra_fence_pool = entry;
+    tegra_fence_pool_num++;
+    tegra_fence_pool_obj_size = size;
+}
+
+struct tegra_fence_waiter {
+    struct tegra_fence *fence;
+    tegra_fence_notify_proc notify;
+    void *data;
+    int fd;
+};
+
+#if XORG_VERSION_CURRENT >= XORG_VERSION_NUMERIC(1,19,0,0,0)
+static void tegra_fence_waiter_release(struct tegra_fence_waiter *waiter)
+{
+    RemoveNotifyFd(waiter->fd);
+    close(waiter->fd);
+
+    TEGRA_FENCE_PUT(waiter->fence);
+    free(waiter);
+}
+
+static void tegra_fence_notify_handler(int fd, int ready, void *data)
+{
+    struct tegra_fence_waiter *waiter = data;
+
+    /* sync_file is signalled, hence this only updates the fence state */
+    TEGRA_FENCE_WAIT(waiter->fence);
+
+    waiter->notify(waiter->fence, waiter->data);
+
+    tegra_fence_waiter_release(waiter);
+}
+
+static struct tegra_fence_waiter *
+tegra_fence_waiter_create(struct tegra_fence *f,
+                          tegra_fence_notify_proc notify, void *data)
+{
+    struct tegra_fence_waiter *waiter;
+    int fd;
+
+    fd = tegra_fence_export_fd(f);
+    if (fd < 0)
+        return NULL;
+
+    waiter = malloc(sizeof(*waiter));
+    if (!waiter) {
+        close(fd);
+        return NULL;
+    }
+
+    if (!SetNotifyFd(fd, tegra_fence_notify_handler, X_NOTIFY_READ, waiter)) {
+        free(waiter);
+        close(fd);
+        return NULL;
+    }
+
+    waiter->fence = TEGRA_FENCE_GET(f, NULL);
+    waiter->notify = notify;
+    waiter->data = data;
+    waiter->fd = fd;
+
+    return waiter;
+}
+#else
+static struct tegra_fence_waiter *
+tegra_fence_waiter_create(struct tegra_fence *f,
+                          tegra_fence_notify_proc notify, void *data)
+{
+    return NULL;
+}
+#endif
+
+struct tegra_fence_waiter *
+tegra_fence_wait_async(struct tegra_fence *f, tegra_fence_notify_proc notify,
+                       void *data)
+{
+    if (TEGRA_FENCE_COMPLETED(f)) {
+        notify(f, data);
+        return NULL;
+    }
+
+    return tegra_fence_waiter_create(f, notify, data);
+}
+
+void tegra_fence_waiter_cancel(struct tegra_fence_waiter *waiter)
+{
+#if XORG_VERSION_CURRENT >= XORG_VERSION_NUMERIC(1,19,0,0,0)
+    if (waiter)
+        tegra_fence_waiter_release(waiter);
+#endif
+}
@@ -26,6 +26,7 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -72,6 +73,7 @@ struct tegra_fence {
     bool (*wait_fence)(struct tegra_fence *f);
     bool (*free_fence)(struct tegra_fence *f);
     bool (*mark_completed)(struct tegra_fence *f);
+    int (*export_fd)(struct tegra_fence *f);
 
 #ifdef FENCE_DEBUG
     uint32_t bug0;
@@ -270,4 +272,47 @@ static inline bool tegra_fence_mark_completed(struct tegra_fence *f)
 #define TEGRA_FENCE_MARK_COMPLETED(F) \
     ({ TEGRA_FENCE_DEBUG_MSG(F, "mark_completed"); tegra_fence_mark_completed(F); })
 
+/*
+ * Returns sync_file FD that signals once fence is completed, caller owns
+ * the FD. Negative value is returned if fence can't be exported, which is
+ * the case for the completed fences and for the legacy UAPI.
+ */
+static inline int tegra_fence_export_fd(struct tegra_fence *f)
+{
+    if (f) {
+        tegra_fence_validate(f);
+
+        if (f->active && f->export_fd)
+            return f->export_fd(f);
+    }
+
+    return -1;
+}
+
+/*
+ * Fence objects are allocated per job submission, released objects are
+ * kept in a freelist for reuse. All fences are of the same size since
+ * only one UAPI is used at a time. Memory is zero-initialized.
+ */
+void *tegra_fence_alloc(size_t size);
+void tegra_fence_release(void *f, size_t size);
+
+struct tegra_fence_waiter;
+
+typedef void (*tegra_fence_notify_proc)(struct tegra_fence *f, void *data);
+
+/*
+ * Invokes notify() once fence is completed without blocking the caller, the
+ * fence is polled by the X server's main loop. Returns waiter that is valid
+ * until notify() is invoked, it could be used for cancelling the wait.
+ * Returns NULL if fence is already completed, in this case notify() is
+ * invoked right away, or if fence can't be polled, in this case notify()
+ * is never invoked and caller should wait for the fence by itself.
+ */
+struct tegra_fence_waiter *
+tegra_fence_wait_async(struct tegra_fence *f, tegra_fence_notify_proc notify,
+                       void *data);
+
+void tegra_fence_waiter_cancel(struct tegra_fence_waiter *waiter);
+
 #endif
@@ -0,0 +1,1027 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Decoder and replayer of the job captures made with OPENTEGRA_CAPTURE.
+ *
+ * Replay goes through the upstream job UAPI, which is implemented by the
+ * mock device as well. Syncpoint increments are re-emitted for the replay
+ * channel and host1x waits are dropped, jobs are serialized by awaiting
+ * the captured explicit fences instead. BOs are created on the first use
+ * and are zero-filled, capture holds only the hash of the BO contents.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "opentegra_lib.h"
+
+#include "host1x.h"
+#include "tegra_capture.h"
+#include "tgr_3d.xml.h"
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+#define REPLAY_FENCES_NUM   64
+
+struct reg_desc {
+    uint32_t reg;
+    uint32_t count;
+    uint32_t stride;
+    const char *name;
+};
+
+#define REG(R)              { R, 1, 1, #R }
+#define REG_ARRAY(R)        { R(0), R##__LEN, R##__ESIZE, #R }
+#define REG_NAMED(R, NAME)  { R, 1, 1, NAME }
+
+static const struct reg_desc host1x_regs[] = {
+    REG_NAMED(0x000, "INCR_SYNCPT"),
+    REG_NAMED(0x008, "WAIT_SYNCPT"),
+    REG_NAMED(0x009, "WAIT_SYNCPT_BASE"),
+    REG_NAMED(0x00b, "LOAD_SYNCPT_BASE"),
+    REG_NAMED(0x00c, "INCR_SYNCPT_BASE"),
+};
+
+/* GR2D registers as they are used by EXA */
+static const struct reg_desc gr2d_regs[] = {
+    REG_NAMED(0x000, "INCR_SYNCPT"),
+    REG_NAMED(0x008, "WAIT_SYNCPT"),
+    REG_NAMED(0x009, "TRIGGER"),
+    REG_NAMED(0x00c, "CMDSEL"),
+    REG_NAMED(0x01e, "CONTROLSECOND"),
+    REG_NAMED(0x01f, "CONTROLMAIN"),
+    REG_NAMED(0x020, "ROPFADE"),
+    REG_NAMED(0x02b, "DSTBA"),
+    REG_NAMED(0x02e, "DSTST"),
+    REG_NAMED(0x031, "SRCBA"),
+    REG_NAMED(0x033, "SRCST"),
+    REG_NAMED(0x035, "SRC_FGC"),
+    REG_NAMED(0x037, "SRCSIZE"),
+    REG_NAMED(0x038, "DSTSIZE"),
+    REG_NAMED(0x039, "SRCPS"),
+    REG_NAMED(0x03a, "DSTPS"),
+    REG_NAMED(0x046, "TILEMODE"),
+};
+
+static const struct reg_desc gr3d_regs[] = {
+    REG(TGR3D_INCR_SYNCPT),
+    REG(TGR3D_WAIT_SYNCPT),
+    REG(TGR3D_WAIT_SYNCPT_BASE),
+    REG(TGR3D_LOAD_SYNCPT_BASE),
+    REG(TGR3D_INCR_SYNCPT_BASE),
+    REG(TGR3D_INDOFF2),
+    REG(TGR3D_INDOFF),
+    REG_ARRAY(TGR3D_ATTRIB_PTR),
+    REG_ARRAY(TGR3D_ATTRIB_MODE),
+    REG(TGR3D_VP_ATTRIB_IN_OUT_SELECT),
+    REG(TGR3D_INDEX_PTR),
+    REG(TGR3D_DRAW_PARAMS),
+    REG(TGR3D_DRAW_PRIMITIVES),
+    REG(TGR3D_VP_UPLOAD_INST_ID),
+    REG(TGR3D_VP_UPLOAD_INST),
+    REG(TGR3D_VP_UPLOAD_CONST_ID),
+    REG(TGR3D_VP_UPLOAD_CONST),
+    REG_ARRAY(TGR3D_LINKER_INSTRUCTION),
+    REG(TGR3D_CULL_FACE_LINKER_SETUP),
+    REG(TGR3D_POLYGON_OFFSET_UNITS),
+    REG(TGR3D_POLYFON_OFFSET_FACTOR),
+    REG(TGR3D_POINT_PARAMS),
+    REG(TGR3D_POINT_SIZE),
+    REG(TGR3D_POINT_COORD_RANGE_MAX_S),
+    REG(TGR3D_POINT_COORD_RANGE_MAX_T),
+    REG(TGR3D_POINT_COORD_RANGE_MIN_S),
+    REG(TGR3D_POINT_COORD_RANGE_MIN_T),
+    REG(TGR3D_LINE_PARAMS),
+    REG(TGR3D_HALF_LINE_WIDTH),
+    REG(TGR3D_SCISSOR_HORIZ),
+    REG(TGR3D_SCISSOR_VERT),
+    REG(TGR3D_VIEWPORT_X_BIAS),
+    REG(TGR3D_VIEWPORT_Y_BIAS),
+    REG(TGR3D_VIEWPORT_Z_BIAS),
+    REG(TGR3D_VIEWPORT_X_SCALE),
+    REG(TGR3D_VIEWPORT_Y_SCALE),
+    REG(TGR3D_VIEWPORT_Z_SCALE),
+    REG(TGR3D_GUARDBAND_WIDTH),
+    REG(TGR3D_GUARDBAND_HEIGHT),
+    REG(TGR3D_GUARDBAND_DEPTH),
+    REG(TGR3D_STENCIL_FRONT1),
+    REG(TGR3D_STENCIL_BACK1),
+    REG(TGR3D_STENCIL_PARAMS),
+    REG(TGR3D_DEPTH_TEST_PARAMS),
+    REG(TGR3D_DEPTH_RANGE_NEAR),
+    REG(TGR3D_DEPTH_RANGE_FAR),
+    REG(TGR3D_FP_PSEQ_UPLOAD_INST_BUFFER_FLUSH),
+    REG(TGR3D_FP_PSEQ_ENGINE_INST),
+    REG(TGR3D_FP_PSEQ_UPLOAD_INST_ID),
+    REG(TGR3D_FP_PSEQ_UPLOAD_INST),
+    REG(TGR3D_FP_PSEQ_QUAD_ID),
+    REG(TGR3D_FP_PSEQ_DW_CFG),
+    REG(TGR3D_FP_UPLOAD_MFU_SCHED_ID),
+    REG(TGR3D_FP_UPLOAD_MFU_SCHED),
+    REG(TGR3D_FP_UPLOAD_MFU_INST_ID),
+    REG(TGR3D_FP_UPLOAD_MFU_INST),
+    REG(TGR3D_FP_UPLOAD_TEX_INST_ID),
+    REG(TGR3D_FP_UPLOAD_TEX_INST),
+    REG_ARRAY(TGR3D_TEXTURE_POINTER),
+    REG_ARRAY(TGR3D_TEXTURE_DESC1),
+    REG_ARRAY(TGR3D_TEXTURE_DESC2),
+    REG(TGR3D_FP_UPLOAD_ALU_SCHED_ID),
+    REG(TGR3D_FP_UPLOAD_ALU_SCHED),
+    REG(TGR3D_FP_UPLOAD_ALU_INST_ID),
+    REG(TGR3D_FP_UPLOAD_ALU_INST),
+    REG(TGR3D_FP_UPLOAD_ALU_INST_COMPLEMENT),
+    REG_ARRAY(TGR3D_FP_CONST),
+    REG(TGR3D_FP_UPLOAD_DW_INST_ID),
+    REG(TGR3D_FP_UPLOAD_DW_INST),
+    REG(TGR3D_RT_ENABLE),
+    REG(TGR3D_FDC_CONTROL),
+    REG_ARRAY(TGR3D_RT_PTR),
+    REG_ARRAY(TGR3D_RT_PARAMS),
+    REG(TGR3D_ALU_BUFFER_SIZE),
+    REG(TGR3D_TRAM_SETUP),
+    REG(TGR3D_FP_UPLOAD_INST_ID_COMMON),
+    REG(TGR3D_DITHER),
+    REG(TGR3D_STENCIL_FRONT2),
+    REG(TGR3D_STENCIL_BACK2),
+};
+
+static const char * const opcode_names[16] = {
+    [0x0] = "SETCL",
+    [0x1] = "INCR",
+    [0x2] = "NONINCR",
+    [0x3] = "MASK",
+    [0x4] = "IMM",
+    [0x5] = "RESTART",
+    [0x6] = "GATHER",
+    [0xe] = "EXTEND",
+};
+
+struct host1x_op {
+    unsigned int pos;
+    unsigned int opcode;
+    uint32_t offset;
+    uint32_t mask;
+    uint32_t class_id;
+    unsigned int num_data;
+};
+
+struct capture_job {
+    struct tegra_capture_job_header hdr;
+    struct tegra_capture_reloc_entry *relocs;
+    uint32_t *words;
+};
+
+struct replay_bo {
+    uint32_t handle;
+    uint32_t size;
+    struct drm_tegra_bo *bo;
+};
+
+struct replay_fence {
+    uint64_t id;
+    struct drm_tegra_fence *fence;
+    struct drm_tegra_job *job;
+};
+
+struct replay_state {
+    struct drm_tegra *drm;
+    struct drm_tegra_channel *channels[TEGRA_ENGINES_NUM];
+    struct replay_bo *bos;
+    unsigned int num_bos;
+    struct replay_fence fences[REPLAY_FENCES_NUM];
+    unsigned int next_fence;
+};
+
+struct reg_stat {
+    uint32_t class_id;
+    uint32_t reg;
+    uint64_t writes;
+    uint64_t redundant;
+};
+
+struct capture_stats {
+    uint64_t jobs[TEGRA_ENGINES_NUM + 1];
+    uint64_t words[TEGRA_ENGINES_NUM + 1];
+    uint64_t relocs;
+    uint64_t opcodes[16];
+    uint64_t first_ns;
+    uint64_t last_ns;
+    struct reg_stat *regs;
+    unsigned int num_regs;
+};
+
+static const char *capture_path;
+static const char *device_path;
+static bool opt_decode;
+static bool opt_stats;
+static bool opt_replay;
+static bool opt_sync;
+
+static const char *engine_name(uint32_t engine)
+{
+    switch (engine) {
+    case TEGRA_2D:
+        return "2D";
+    case TEGRA_3D:
+        return "3D";
+    default:
+        return "sync";
+    }
+}
+
+static const char *reg_name(uint32_t class_id, uint32_t reg, char *buf,
+                            size_t size)
+{
+    const struct reg_desc *regs;
+    unsigned int i, num;
+    uint32_t index;
+
+    switch (class_id) {
+    case HOST1X_CLASS_HOST1X:
+        regs = host1x_regs;
+        num = ARRAY_SIZE(host1x_regs);
+        break;
+    case HOST1X_CLASS_GR2D:
+        regs = gr2d_regs;
+        num = ARRAY_SIZE(gr2d_regs);
+        break;
+    case HOST1X_CLASS_GR3D:
+        regs = gr3d_regs;
+        num = ARRAY_SIZE(gr3d_regs);
+        break;
+    default:
+        regs = NULL;
+        num = 0;
+        break;
+    }
+
+    for (i = 0; i < num; i++) {
+        if (reg < regs[i].reg ||
+            reg >= regs[i].reg + regs[i].count * regs[i].stride ||
+            (reg - regs[i].reg) % regs[i].stride)
+            continue;
+
+        if (regs[i].count == 1)
+            return regs[i].name;
+
+        index = (reg - regs[i].reg) / regs[i].stride;
+        snprintf(buf, size, "%s[%u]", regs[i].name, index);
+
+        return buf;
+    }
+
+    snprintf(buf, size, "0x%03x", reg);
+
+    return buf;
+}
+
+/* returns the next opcode of cmdstream, false at the end of cmdstream */
+static bool host1x_next_op(const uint32_t *words, unsigned int num_words,
+                           unsigned int *pos, struct host1x_op *op)
+{
+    uint32_t word;
+
+    if (*pos >= num_words)
+        return false;
+
+    word = words[*pos];
+
+    op->pos = *pos;
+    op->opcode = word >> 28;
+    op->offset = (word >> 16) & 0xfff;
+    op->mask = 0;
+    op->num_data = 0;
+
+    switch (op->opcode) {
+    case 0x0:
+        op->class_id = (word >> 6) & 0x3ff;
+        op->mask = word & 0x3f;
+        op->num_data = __builtin_popcount(op->mask);
+        break;
+    case 0x1:
+    case 0x2:
+        op->num_data = word & 0xffff;
+        break;
+    case 0x3:
+        op->mask = word & 0xffff;
+        op->num_data = __builtin_popcount(op->mask);
+        break;
+    case 0x6:
+        op->num_data = 1;
+        break;
+    default:
+        break;
+    }
+
+    *pos += 1 + op->num_data;
+
+    return true;
+}
+
+/* register that is written by the data word of the opcode */
+static uint32_t host1x_op_reg(const struct host1x_op *op, unsigned int i)
+{
+    uint32_t mask = op->mask;
+    unsigned int bit;
+
+    switch (op->opcode) {
+    case 0x1:
+        return op->offset + i;
+    case 0x0:
+    case 0x3:
+        for (bit = 0; mask; bit++, mask >>= 1) {
+            if ((mask & 1) && i-- == 0)
+                break;
+        }
+        return op->offset + bit;
+    default:
+        return op->offset;
+    }
+}
+
+static const struct tegra_capture_reloc_entry *
+job_reloc_at(const struct capture_job *job, unsigned int word)
+{
+    unsigned int i;
+
+    for (i = 0; i < job->hdr.num_relocs; i++) {
+        if (job->relocs[i].word == word)
+            return &job->relocs[i];
+    }
+
+    return NULL;
+}
+
+static int read_job(FILE *fp, struct capture_job *job)
+{
+    size_t size;
+
+    if (fread(&job->hdr, sizeof(job->hdr), 1, fp) != 1)
+        return feof(fp) ? 0 : -1;
+
+    size = job->hdr.num_relocs * sizeof(*job->relocs);
+    job->relocs = realloc(job->relocs, size + 1);
+    if (!job->relocs)
+        return -1;
+
+    if (fread(job->relocs, sizeof(*job->relocs), job->hdr.num_relocs,
+              fp) != job->hdr.num_relocs)
+        return -1;
+
+    size = job->hdr.num_words * sizeof(*job->words);
+    job->words = realloc(job->words, size + 1);
+    if (!job->words)
+        return -1;
+
+    if (fread(job->words, sizeof(*job->words), job->hdr.num_words,
+              fp) != job->hdr.num_words)
+        return -1;
+
+    return 1;
+}
+
+static void decode_job(const struct capture_job *job, unsigned int index)
+{
+    const struct tegra_capture_reloc_entry *reloc;
+    unsigned int pos = 0, i, word;
+    uint32_t class_id = 0;
+    struct host1x_op op;
+    char buf[64];
+
+    printf("job %u: %s uapi=v%u words=%u relocs=%u fence=0x%llx",
+           index, engine_name(job->hdr.engine), job->hdr.uapi,
+           job->hdr.num_words, job->hdr.num_relocs,
+           (unsigned long long)job->hdr.fence);
+
+    if (job->hdr.explicit_fence)
+        printf(" waits=0x%llx", (unsigned long long)job->hdr.explicit_fence);
+
+    printf("\n");
+
+    while (host1x_next_op(job->words, job->hdr.num_words, &pos, &op)) {
+        printf("  %04u: %08x  %s", op.pos, job->words[op.pos],
+               opcode_names[op.opcode] ?: "UNKNOWN");
+
+        switch (op.opcode) {
+        case 0x0:
+            class_id = op.class_id;
+            printf(" class=0x%02x offset=0x%03x mask=0x%02x\n",
+                   op.class_id, op.offset, op.mask);
+            break;
+        case 0x1:
+        case 0x2:
+            printf(" offset=0x%03x count=%u\n", op.offset, op.num_data);
+            break;
+        case 0x3:
+            printf(" offset=0x%03x mask=0x%04x\n", op.offset, op.mask);
+            break;
+        case 0x4:
+            printf(" %s = 0x%04x\n",
+                   reg_name(class_id, op.offset, buf, sizeof(buf)),
+                   job->words[op.pos] & 0xffff);
+            break;
+        default:
+            printf("\n");
+            break;
+        }
+
+        for (i = 0; i < op.num_data; i++) {
+            word = op.pos + 1 + i;
+
+            if (word >= job->hdr.num_words)
+                break;
+
+            reloc = job_reloc_at(job, word);
+
+            if (op.opcode == 0x6) {
+                printf("  %04u: %08x      address\n", word, job->words[word]);
+            } else if (reloc) {
+                printf("  %04u: %08x      %s = bo %u+0x%x size=%u "
+                       "hash=%016llx%s\n", word, job->words[word],
+                       reg_name(class_id, host1x_op_reg(&op, i),
+                                buf, sizeof(buf)),
+                       reloc->bo_handle, reloc->bo_offset, reloc->bo_size,
+                       (unsigned long long)reloc->bo_hash,
+                       reloc->flags & TEGRA_CAPTURE_RELOC_WRITE ? " W" : "");
+            } else {
+                printf("  %04u: %08x      %s = 0x%08x\n", word,
+                       job->words[word],
+                       reg_name(class_id, host1x_op_reg(&op, i),
+                                buf, sizeof(buf)),
+                       job->words[word]);
+            }
+        }
+    }
+}
+
+static struct reg_stat *stats_reg(struct capture_stats *stats,
+                                  uint32_t class_id, uint32_t reg)
+{
+    struct reg_stat *regs;
+    unsigned int i;
+
+    for (i = 0; i < stats->num_regs; i++) {
+        if (stats->regs[i].class_id == class_id && stats->regs[i].reg == reg)
+            return &stats->regs[i];
+    }
+
+    regs = realloc(stats->regs, (stats->num_regs + 1) * sizeof(*regs));
+    if (!regs)
+        return NULL;
+
+    stats->regs = regs;
+    regs = &stats->regs[stats->num_regs++];
+    regs->class_id = class_id;
+    regs->reg = reg;
+    regs->writes = 0;
+    regs->redundant = 0;
+
+    return regs;
+}
+
+static void account_job(struct capture_stats *stats,
+                        const struct capture_job *job)
+{
+    /* last written values of the job, to spot the redundant writes */
+    static uint32_t values[2][0x1000];
+    static uint8_t written[2][0x1000];
+    unsigned int engine = job->hdr.engine;
+    unsigned int pos = 0, i, word, c;
+    uint32_t class_id = 0, reg;
+    struct host1x_op op;
+    struct reg_stat *rs;
+
+    if (engine > TEGRA_ENGINES_NUM)
+        engine = TEGRA_ENGINES_NUM;
+
+    if (!stats->first_ns)
+        stats->first_ns = job->hdr.timestamp_ns;
+    stats->last_ns = job->hdr.timestamp_ns;
+
+    stats->jobs[engine]++;
+    stats->words[engine] += job->hdr.num_words;
+    stats->relocs += job->hdr.num_relocs;
+
+    memset(written, 0, sizeof(written));
+
+    while (host1x_next_op(job->words, job->hdr.num_words, &pos, &op)) {
+        stats->opcodes[op.opcode]++;
+
+        if (op.opcode == 0x0)
+            class_id = op.class_id;
+
+        if (op.opcode == 0x4 || op.opcode == 0x6 || op.opcode == 0x0)
+            continue;
+
+        c = class_id == HOST1X_CLASS_GR3D;
+
+        for (i = 0; i < op.num_data; i++) {
+            word = op.pos + 1 + i;
+
+            if (word >= job->hdr.num_words)
+                break;
+
+            reg = host1x_op_reg(&op, i);
+            rs = stats_reg(stats, class_id, reg);
+            if (!rs)
+                continue;
+
+            rs->writes++;
+
+            /* uploads to the data ports aren't redundant */
+            if ((op.opcode != 0x2 || op.num_data == 1) &&
+                !job_reloc_at(job, word) &&
+                written[c][reg] && values[c][reg] == job->words[word])
+                rs->redundant++;
+
+            written[c][reg] = 1;
+            values[c][reg] = job->words[word];
+        }
+    }
+}
+
+static int reg_stat_cmp(const void *a, const void *b)
+{
+    const struct reg_stat *ra = a, *rb = b;
+
+    if (ra->writes != rb->writes)
+        return ra->writes < rb->writes ? 1 : -1;
+
+    return 0;
+}
+
+static void print_stats(struct capture_stats *stats)
+{
+    uint64_t jobs = 0, words = 0, writes = 0, redundant = 0;
+    unsigned int i;
+    char buf[64];
+
+    printf("\n");
+
+    for (i = 0; i <= TEGRA_ENGINES_NUM; i++) {
+        if (!stats->jobs[i])
+            continue;
+
+        printf("%-4s jobs: %8llu  words: %10llu  words/job: %6.1f\n",
+               engine_name(i), (unsigned long long)stats->jobs[i],
+               (unsigned long long)stats->words[i],
+               (double)stats->words[i] / stats->jobs[i]);
+
+        jobs += stats->jobs[i];
+        words += stats->words[i];
+    }
+
+    if (!jobs)
+        return;
+
+    printf("relocations: %llu (%.1f per job)\n",
+           (unsigned long long)stats->relocs,
+           (double)stats->relocs / jobs);
+
+    if (stats->last_ns > stats->first_ns)
+        printf("duration: %.3f sec, %.1f jobs/sec, %.1f KB/sec\n",
+               (stats->last_ns - stats->first_ns) / 1e9,
+               jobs * 1e9 / (stats->last_ns - stats->first_ns),
+               words * 4 * 1e9 / 1024 / (stats->last_ns - stats->first_ns));
+
+    printf("\nopcodes:\n");
+
+    for (i = 0; i < ARRAY_SIZE(stats->opcodes); i++) {
+        if (stats->opcodes[i])
+            printf("  %-8s %10llu\n", opcode_names[i] ?: "UNKNOWN",
+                   (unsigned long long)stats->opcodes[i]);
+    }
+
+    qsort(stats->regs, stats->num_regs, sizeof(*stats->regs), reg_stat_cmp);
+
+    printf("\nregister writes (redundant within job):\n");
+
+    for (i = 0; i < stats->num_regs; i++) {
+        writes += stats->regs[i].writes;
+        redundant += stats->regs[i].redundant;
+
+        if (i >= 32)
+            continue;
+
+        printf("  %s %-36s %10llu %10llu\n",
+               stats->regs[i].class_id == HOST1X_CLASS_GR3D ? "3D" :
+               stats->regs[i].class_id == HOST1X_CLASS_GR2D ? "2D" : "  ",
+               reg_name(stats->regs[i].class_id, stats->regs[i].reg,
+                        buf, sizeof(buf)),
+               (unsigned long long)stats->regs[i].writes,
+               (unsigned long long)stats->regs[i].redundant);
+    }
+
+    printf("  total %42llu %10llu\n",
+           (unsigned long long)writes, (unsigned long long)redundant);
+}
+
+static struct drm_tegra_bo *replay_get_bo(struct replay_state *state,
+                                          uint32_t handle, uint32_t size)
+{
+    struct replay_bo *bos;
+    unsigned int i;
+    int err;
+
+    /* handles are re-used by kernel, hence size is a part of the key */
+    for (i = 0; i < state->num_bos; i++) {
+        if (state->bos[i].handle == handle && state->bos[i].size == size)
+            return state->bos[i].bo;
+    }
+
+    bos = realloc(state->bos, (state->num_bos + 1) * sizeof(*bos));
+    if (!bos)
+        return NULL;
+
+    state->bos = bos;
+    bos = &state->bos[state->num_bos];
+
+    err = drm_tegra_bo_new(&bos->bo, state->drm, 0, size);
+    if (err) {
+        fprintf(stderr, "Failed to allocate BO of size %u: %d\n", size, err);
+        return NULL;
+    }
+
+    bos->handle = handle;
+    bos->size = size;
+    state->num_bos++;
+
+    return bos->bo;
+}
+
+static void replay_release_fence(struct replay_fence *rf)
+{
+    int err;
+
+    if (rf->fence) {
+        err = drm_tegra_fence_wait_timeout(rf->fence, 1000);
+        if (err)
+            fprintf(stderr, "Fence wait failed %d\n", err);
+
+        drm_tegra_fence_free(rf->fence);
+    }
+
+    drm_tegra_job_free(rf->job);
+
+    rf->fence = NULL;
+    rf->job = NULL;
+    rf->id = 0;
+}
+
+static int replay_job(struct replay_state *state,
+                      const struct capture_job *job, unsigned int index)
+{
+    const struct tegra_capture_reloc_entry *reloc;
+    struct drm_tegra_channel *channel;
+    struct drm_tegra_pushbuf *pushbuf;
+    struct drm_tegra_fence *fence;
+    struct drm_tegra_job *drm_job;
+    unsigned int pos = 0, i, word;
+    struct replay_fence *rf;
+    struct drm_tegra_bo *bo;
+    uint32_t class_id = 0;
+    struct host1x_op op;
+    int err;
+
+    /* await the job that was awaited by the captured job */
+    for (i = 0; job->hdr.explicit_fence && i < REPLAY_FENCES_NUM; i++) {
+        if (state->fences[i].id == job->hdr.explicit_fence)
+            replay_release_fence(&state->fences[i]);
+    }
+
+    /* engine of the synchronous flushes is known only from cmdstream */
+    while (host1x_next_op(job->words, job->hdr.num_words, &pos, &op)) {
+        if (op.opcode == 0x0 && op.class_id != HOST1X_CLASS_HOST1X) {
+            class_id = op.class_id;
+            break;
+        }
+    }
+
+    channel = state->channels[class_id == HOST1X_CLASS_GR3D];
+
+    err = drm_tegra_job_new(&drm_job, channel);
+    if (err) {
+        fprintf(stderr, "Job %u: drm_tegra_job_new() failed %d\n", index, err);
+        return err;
+    }
+
+    err = drm_tegra_pushbuf_new(&pushbuf, drm_job);
+    if (err) {
+        fprintf(stderr, "Job %u: drm_tegra_pushbuf_new() failed %d\n",
+                index, err);
+        goto free_job;
+    }
+
+    err = drm_tegra_pushbuf_prepare(pushbuf, job->hdr.num_words + 16);
+    if (err) {
+        fprintf(stderr, "Job %u: drm_tegra_pushbuf_prepare() failed %d\n",
+                index, err);
+        goto free_job;
+    }
+
+    pos = 0;
+
+    while (host1x_next_op(job->words, job->hdr.num_words, &pos, &op)) {
+        /* syncpoint increments are re-emitted for the replay channel */
+        if (op.opcode == 0x4 && op.offset == 0) {
+            err = drm_tegra_pushbuf_sync(pushbuf,
+                                         (job->words[op.pos] >> 8) & 0xff);
+            if (err)
+                goto free_job;
+            continue;
+        }
+
+        /* waits are UAPI-specific, jobs are serialized by the replayer */
+        if (op.opcode == 0x0 && op.class_id == HOST1X_CLASS_HOST1X)
+            continue;
+
+        *pushbuf->ptr++ = job->words[op.pos];
+
+        for (i = 0; i < op.num_data; i++) {
+            word = op.pos + 1 + i;
+
+            if (word >= job->hdr.num_words)
+                break;
+
+            reloc = job_reloc_at(job, word);
+            if (!reloc || op.opcode == 0x6) {
+                *pushbuf->ptr++ = job->words[word];
+                continue;
+            }
+
+            bo = replay_get_bo(state, reloc->bo_handle, reloc->bo_size);
+            if (!bo) {
+                err = -ENOMEM;
+                goto free_job;
+            }
+
+            err = drm_tegra_pushbuf_relocate(pushbuf, bo, reloc->bo_offset, 0);
+            if (err) {
+                fprintf(stderr, "Job %u: drm_tegra_pushbuf_relocate() "
+                        "failed %d\n", index, err);
+                goto free_job;
+            }
+        }
+    }
+
+    if (opt_sync)
+        fprintf(stderr, "Job %u: submitting\n", index);
+
+    err = drm_tegra_job_submit(drm_job, &fence);
+    if (err) {
+        fprintf(stderr, "Job %u: drm_tegra_job_submit() failed %d\n",
+                index, err);
+        goto free_job;
+    }
+
+    rf = &state->fences[state->next_fence];
+    state->next_fence = (state->next_fence + 1) % REPLAY_FENCES_NUM;
+
+    replay_release_fence(rf);
+
+    rf->id = job->hdr.fence;
+    rf->fence = fence;
+    rf->job = drm_job;
+
+    if (opt_sync)
+        replay_release_fence(rf);
+
+    return 0;
+
+free_job:
+    drm_tegra_job_free(drm_job);
+
+    return err;
+}
+
+static int replay_init(struct replay_state *state)
+{
+    int fd = DRM_TEGRA_MOCK_FD;
+    int err;
+
+    if (device_path) {
+        fd = open(device_path, O_RDWR);
+        if (fd < 0) {
+            fprintf(stderr, "Failed to open %s: %s\n",
+                    device_path, strerror(errno));
+            return -errno;
+        }
+    }
+
+    err = drm_tegra_new(&state->drm, fd);
+    if (err) {
+        fprintf(stderr, "drm_tegra_new() failed %d\n", err);
+        return err;
+    }
+
+    err = drm_tegra_channel_open(&state->channels[TEGRA_2D], state->drm,
+                                 DRM_TEGRA_GR2D);
+    if (err) {
+        fprintf(stderr, "Failed to open 2D channel: %d\n", err);
+        return err;
+    }
+
+    err = drm_tegra_channel_open(&state->channels[TEGRA_3D], state->drm,
+                                 DRM_TEGRA_GR3D);
+    if (err) {
+        fprintf(stderr, "Failed to open 3D channel: %d\n", err);
+        return err;
+    }
+
+    return 0;
+}
+
+static void replay_fini(struct replay_state *state)
+{
+    unsigned int i;
+
+    for (i = 0; i < REPLAY_FENCES_NUM; i++)
+        replay_release_fence(&state->fences[i]);
+
+    for (i = 0; i < state->num_bos; i++)
+        drm_tegra_bo_unref(state->bos[i].bo);
+
+    for (i = 0; i < TEGRA_ENGINES_NUM; i++) {
+        if (state->channels[i])
+            drm_tegra_channel_close(state->channels[i]);
+    }
+
+    if (state->drm)
+        drm_tegra_close(state->drm);
+
+    free(state->bos);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] capture-file\n"
+            "  --decode          print the decoded cmdstreams\n"
+            "  --stats           print the cmdstream statistics\n"
+            "  --replay          replay jobs, on the mock device by default\n"
+            "  --device <path>   DRM device to replay on\n"
+            "  --sync            await every job, to locate the hanging one\n",
+            prog);
+}
+
+static int parse_command_line(int argc, char *argv[])
+{
+    static const struct option long_options[] = {
+        { "decode", no_argument,       NULL, 'd' },
+        { "stats",  no_argument,       NULL, 's' },
+        { "replay", no_argument,       NULL, 'r' },
+        { "device", required_argument, NULL, 'D' },
+        { "sync",   no_argument,       NULL, 'S' },
+        { /* Sentinel */ }
+    };
+    int c;
+
+    while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'd':
+            opt_decode = true;
+            break;
+        case 's':
+            opt_stats = true;
+            break;
+        case 'r':
+            opt_replay = true;
+            break;
+        case 'D':
+            device_path = optarg;
+            break;
+        case 'S':
+            opt_sync = true;
+            break;
+        default:
+            return 0;
+        }
+    }
+
+    if (optind != argc - 1)
+        return 0;
+
+    capture_path = argv[optind];
+
+    if (!opt_decode && !opt_replay)
+        opt_stats = true;
+
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    struct replay_state state = { 0 };
+    struct capture_stats stats = { 0 };
+    struct tegra_capture_file_header hdr;
+    struct capture_job job = { 0 };
+    struct timespec start, end;
+    unsigned int index = 0;
+    int ret = 1;
+    int err;
+    FILE *fp;
+
+    if (!parse_command_line(argc, argv)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fp = fopen(capture_path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open %s: %s\n",
+                capture_path, strerror(errno));
+        return 1;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        hdr.magic != TEGRA_CAPTURE_MAGIC ||
+        hdr.version != TEGRA_CAPTURE_VERSION) {
+        fprintf(stderr, "%s isn't a capture file of version %u\n",
+                capture_path, TEGRA_CAPTURE_VERSION);
+        goto close_file;
+    }
+
+    printf("capture: %s, DRM version %u\n",
+           hdr.soc_id < ARRAY_SIZE(drm_tegra_soc_names) ?
+                drm_tegra_soc_names[hdr.soc_id] : "invalid",
+           hdr.drm_version);
+
+    if (opt_replay && replay_init(&state))
+        goto fini;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while ((err = read_job(fp, &job)) > 0) {
+        if (opt_decode)
+            decode_job(&job, index);
+
+        if (opt_stats)
+            account_job(&stats, &job);
+
+        if (opt_replay && replay_job(&state, &job, index))
+            goto fini;
+
+        index++;
+    }
+
+    if (err < 0) {
+        fprintf(stderr, "%s is truncated at job %u\n", capture_path, index);
+        goto fini;
+    }
+
+    if (opt_stats)
+        print_stats(&stats);
+
+    ret = 0;
+
+fini:
+    if (opt_replay) {
+        replay_fini(&state);
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        printf("replayed %u jobs in %.3f sec\n", index,
+               (end.tv_sec - start.tv_sec) +
+               (end.tv_nsec - start.tv_nsec) / 1e9);
+    }
+
+    free(stats.regs);
+    free(job.relocs);
+    free(job.words);
+
+close_file:
+    fclose(fp);
+
+    return ret;
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -29,14 +29,15 @@
 #define TEGRA_STREAM_H_
 
 #include <assert.h>
-#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "tegradrm/opentegra_lib.h"
 
 #include "host1x.h"
+#include "tegra_capture.h"
 #include "tegra_fence.h"
 
 #define TEGRA_STREAM_ERR_MSG(fmt, args...)                              \
@@ -61,15 +62,22 @@ struct tegra_reloc {
     bool explicit_fencing;
 };
 
+struct tgr3d_shadow;
+
 struct tegra_stream {
     enum tegra_stream_status status;
     struct tegra_fence *last_fence[TEGRA_ENGINES_NUM];
     bool op_done_synced;
     uint64_t fence_seqno;
     uint32_t **buf_ptr;
+    uint32_t *buf_end;
     uint32_t class_id;
     uint32_t num_pushed_words;
     bool tegra114;
+    bool batch_2d;
+
+    /* GR3D registers state of the current job, managed by gr3d.c */
+    struct tgr3d_shadow *gr3d_shadow;
 
     void (*destroy)(struct tegra_stream *stream);
     int (*begin)(struct tegra_stream *stream,
@@ -87,12 +95,14 @@ struct tegra_stream {
                       bool write,
                       bool explicit_fencing);
     int (*push_words)(struct tegra_stream *stream, const void *addr,
-                      unsigned words, int num_relocs, va_list args);
+                      unsigned words, const struct tegra_reloc *relocs,
+                      unsigned num_relocs);
     int (*prep)(struct tegra_stream *stream, uint32_t words);
     int (*sync)(struct tegra_stream *stream,
                 enum drm_tegra_syncpt_cond cond,
                 bool keep_class);
     struct tegra_fence * (*current_fence)(struct tegra_stream *stream);
+    int (*flush_queue)(struct tegra_stream *stream);
 };
 
 /* Stream operations */
@@ -128,6 +138,8 @@ success:
     if (drm_tegra_get_soc_id(drm) == DRM_TEGRA114_SOC)
         (*pstream)->tegra114 = true;
 
+    tegra_capture_init(drm);
+
     return 0;
 }
 
@@ -136,6 +148,8 @@ static inline void tegra_stream_destroy(struct tegra_stream *stream)
     if (!stream)
         return;
 
+    free(stream->gr3d_shadow);
+
     return stream->destroy(stream);
 }
 
@@ -150,6 +164,31 @@ static inline int tegra_stream_begin(struct tegra_stream *stream,
     return stream->begin(stream, channel);
 }
 
+/*
+ * Running estimate of the job size for a particular kind of work. Growing
+ * stream's buffer word-by-word in the middle of a big job causes multiple
+ * reallocations, the predicted size is reserved once when job begins.
+ */
+#define TEGRA_STREAM_PREDICT_MAX_WORDS  (64 * 1024)
+
+struct tegra_stream_size_predictor {
+    uint32_t words;
+};
+
+/* follows a bigger job immediately and decays slowly afterwards */
+static inline void
+tegra_stream_predictor_update(struct tegra_stream_size_predictor *predictor,
+                              uint32_t words)
+{
+    if (words > TEGRA_STREAM_PREDICT_MAX_WORDS)
+        words = TEGRA_STREAM_PREDICT_MAX_WORDS;
+
+    if (words > predictor->words)
+        predictor->words = words;
+    else
+        predictor->words -= (predictor->words - words) / 8;
+}
+
 static inline int tegra_stream_end(struct tegra_stream *stream)
 {
     int ret;
@@ -162,6 +201,7 @@ static inline int tegra_stream_end(struct tegra_stream *stream)
     ret = stream->end(stream);
     stream->num_pushed_words = 0;
     stream->buf_ptr = NULL;
+    stream->buf_end = NULL;
 
     return ret;
 }
@@ -176,6 +216,7 @@ static inline int tegra_stream_cleanup(struct tegra_stream *stream)
     ret = stream->cleanup(stream);
     stream->num_pushed_words = 0;
     stream->buf_ptr = NULL;
+    stream->buf_end = NULL;
 
     return ret;
 }
@@ -189,6 +230,18 @@ static inline int tegra_stream_flush(struct tegra_stream *stream,
     return stream->flush(stream, explicit_fence);
 }
 
+/*
+ * Submits jobs that were batched by tegra_stream_submit(), batching of 2D
+ * jobs is enabled by the batch_2d flag and is supported only by stream v2.
+ */
+static inline int tegra_stream_flush_queue(struct tegra_stream *stream)
+{
+    if (!stream || !stream->flush_queue)
+        return 0;
+
+    return stream->flush_queue(stream);
+}
+
 static inline struct tegra_fence *
 tegra_stream_get_last_fence(struct tegra_stream *stream,
                             enum host1x_engine engine)
@@ -268,10 +321,9 @@ tegra_stream_push_reloc(struct tegra_stream *stream,
 static inline int tegra_stream_push_words(struct tegra_stream *stream,
                                           const void *addr,
                                           unsigned words,
-                                          int num_relocs,
-                                          ...)
+                                          const struct tegra_reloc *relocs,
+                                          unsigned num_relocs)
 {
-    va_list args;
     int ret;
 
     if (!(stream && stream->status == TEGRADRM_STREAM_CONSTRUCT)) {
@@ -279,19 +331,23 @@ static inline int tegra_stream_push_words(struct tegra_stream *stream,
         return -1;
     }
 
-    va_start(args, num_relocs);
-    ret = stream->push_words(stream, addr, words, num_relocs, args);
-    va_end(args);
-
+    ret = stream->push_words(stream, addr, words, relocs, num_relocs);
     stream->num_pushed_words += words;
 
     return ret;
 }
 
-#define TEGRA_STREAM_PUSH_WORDS(STREAM, CMD_ARRAY, NUM_RELOCS, args...)     \
+#define TEGRA_STREAM_PUSH_WORDS(STREAM, CMD_ARRAY, RELOCS, NUM_RELOCS)      \
     tegra_stream_push_words(STREAM, CMD_ARRAY,                              \
                             sizeof(CMD_ARRAY) / sizeof(*(CMD_ARRAY)),       \
-                            NUM_RELOCS, ##args);
+                            RELOCS, NUM_RELOCS);
+
+static inline bool
+tegra_stream_has_space(struct tegra_stream *stream, uint32_t words)
+{
+    /* buf_end is published by backends that expose their words buffer */
+    return stream->buf_end && *stream->buf_ptr + words <= stream->buf_end;
+}
 
 static inline int
 tegra_stream_prep(struct tegra_stream *stream, uint32_t words)
@@ -301,9 +357,29 @@ tegra_stream_prep(struct tegra_stream *stream, uint32_t words)
         return -1;
     }
 
+    if (tegra_stream_has_space(stream, words))
+        return 0;
+
     return stream->prep(stream, words);
 }
 
+static inline int
+tegra_stream_begin_predicted(struct tegra_stream *stream,
+                             struct drm_tegra_channel *channel,
+                             const struct tegra_stream_size_predictor *predictor)
+{
+    int ret;
+
+    ret = tegra_stream_begin(stream, channel);
+    if (ret)
+        return ret;
+
+    if (!predictor->words)
+        return 0;
+
+    return tegra_stream_prep(stream, predictor->words);
+}
+
 static inline int tegra_stream_sync(struct tegra_stream *stream,
                                     enum drm_tegra_syncpt_cond cond,
                                     bool keep_class)
@@ -358,6 +434,42 @@ tegra_stream_push_setclass(struct tegra_stream *stream, unsigned class_id)
     return result;
 }
 
+/*
+ * Unchecked emission fast path. tegra_stream_reserve() ensures that the given
+ * number of words fits into the stream buffer and returns pointer to the
+ * first free word, words are written using TEGRA_STREAM_EMIT() and then
+ * tegra_stream_commit() is invoked with the advanced pointer. Nothing else
+ * may be pushed to the stream in between, relocations included, since they
+ * could reallocate the buffer.
+ */
+static inline uint32_t *
+tegra_stream_reserve(struct tegra_stream *stream, uint32_t words)
+{
+    if (tegra_stream_prep(stream, words))
+        return NULL;
+
+    return *stream->buf_ptr;
+}
+
+static inline void
+tegra_stream_commit(struct tegra_stream *stream, uint32_t *ptr)
+{
+    stream->num_pushed_words += ptr - *stream->buf_ptr;
+    stream->op_done_synced = false;
+    *stream->buf_ptr = ptr;
+}
+
+#define TEGRA_STREAM_EMIT(PTR, WORD)                        \
+({                                                          \
+    *(PTR)++ = (WORD);                                      \
+})
+
+#define TEGRA_STREAM_EMITF(PTR, F)                          \
+({                                                          \
+    union { uint32_t u; float f; } __value = { .f = (F) };  \
+    *(PTR)++ = __value.u;                                   \
+})
+
 static inline struct tegra_reloc
 tegra_reloc(struct drm_tegra_bo *bo,
             uint32_t offset, uint32_t var_offset,
@@ -277,7 +277,7 @@ static bool tegra_stream_free_fence_v1(struct tegra_fence *base_fence)
         drm_tegra_fence_free(f->fence);
         drm_tegra_job_free(f->job);
         xorg_list_del(&f->entry);
-        free(f);
+        tegra_fence_release(f, sizeof(*f));
 
         return true;
     }
@@ -306,7 +306,7 @@ static struct tegra_fence *
 tegra_stream_create_fence_v1(struct tegra_stream_v1 *stream,
                              struct drm_tegra_fence *fence, bool gr2d)
 {
-    struct tegra_fence_v1 *f = calloc(1, sizeof(*f));
+    struct tegra_fence_v1 *f = tegra_fence_alloc(sizeof(*f));
 
     if (!f)
         return NULL;
@@ -409,11 +409,13 @@ ready:
 
 static int
 tegra_stream_push_words_v1(struct tegra_stream *base_stream, const void *addr,
-                           unsigned words, int num_relocs, va_list ap)
+                           unsigned words, const struct tegra_reloc *relocs,
+                           unsigned num_relocs)
 {
     struct tegra_stream_v1 *stream = to_stream_v1(base_stream);
     struct tegra_reloc reloc_arg;
     uint32_t *pushbuf_ptr;
+    unsigned int i;
     int ret;
 
     ret = drm_tegra_pushbuf_prepare(stream->buffer.pushbuf, words);
@@ -437,8 +439,8 @@ tegra_stream_push_words_v1(struct tegra_stream *base_stream, const void *addr,
     memcpy(pushbuf_ptr, addr, words * sizeof(uint32_t));
 
     /* copy relocs */
-    for (; num_relocs; num_relocs--) {
-        reloc_arg = va_arg(ap, struct tegra_reloc);
+    for (i = 0; i < num_relocs; i++) {
+        reloc_arg = relocs[i];
 
         stream->buffer.pushbuf->ptr  = pushbuf_ptr;
         stream->buffer.pushbuf->ptr += reloc_arg.var_offset;
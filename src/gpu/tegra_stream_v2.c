@@ -32,16 +32,25 @@
     xf86DrvMsg(-1, X_INFO, "%s:%d/%s(): " fmt, \
                __FILE__, __LINE__, __func__, ##args)
 
+#define TEGRA_STREAM_V2_MAX_RELOCS      64
+
+#define TEGRA_SUBMIT_QUEUE_MAX_JOBS     32
+#define TEGRA_SUBMIT_QUEUE_MAX_WORDS    16384
+
 struct tegra_fence_v2 {
     struct tegra_fence base;
     uint32_t syncobj_handle;
     int drm_fd;
+
+    /* queue holding the job of the fence, NULL once job is submitted */
+    struct tegra_submit_queue_v2 *queue;
 };
 
 struct tegra_stream_v2 {
     struct tegra_stream base;
     struct drm_tegra *drm;
     struct drm_tegra_job_v2 *job;
+    struct tegra_submit_queue_v2 *queue;
 
     /*
      * job_fence is created by tegra_stream_get_current_fence_v2() that
@@ -49,8 +58,40 @@ struct tegra_stream_v2 {
      * an intermediate job fence, it becomes the job's.
      */
     struct tegra_fence *job_fence;
+
+    /*
+     * Cmdstream offsets of the job's relocations, needed for re-indexing
+     * of the BO table when job is merged into the submission queue.
+     */
+    uint32_t relocs[TEGRA_STREAM_V2_MAX_RELOCS];
+    unsigned int num_relocs;
+    bool relocs_overflow;
+
+    struct tegra_capture capture;
+};
+
+/*
+ * Submission queue accumulates consecutive 2D jobs of all streams of a DRM
+ * device and submits them to kernel as a single job, all the queued jobs
+ * share the out-fence. Queue is flushed before submission of any other job
+ * of the device, hence the submission order is retained, whenever queued
+ * fence is awaited and when the last stream of the device is destroyed.
+ *
+ * Queued jobs refer to BOs by bare GEM handles, BO shall stay alive until
+ * the fence of the job is awaited, which is the rule for all jobs anyway.
+ */
+struct tegra_submit_queue_v2 {
+    struct tegra_submit_queue_v2 *next;
+    struct drm_tegra *drm;
+    struct drm_tegra_job_v2 *job;
+    struct tegra_fence *fence;
+    struct tegra_fence *explicit_fence;
+    unsigned int num_jobs;
+    unsigned int num_streams;
 };
 
+static struct tegra_submit_queue_v2 *submit_queues;
+
 static __maybe_unused uint64_t gettime_ns(void)
 {
     struct timespec current;
@@ -71,17 +112,255 @@ static inline struct tegra_fence_v2 *to_fence_v2(struct tegra_fence *base)
     return TEGRA_CONTAINER_OF(base, struct tegra_fence_v2, base);
 }
 
+static void tegra_stream_wait_submitted_v2(struct drm_tegra *drm,
+                                           uint32_t syncobj_handle)
+{
+#ifdef HAVE_LIBDRM_SYNCOBJ_SUPPORT
+    int ret;
+
+    /*
+     * Since GRATE-kernel v6, the fence is attached to job's syncobject
+     * at submission time and not at the job's execution-start time.
+     */
+    if (!syncobj_handle || drm_tegra_version(drm) >= GRATE_KERNEL_DRM_VERSION + 6)
+        return;
+
+    ret = drmSyncobjWait(drm_tegra_fd(drm), &syncobj_handle, 1,
+                         gettime_ns() + 1000000000,
+                         DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT,
+                         NULL);
+    if (ret)
+        ErrorMsg("drmSyncobjWait(WAIT_FOR_SUBMIT) failed %d\n", ret);
+#endif
+}
+
+static int tegra_submit_queue_flush_v2(struct tegra_submit_queue_v2 *queue)
+{
+    uint32_t syncobj_handle_in = 0;
+    struct tegra_fence_v2 *f;
+    int ret;
+
+    if (!queue->num_jobs)
+        return 0;
+
+    f = to_fence_v2(queue->fence);
+    f->queue = NULL;
+
+    if (queue->explicit_fence)
+        syncobj_handle_in = to_fence_v2(queue->explicit_fence)->syncobj_handle;
+
+    tegra_stream_wait_submitted_v2(queue->job->drm, syncobj_handle_in);
+
+    ret = drm_tegra_job_submit_v2(queue->job,
+                                  syncobj_handle_in,
+                                  f->syncobj_handle,
+                                  ~0ull);
+    if (ret) {
+        ErrorMsg("drm_tegra_job_submit_v2() failed %d\n", ret);
+        TEGRA_FENCE_MARK_COMPLETED(queue->fence);
+    }
+
+    TEGRA_FENCE_PUT(queue->explicit_fence);
+    TEGRA_FENCE_PUT(queue->fence);
+
+    drm_tegra_job_reset_v2(queue->job);
+    queue->explicit_fence = NULL;
+    queue->fence = NULL;
+    queue->num_jobs = 0;
+
+    return ret ? -1 : 0;
+}
+
+static struct tegra_submit_queue_v2 *
+tegra_submit_queue_get_v2(struct drm_tegra *drm)
+{
+    struct tegra_submit_queue_v2 *queue;
+
+    for (queue = submit_queues; queue; queue = queue->next) {
+        if (queue->drm == drm)
+            break;
+    }
+
+    if (!queue) {
+        queue = calloc(1, sizeof(*queue));
+        if (!queue)
+            return NULL;
+
+        queue->drm = drm;
+        queue->next = submit_queues;
+        submit_queues = queue;
+    }
+
+    queue->num_streams++;
+
+    return queue;
+}
+
+static void tegra_submit_queue_put_v2(struct tegra_submit_queue_v2 *queue)
+{
+    struct tegra_submit_queue_v2 **pqueue;
+
+    tegra_submit_queue_flush_v2(queue);
+
+    if (--queue->num_streams)
+        return;
+
+    for (pqueue = &submit_queues; *pqueue != queue; pqueue = &(*pqueue)->next)
+        ;
+
+    *pqueue = queue->next;
+
+    drm_tegra_job_free_v2(queue->job);
+    free(queue);
+}
+
+static int tegra_submit_queue_bo_index_v2(struct drm_tegra_job_v2 *job,
+                                          struct drm_tegra_bo_table_entry *bo)
+{
+    unsigned int i;
+
+    for (i = 0; i < job->num_bos; i++) {
+        if (job->bo_table[i].handle == bo->handle) {
+            job->bo_table[i].flags |= bo->flags & DRM_TEGRA_BO_TABLE_WRITE;
+
+            if (!(bo->flags & DRM_TEGRA_BO_TABLE_EXPLICIT_FENCE))
+                job->bo_table[i].flags &= ~DRM_TEGRA_BO_TABLE_EXPLICIT_FENCE;
+
+            return i;
+        }
+    }
+
+    job->bo_table[i] = *bo;
+    job->num_bos++;
+
+    return i;
+}
+
+static struct tegra_fence *
+tegra_submit_queue_append_v2(struct tegra_stream_v2 *stream,
+                             struct tegra_fence *explicit_fence)
+{
+    uint8_t bo_index[DRM_TEGRA_BO_TABLE_MAX_ENTRIES_NUM];
+    struct tegra_submit_queue_v2 *queue = stream->queue;
+    struct drm_tegra_job_v2 *job = stream->job;
+    struct drm_tegra_cmdstream_reloc reloc;
+    unsigned int num_words, i;
+    uint32_t *ptr;
+    int ret;
+
+    num_words = job->ptr - job->start;
+
+    if (num_words > TEGRA_SUBMIT_QUEUE_MAX_WORDS ||
+        job->num_bos > DRM_TEGRA_BO_TABLE_MAX_ENTRIES_NUM)
+        return NULL;
+
+    if (!queue->job) {
+        ret = drm_tegra_job_new_v2(&queue->job, stream->drm,
+                                   DRM_TEGRA_BO_TABLE_MAX_ENTRIES_NUM,
+                                   TEGRA_SUBMIT_QUEUE_MAX_WORDS);
+        if (ret) {
+            ErrorMsg("drm_tegra_job_new_v2() failed %d\n", ret);
+            return NULL;
+        }
+    }
+
+    /* jobs are serialized within the queue, no need to await own fence */
+    if (explicit_fence == queue->fence)
+        explicit_fence = NULL;
+
+    /* all queued jobs share the single in-fence */
+    if (explicit_fence && queue->explicit_fence &&
+        explicit_fence != queue->explicit_fence)
+        tegra_submit_queue_flush_v2(queue);
+
+    if (queue->job->ptr + num_words >
+            queue->job->start + queue->job->num_words ||
+        queue->job->num_bos + job->num_bos > DRM_TEGRA_BO_TABLE_MAX_ENTRIES_NUM)
+        tegra_submit_queue_flush_v2(queue);
+
+    if (!queue->fence) {
+        queue->fence = tegra_stream_create_fence_v2(stream, true);
+        if (!queue->fence)
+            return NULL;
+
+        queue->fence->seqno = stream->base.fence_seqno++;
+        to_fence_v2(queue->fence)->queue = queue;
+        TEGRA_FENCE_SET_ACTIVE(queue->fence);
+    }
+
+    if (explicit_fence && !queue->explicit_fence) {
+        assert(explicit_fence->active);
+        queue->explicit_fence = TEGRA_FENCE_GET(explicit_fence, NULL);
+    }
+
+    for (i = 0; i < job->num_bos; i++)
+        bo_index[i] = tegra_submit_queue_bo_index_v2(queue->job,
+                                                     &job->bo_table[i]);
+
+    ptr = queue->job->ptr;
+    memcpy(ptr, job->start, num_words * sizeof(uint32_t));
+
+    for (i = 0; i < stream->num_relocs; i++) {
+        reloc.u_data = ptr[stream->relocs[i]];
+        reloc.bo_index = bo_index[reloc.bo_index];
+        ptr[stream->relocs[i]] = reloc.u_data;
+    }
+
+    queue->job->ptr += num_words;
+    queue->num_jobs++;
+
+    return queue->fence;
+}
+
+static int tegra_stream_flush_queue_v2(struct tegra_stream *base_stream)
+{
+    return tegra_submit_queue_flush_v2(to_stream_v2(base_stream)->queue);
+}
+
+static void tegra_stream_reset_relocs_v2(struct tegra_stream_v2 *stream)
+{
+    stream->num_relocs = 0;
+    stream->relocs_overflow = false;
+    tegra_capture_reset(&stream->capture);
+}
+
+static void tegra_stream_capture_job_v2(struct tegra_stream_v2 *stream,
+                                        enum host1x_engine engine,
+                                        struct tegra_fence *explicit_fence,
+                                        struct tegra_fence *fence)
+{
+    if (tegra_capture_enabled())
+        tegra_capture_job(&stream->capture, engine, 2,
+                          stream->job->start,
+                          stream->job->ptr - stream->job->start,
+                          explicit_fence, fence);
+}
+
+static void tegra_stream_record_reloc_v2(struct tegra_stream_v2 *stream)
+{
+    if (stream->num_relocs == TEGRA_STREAM_V2_MAX_RELOCS) {
+        stream->relocs_overflow = true;
+        return;
+    }
+
+    stream->relocs[stream->num_relocs++] = stream->job->ptr - stream->job->start;
+}
+
 static void tegra_stream_destroy_v2(struct tegra_stream *base_stream)
 {
     struct tegra_stream_v2 *stream = to_stream_v2(base_stream);
 
+    tegra_submit_queue_flush_v2(stream->queue);
+
     TEGRA_FENCE_WAIT(stream->base.last_fence[TEGRA_2D]);
     TEGRA_FENCE_PUT(stream->base.last_fence[TEGRA_2D]);
 
     TEGRA_FENCE_WAIT(stream->base.last_fence[TEGRA_3D]);
     TEGRA_FENCE_PUT(stream->base.last_fence[TEGRA_3D]);
 
+    tegra_submit_queue_put_v2(stream->queue);
     drm_tegra_job_free_v2(stream->job);
+    tegra_capture_fini(&stream->capture);
     free(stream);
 }
 
@@ -90,6 +369,7 @@ static int tegra_stream_cleanup_v2(struct tegra_stream *base_stream)
     struct tegra_stream_v2 *stream = to_stream_v2(base_stream);
 
     drm_tegra_job_reset_v2(stream->job);
+    tegra_stream_reset_relocs_v2(stream);
     stream->base.status = TEGRADRM_STREAM_FREE;
     TEGRA_FENCE_PUT(stream->job_fence);
     stream->job_fence = NULL;
@@ -105,6 +385,8 @@ static int tegra_stream_flush_v2(struct tegra_stream *base_stream,
     struct tegra_fence *f;
     int ret;
 
+    tegra_submit_queue_flush_v2(stream->queue);
+
     TEGRA_FENCE_WAIT(stream->base.last_fence[TEGRA_2D]);
     TEGRA_FENCE_PUT(stream->base.last_fence[TEGRA_2D]);
     stream->base.last_fence[TEGRA_2D] = NULL;
@@ -153,6 +435,8 @@ static int tegra_stream_flush_v2(struct tegra_stream *base_stream,
                  ret, strerror(ret));
         ret = -1;
     } else {
+        tegra_stream_capture_job_v2(stream, TEGRA_ENGINES_NUM,
+                                    explicit_fence, f);
         TEGRA_FENCE_SET_ACTIVE(f);
         TEGRA_FENCE_WAIT(f);
     }
@@ -173,7 +457,6 @@ tegra_stream_submit_v2(enum host1x_engine engine,
     struct tegra_stream_v2 *stream = to_stream_v2(base_stream);
     uint32_t syncobj_handle_in;
     struct tegra_fence *f;
-    int drm_ver;
     int ret;
 
     f = stream->base.last_fence[engine];
@@ -186,6 +469,25 @@ tegra_stream_submit_v2(enum host1x_engine engine,
     if (stream->base.status != TEGRADRM_STREAM_READY)
         goto cleanup;
 
+    if (engine == TEGRA_2D && stream->base.batch_2d &&
+        !stream->job_fence && !stream->relocs_overflow) {
+        f = tegra_submit_queue_append_v2(stream, explicit_fence);
+        if (f) {
+            tegra_stream_capture_job_v2(stream, engine, explicit_fence, f);
+            TEGRA_FENCE_GET(f, NULL);
+            TEGRA_FENCE_PUT(stream->base.last_fence[engine]);
+            stream->base.last_fence[engine] = f;
+
+            if (stream->queue->num_jobs >= TEGRA_SUBMIT_QUEUE_MAX_JOBS)
+                tegra_submit_queue_flush_v2(stream->queue);
+
+            goto cleanup;
+        }
+    }
+
+    /* queued jobs must be submitted first to retain the execution order */
+    tegra_submit_queue_flush_v2(stream->queue);
+
     if (stream->job_fence) {
         f = stream->job_fence;
         stream->job_fence = NULL;
@@ -207,22 +509,7 @@ tegra_stream_submit_v2(enum host1x_engine engine,
     if (explicit_fence)
         assert(explicit_fence->active);
 
-    drm_ver = drm_tegra_version(stream->drm);
-
-    /*
-     * Since GRATE-kernel v6, the fence is attached to job's syncobject
-     * at submission time and not at the job's execution-start time.
-     */
-    if (syncobj_handle_in && drm_ver < GRATE_KERNEL_DRM_VERSION + 6) {
-#ifdef HAVE_LIBDRM_SYNCOBJ_SUPPORT
-        ret = drmSyncobjWait(drm_tegra_fd(stream->drm), &syncobj_handle_in, 1,
-                             gettime_ns() + 1000000000,
-                             DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT,
-                             NULL);
-        if (ret)
-            ErrorMsg("drmSyncobjWait(WAIT_FOR_SUBMIT) failed %d\n", ret);
-#endif
-    }
+    tegra_stream_wait_submitted_v2(stream->drm, syncobj_handle_in);
 
     ret = drm_tegra_job_submit_v2(stream->job,
                                   syncobj_handle_in,
@@ -236,6 +523,7 @@ tegra_stream_submit_v2(enum host1x_engine engine,
         TEGRA_FENCE_PUT(stream->base.last_fence[engine]);
         stream->base.last_fence[engine] = f = NULL;
     } else {
+        tegra_stream_capture_job_v2(stream, engine, explicit_fence, f);
         TEGRA_FENCE_PUT(stream->base.last_fence[engine]);
         stream->base.last_fence[engine] = f;
         TEGRA_FENCE_SET_ACTIVE(f);
@@ -243,6 +531,7 @@ tegra_stream_submit_v2(enum host1x_engine engine,
 
 cleanup:
     drm_tegra_job_reset_v2(stream->job);
+    tegra_stream_reset_relocs_v2(stream);
     stream->base.status = TEGRADRM_STREAM_FREE;
 
     return f;
@@ -270,6 +559,10 @@ static bool tegra_stream_check_fence_v2(struct tegra_fence *base_fence)
     struct tegra_fence_v2 *f = to_fence_v2(base_fence);
     int ret;
 
+    /* queued job can't complete until the queue is flushed */
+    if (f->queue)
+        return false;
+
     if (!f->syncobj_handle)
         return true;
 
@@ -293,6 +586,9 @@ static bool tegra_stream_wait_fence_v2(struct tegra_fence *base_fence)
     struct tegra_fence_v2 *f = to_fence_v2(base_fence);
     int ret;
 
+    if (f->queue)
+        tegra_submit_queue_flush_v2(f->queue);
+
     if (!f->syncobj_handle)
         return true;
 
@@ -318,6 +614,8 @@ static bool tegra_stream_free_fence_v2(struct tegra_fence *base_fence)
 #ifdef HAVE_LIBDRM_SYNCOBJ_SUPPORT
     struct tegra_fence_v2 *f = to_fence_v2(base_fence);
 
+    assert(!f->queue);
+
 #ifdef FENCE_DEBUG
     DRMLISTDEL(&f->base.dbg_entry);
     tegra_fences_destroyed++;
@@ -325,7 +623,7 @@ static bool tegra_stream_free_fence_v2(struct tegra_fence *base_fence)
 
     if (f->syncobj_handle)
         drmSyncobjDestroy(f->drm_fd, f->syncobj_handle);
-    free(f);
+    tegra_fence_release(f, sizeof(*f));
 #endif
     return true;
 }
@@ -336,6 +634,9 @@ tegra_stream_mark_fence_completed_v2(struct tegra_fence *base_fence)
 #ifdef HAVE_LIBDRM_SYNCOBJ_SUPPORT
     struct tegra_fence_v2 *f = to_fence_v2(base_fence);
 
+    if (f->queue)
+        tegra_submit_queue_flush_v2(f->queue);
+
     if (f->syncobj_handle) {
         drmSyncobjDestroy(f->drm_fd, f->syncobj_handle);
         f->syncobj_handle = 0;
@@ -346,17 +647,39 @@ tegra_stream_mark_fence_completed_v2(struct tegra_fence *base_fence)
     return true;
 }
 
+static int tegra_stream_export_fence_v2(struct tegra_fence *base_fence)
+{
+#ifdef HAVE_LIBDRM_SYNCOBJ_SUPPORT
+    struct tegra_fence_v2 *f = to_fence_v2(base_fence);
+    int fd;
+
+    /* syncobj has no fence attached until job is submitted */
+    if (f->queue)
+        tegra_submit_queue_flush_v2(f->queue);
+
+    if (!f->syncobj_handle)
+        return -1;
+
+    if (drmSyncobjExportSyncFile(f->drm_fd, f->syncobj_handle, &fd))
+        return -1;
+
+    return fd;
+#else
+    return -1;
+#endif
+}
+
 static struct tegra_fence *
 tegra_stream_create_fence_v2(struct tegra_stream_v2 *stream, bool gr2d)
 {
-    struct tegra_fence_v2 *f = calloc(1, sizeof(*f));
+    struct tegra_fence_v2 *f = tegra_fence_alloc(sizeof(*f));
     int err;
 
     if (!f)
         return NULL;
     err = tegra_stream_create_syncobj_v2(stream, &f->syncobj_handle);
     if (err) {
-        free(f);
+        tegra_fence_release(f, sizeof(*f));
         return NULL;
     }
 
@@ -365,6 +688,7 @@ tegra_stream_create_fence_v2(struct tegra_stream_v2 *stream, bool gr2d)
     f->base.wait_fence = tegra_stream_wait_fence_v2;
     f->base.free_fence = tegra_stream_free_fence_v2;
     f->base.mark_completed = tegra_stream_mark_fence_completed_v2;
+    f->base.export_fd = tegra_stream_export_fence_v2;
     f->base.gr2d = gr2d;
 
 #ifdef FENCE_DEBUG
@@ -379,6 +703,12 @@ tegra_stream_create_fence_v2(struct tegra_stream_v2 *stream, bool gr2d)
     return &f->base;
 }
 
+static void tegra_stream_update_buf_end_v2(struct tegra_stream_v2 *stream)
+{
+    /* job words may be reallocated by resizing, the window has to follow */
+    stream->base.buf_end = stream->job->start + stream->job->num_words;
+}
+
 static int tegra_stream_begin_v2(struct tegra_stream *base_stream,
                                  struct drm_tegra_channel *channel)
 {
@@ -388,6 +718,7 @@ static int tegra_stream_begin_v2(struct tegra_stream *base_stream,
     stream->base.status = TEGRADRM_STREAM_CONSTRUCT;
     stream->base.op_done_synced = false;
     stream->base.buf_ptr = &stream->job->ptr;
+    tegra_stream_update_buf_end_v2(stream);
 
     return 0;
 }
@@ -412,6 +743,13 @@ static int tegra_stream_push_reloc_v2(struct tegra_stream *base_stream,
     if (explicit_fencing && drm_ver >= GRATE_KERNEL_DRM_VERSION + 5)
         flags |= DRM_TEGRA_BO_TABLE_EXPLICIT_FENCE;
 
+    tegra_stream_record_reloc_v2(stream);
+
+    if (tegra_capture_enabled())
+        tegra_capture_push_reloc(&stream->capture,
+                                 stream->job->ptr - stream->job->start,
+                                 bo, offset, write_dir, explicit_fencing);
+
     ret = drm_tegra_job_push_reloc_v2(stream->job, bo, offset, flags);
     if (ret) {
         stream->base.status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
@@ -419,6 +757,8 @@ static int tegra_stream_push_reloc_v2(struct tegra_stream *base_stream,
         return -1;
     }
 
+    tegra_stream_update_buf_end_v2(stream);
+
     return 0;
 }
 
@@ -450,6 +790,10 @@ static int tegra_stream_prep_v2(struct tegra_stream *base_stream, uint32_t words
         if (words < 1024)
             words = 1024;
 
+        /* grow geometrically to keep the number of reallocations low */
+        if (words < stream->job->num_words)
+            words = stream->job->num_words;
+
         ret = drm_tegra_job_resize_v2(stream->job,
                                       stream->job->num_words + words,
                                       stream->job->num_bos,
@@ -461,6 +805,7 @@ static int tegra_stream_prep_v2(struct tegra_stream *base_stream, uint32_t words
         }
 
         stream->base.buf_ptr = &stream->job->ptr;
+        tegra_stream_update_buf_end_v2(stream);
     }
 
     return 0;
@@ -468,11 +813,13 @@ static int tegra_stream_prep_v2(struct tegra_stream *base_stream, uint32_t words
 
 static int
 tegra_stream_push_words_v2(struct tegra_stream *base_stream, const void *addr,
-                           unsigned words, int num_relocs, va_list ap)
+                           unsigned words, const struct tegra_reloc *relocs,
+                           unsigned num_relocs)
 {
     struct tegra_stream_v2 *stream = to_stream_v2(base_stream);
     struct tegra_reloc reloc_arg;
     uint32_t *pushbuf_ptr;
+    unsigned int i;
     uint32_t flags;
     int drm_ver;
     int ret;
@@ -495,8 +842,8 @@ tegra_stream_push_words_v2(struct tegra_stream *base_stream, const void *addr,
     memcpy(pushbuf_ptr, addr, words * sizeof(uint32_t));
 
     /* copy relocs */
-    for (; num_relocs; num_relocs--) {
-        reloc_arg = va_arg(ap, struct tegra_reloc);
+    for (i = 0; i < num_relocs; i++) {
+        reloc_arg = relocs[i];
 
         stream->job->ptr  = pushbuf_ptr;
         stream->job->ptr += reloc_arg.var_offset;
@@ -509,6 +856,15 @@ tegra_stream_push_words_v2(struct tegra_stream *base_stream, const void *addr,
         if (reloc_arg.explicit_fencing && drm_ver >= GRATE_KERNEL_DRM_VERSION + 5)
             flags |= DRM_TEGRA_BO_TABLE_EXPLICIT_FENCE;
 
+        tegra_stream_record_reloc_v2(stream);
+
+        if (tegra_capture_enabled())
+            tegra_capture_push_reloc(&stream->capture,
+                                     stream->job->ptr - stream->job->start,
+                                     reloc_arg.bo, reloc_arg.offset,
+                                     reloc_arg.write,
+                                     reloc_arg.explicit_fencing);
+
         ret = drm_tegra_job_push_reloc_v2(stream->job,
                                           reloc_arg.bo,
                                           reloc_arg.offset,
@@ -521,6 +877,7 @@ tegra_stream_push_words_v2(struct tegra_stream *base_stream, const void *addr,
     }
 
     stream->job->ptr = pushbuf_ptr + words;
+    tegra_stream_update_buf_end_v2(stream);
 
     return ret ? -1 : 0;
 }
@@ -632,6 +989,7 @@ int grate_stream_create_v2(struct tegra_stream **pstream,
     stream->prep = tegra_stream_prep_v2;
     stream->sync = tegra_stream_sync_v2;
     stream->current_fence = tegra_stream_get_current_fence_v2;
+    stream->flush_queue = tegra_stream_flush_queue_v2;
 
     stream_v2->drm = drm;
 
@@ -644,6 +1002,13 @@ int grate_stream_create_v2(struct tegra_stream **pstream,
         return ret;
     }
 
+    stream_v2->queue = tegra_submit_queue_get_v2(drm);
+    if (!stream_v2->queue) {
+        drm_tegra_job_free_v2(stream_v2->job);
+        free(stream_v2);
+        return -1;
+    }
+
     InfoMsg("success\n");
 
     *pstream = stream;
@@ -35,9 +35,23 @@ struct tegra_fence_v3 {
     struct drm_tegra_fence *fence;
 };
 
+/*
+ * Jobs are recycled, their buffers are pre-allocated to fit a typical job
+ * and grow up to the high-water mark, hence constructing a stream doesn't
+ * allocate memory. Gather data is copied by kernel during submission, so
+ * job could be re-used right after the submission.
+ */
+#define TEGRA_STREAM_V3_JOBS_NUM        4
+#define TEGRA_STREAM_V3_JOB_WORDS       (16 * 1024)
+#define TEGRA_STREAM_V3_JOB_BUFFERS     128
+#define TEGRA_STREAM_V3_JOB_CMDS        32
+
 struct tegra_stream_v3 {
     struct tegra_stream base;
     struct drm_tegra_job_v3 *job;
+    struct drm_tegra_job_v3 *jobs[TEGRA_STREAM_V3_JOBS_NUM];
+    unsigned int next_job;
+    struct tegra_capture capture;
 };
 
 static struct tegra_fence *
@@ -57,6 +71,7 @@ static inline struct tegra_fence_v3 *to_fence_v3(struct tegra_fence *base)
 static void tegra_stream_destroy_v3(struct tegra_stream *base_stream)
 {
     struct tegra_stream_v3 *stream = to_stream_v3(base_stream);
+    unsigned int i;
 
     TEGRA_FENCE_WAIT(stream->base.last_fence[TEGRA_2D]);
     TEGRA_FENCE_PUT(stream->base.last_fence[TEGRA_2D]);
@@ -64,15 +79,57 @@ static void tegra_stream_destroy_v3(struct tegra_stream *base_stream)
     TEGRA_FENCE_WAIT(stream->base.last_fence[TEGRA_3D]);
     TEGRA_FENCE_PUT(stream->base.last_fence[TEGRA_3D]);
 
-    drm_tegra_job_free_v3(stream->job);
+    for (i = 0; i < TEGRA_STREAM_V3_JOBS_NUM; i++)
+        drm_tegra_job_free_v3(stream->jobs[i]);
+
+    tegra_capture_fini(&stream->capture);
     free(stream);
 }
 
+static struct drm_tegra_job_v3 *
+tegra_stream_get_job_v3(struct tegra_stream_v3 *stream,
+                        struct drm_tegra_channel *channel)
+{
+    struct drm_tegra_job_v3 **job;
+    unsigned int i;
+    int ret;
+
+    for (i = 0; i < TEGRA_STREAM_V3_JOBS_NUM; i++) {
+        job = &stream->jobs[i];
+
+        if (*job && (*job)->channel == channel) {
+            drm_tegra_job_reset_v3(*job);
+            return *job;
+        }
+    }
+
+    /* replace the oldest job */
+    job = &stream->jobs[stream->next_job];
+    stream->next_job = (stream->next_job + 1) % TEGRA_STREAM_V3_JOBS_NUM;
+
+    if (*job) {
+        drm_tegra_job_free_v3(*job);
+        *job = NULL;
+    }
+
+    ret = drm_tegra_job_new_v3(job, channel,
+                               TEGRA_STREAM_V3_JOB_BUFFERS,
+                               TEGRA_STREAM_V3_JOB_WORDS,
+                               TEGRA_STREAM_V3_JOB_CMDS);
+    if (ret) {
+        ErrorMsg("drm_tegra_job_new_v3() failed %d\n", ret);
+        *job = NULL;
+    }
+
+    return *job;
+}
+
 static int tegra_stream_cleanup_v3(struct tegra_stream *base_stream)
 {
     struct tegra_stream_v3 *stream = to_stream_v3(base_stream);
 
     drm_tegra_job_reset_v3(stream->job);
+    tegra_capture_reset(&stream->capture);
 
     stream->job = NULL;
     stream->base.status = TEGRADRM_STREAM_FREE;
@@ -80,6 +137,18 @@ static int tegra_stream_cleanup_v3(struct tegra_stream *base_stream)
     return 0;
 }
 
+static void tegra_stream_capture_job_v3(struct tegra_stream_v3 *stream,
+                                        enum host1x_engine engine,
+                                        struct tegra_fence *explicit_fence,
+                                        struct tegra_fence *fence)
+{
+    if (tegra_capture_enabled())
+        tegra_capture_job(&stream->capture, engine, 3,
+                          stream->job->start,
+                          stream->job->ptr - stream->job->start,
+                          explicit_fence, fence);
+}
+
 static int tegra_stream_flush_v3(struct tegra_stream *base_stream,
                                  struct tegra_fence *explicit_fence)
 {
@@ -113,6 +182,9 @@ static int tegra_stream_flush_v3(struct tegra_stream *base_stream,
         ErrorMsg("drm_tegra_job_submit_v3() failed to create fence\n");
     }
 
+    tegra_stream_capture_job_v3(stream, TEGRA_ENGINES_NUM,
+                                explicit_fence, NULL);
+
     ret = drm_tegra_fence_wait_timeout(fence, 1000);
     if (ret)
         ErrorMsg("drm_tegra_fence_wait_timeout() failed %d\n", ret);
@@ -159,6 +231,9 @@ tegra_stream_submit_v3(enum host1x_engine engine,
             ErrorMsg("drm_tegra_job_submit_v3() failed to create fence\n");
 
         f = tegra_stream_create_fence_v3(stream, fence, engine == TEGRA_2D);
+
+        tegra_stream_capture_job_v3(stream, engine, explicit_fence, f);
+
         if (f) {
             TEGRA_FENCE_PUT(stream->base.last_fence[engine]);
             TEGRA_FENCE_SET_ACTIVE(f);
@@ -175,7 +250,8 @@ tegra_stream_submit_v3(enum host1x_engine engine,
     }
 
 cleanup:
-    drm_tegra_job_free_v3(stream->job);
+    drm_tegra_job_reset_v3(stream->job);
+    tegra_capture_reset(&stream->capture);
 
     stream->job = NULL;
     stream->base.status = TEGRADRM_STREAM_FREE;
@@ -253,7 +329,7 @@ static bool tegra_stream_free_fence_v3(struct tegra_fence *base_fence)
     tegra_fences_destroyed++;
 #endif
     drm_tegra_fence_free(f->fence);
-    free(f);
+    tegra_fence_release(f, sizeof(*f));
 
     return true;
 }
@@ -273,11 +349,25 @@ tegra_stream_mark_fence_completed_v3(struct tegra_fence *base_fence)
     return true;
 }
 
+static int tegra_stream_export_fence_v3(struct tegra_fence *base_fence)
+{
+    struct tegra_fence_v3 *f = to_fence_v3(base_fence);
+    int fd;
+
+    if (!f->fence)
+        return -1;
+
+    if (drm_tegra_fence_export_sync_file(f->fence, &fd))
+        return -1;
+
+    return fd;
+}
+
 static struct tegra_fence *
 tegra_stream_create_fence_v3(struct tegra_stream_v3 *stream,
                              struct drm_tegra_fence *fence, bool gr2d)
 {
-    struct tegra_fence_v3 *f = calloc(1, sizeof(*f));
+    struct tegra_fence_v3 *f = tegra_fence_alloc(sizeof(*f));
 
     if (!f)
         return NULL;
@@ -287,6 +377,7 @@ tegra_stream_create_fence_v3(struct tegra_stream_v3 *stream,
     f->base.wait_fence = tegra_stream_wait_fence_v3;
     f->base.free_fence = tegra_stream_free_fence_v3;
     f->base.mark_completed = tegra_stream_mark_fence_completed_v3;
+    f->base.export_fd = tegra_stream_export_fence_v3;
     f->base.gr2d = gr2d;
 
 #ifdef FENCE_DEBUG
@@ -301,24 +392,28 @@ tegra_stream_create_fence_v3(struct tegra_stream_v3 *stream,
     return &f->base;
 }
 
+static void tegra_stream_update_buf_end_v3(struct tegra_stream_v3 *stream)
+{
+    /* job words may be reallocated by resizing, the window has to follow */
+    stream->base.buf_end = stream->job->start + stream->job->num_words;
+}
+
 static int tegra_stream_begin_v3(struct tegra_stream *base_stream,
                                  struct drm_tegra_channel *channel)
 {
     struct tegra_stream_v3 *stream = to_stream_v3(base_stream);
-    int ret;
 
     if (!stream->job) {
-        ret = drm_tegra_job_new_v3(&stream->job, channel, 0, 0, 0);
-        if (ret) {
-            ErrorMsg("drm_tegra_job_new_v3() failed %d\n", ret);
+        stream->job = tegra_stream_get_job_v3(stream, channel);
+        if (!stream->job)
             return -1;
-        }
     }
 
     stream->base.class_id = 0;
     stream->base.status = TEGRADRM_STREAM_CONSTRUCT;
     stream->base.op_done_synced = false;
     stream->base.buf_ptr = &stream->job->ptr;
+    tegra_stream_update_buf_end_v3(stream);
 
     return 0;
 }
@@ -332,6 +427,11 @@ static int tegra_stream_push_reloc_v3(struct tegra_stream *base_stream,
     struct tegra_stream_v3 *stream = to_stream_v3(base_stream);
     int ret;
 
+    if (tegra_capture_enabled())
+        tegra_capture_push_reloc(&stream->capture,
+                                 stream->job->ptr - stream->job->start,
+                                 bo, offset, write_dir, explicit_fencing);
+
     ret = drm_tegra_job_push_reloc_v3(stream->job, bo, offset, 0);
     if (ret) {
         stream->base.status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
@@ -339,6 +439,8 @@ static int tegra_stream_push_reloc_v3(struct tegra_stream *base_stream,
         return -1;
     }
 
+    tegra_stream_update_buf_end_v3(stream);
+
     return 0;
 }
 
@@ -382,6 +484,10 @@ static int tegra_stream_prep_v3(struct tegra_stream *base_stream,
         if (words < 1024)
             words = 1024;
 
+        /* grow geometrically to keep the number of reallocations low */
+        if (words < stream->job->num_words)
+            words = stream->job->num_words;
+
         ret = drm_tegra_job_resize_v3(stream->job,
                                       stream->job->num_words + words,
                                       stream->job->num_buffers_max,
@@ -394,6 +500,7 @@ static int tegra_stream_prep_v3(struct tegra_stream *base_stream,
         }
 
         stream->base.buf_ptr = &stream->job->ptr;
+        tegra_stream_update_buf_end_v3(stream);
     }
 
     return 0;
@@ -401,11 +508,13 @@ static int tegra_stream_prep_v3(struct tegra_stream *base_stream,
 
 static int
 tegra_stream_push_words_v3(struct tegra_stream *base_stream, const void *addr,
-                           unsigned words, int num_relocs, va_list ap)
+                           unsigned words, const struct tegra_reloc *relocs,
+                           unsigned num_relocs)
 {
     struct tegra_stream_v3 *stream = to_stream_v3(base_stream);
     struct tegra_reloc reloc_arg;
     uint32_t *pushbuf_ptr;
+    unsigned int i;
     int ret;
 
     ret = tegra_stream_prep_v3(base_stream, words);
@@ -426,12 +535,19 @@ tegra_stream_push_words_v3(struct tegra_stream *base_stream, const void *addr,
     memcpy(pushbuf_ptr, addr, words * sizeof(uint32_t));
 
     /* copy relocs */
-    for (; num_relocs; num_relocs--) {
-        reloc_arg = va_arg(ap, struct tegra_reloc);
+    for (i = 0; i < num_relocs; i++) {
+        reloc_arg = relocs[i];
 
         stream->job->ptr  = pushbuf_ptr;
         stream->job->ptr += reloc_arg.var_offset;
 
+        if (tegra_capture_enabled())
+            tegra_capture_push_reloc(&stream->capture,
+                                     stream->job->ptr - stream->job->start,
+                                     reloc_arg.bo, reloc_arg.offset,
+                                     reloc_arg.write,
+                                     reloc_arg.explicit_fencing);
+
         ret = drm_tegra_job_push_reloc_v3(stream->job, reloc_arg.bo,
                                           reloc_arg.offset, 0);
         if (ret) {
@@ -442,6 +558,7 @@ tegra_stream_push_words_v3(struct tegra_stream *base_stream, const void *addr,
     }
 
     stream->job->ptr = pushbuf_ptr + words;
+    tegra_stream_update_buf_end_v3(stream);
 
     return ret ? -1 : 0;
 }
@@ -268,3 +268,49 @@ void tegra_memcpy_vfp_threaded(char *dst, const char *src, int size,
     for (i = 1; i < threads_num; i++)
         pthread_join(threads[i], NULL);
 }
+
+static void tegra_memcpy_vfp_line(char *dst, const char *src, int size,
+                                  tegra_vfp_func copy_func)
+{
+    int vfp_size = size & ~127;
+
+    if (vfp_size && tegra_memcpy_vfp_copy_is_safe(dst, src, vfp_size)) {
+        copy_func(dst, src, vfp_size);
+
+        src += vfp_size;
+        dst += vfp_size;
+        size -= vfp_size;
+    }
+
+    if (size)
+        memcpy(dst, src, size);
+}
+
+void tegra_memcpy_vfp_planes(const struct tegra_vfp_plane *planes,
+                             unsigned int num_planes,
+                             tegra_vfp_func copy_func)
+{
+    const struct tegra_vfp_plane *p;
+    const char *src;
+    unsigned int i;
+    char *dst;
+    int y;
+
+    for (i = 0, p = planes; i < num_planes; i++, p++) {
+        if (!p->dst || !p->src || !p->line_len || !p->height)
+            continue;
+
+        if (p->dst_pitch == p->src_pitch && p->line_len == p->src_pitch) {
+            tegra_memcpy_vfp_line(p->dst, p->src, p->line_len * p->height,
+                                  copy_func);
+            continue;
+        }
+
+        for (y = 0, dst = p->dst, src = p->src; y < p->height; y++) {
+            tegra_memcpy_vfp_line(dst, src, p->line_len, copy_func);
+
+            dst += p->dst_pitch;
+            src += p->src_pitch;
+        }
+    }
+}
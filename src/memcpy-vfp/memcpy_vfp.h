@@ -31,6 +31,15 @@
 
 typedef void (*tegra_vfp_func)(char *dst, const char *src, int size);
 
+struct tegra_vfp_plane {
+    char *dst;
+    const char *src;
+    int dst_pitch;
+    int src_pitch;
+    int line_len;
+    int height;
+};
+
 void tegra_copy_block_vfp(char *dst, const char *src, int size);
 void tegra_copy_block_vfp_2_pass(char *dst, const char *src, int size);
 void tegra_copy_block_vfp_arm(char *dst, const char *src, int size);
@@ -45,6 +54,15 @@ void tegra_memcpy_vfp_unaligned_2_pass(char *dst, const char *src, int size);
 void tegra_memcpy_vfp_threaded(char *dst, const char *src, int size,
                                tegra_vfp_func copy_func);
 
+/*
+ * Copy a set of 2D planes in a single pass, the VFP copy_func is used for
+ * the 128 bytes aligned portions of lines, the rest is copied by memcpy.
+ * Planes with matching pitches are copied as a whole.
+ */
+void tegra_memcpy_vfp_planes(const struct tegra_vfp_plane *planes,
+                             unsigned int num_planes,
+                             tegra_vfp_func copy_func);
+
 /* use this when src is uncacheable */
 static inline void
 tegra_memcpy_vfp_unaligned(char *dst, const char *src, int size)
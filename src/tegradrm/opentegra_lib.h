@@ -61,6 +61,12 @@ static __maybe_unused const char * const drm_tegra_soc_names[] = {
 struct drm_tegra_bo;
 struct drm_tegra;
 
+/*
+ * Pass to drm_tegra_new() to get a Tegra DRM device emulated in userspace,
+ * available only if library is built with HAVE_TEGRA_MOCK.
+ */
+#define DRM_TEGRA_MOCK_FD	-1
+
 int drm_tegra_new(struct drm_tegra **drmp, int fd);
 void drm_tegra_close(struct drm_tegra *drm);
 
@@ -113,6 +119,22 @@ int drm_tegra_bo_cpu_prep(struct drm_tegra_bo *bo,
 
 void drm_tegra_bo_cache_cleanup(struct drm_tegra *drm, time_t time);
 
+struct drm_tegra_bo_size_stat {
+	uint32_t size;
+	uint32_t flags;
+	uint32_t count;
+};
+
+int drm_tegra_bo_cache_get_histogram(struct drm_tegra *drm,
+				     struct drm_tegra_bo_size_stat *stats,
+				     unsigned int max);
+int drm_tegra_bo_cache_prefill(struct drm_tegra *drm, uint32_t flags,
+			       uint32_t size, unsigned int count);
+
+int drm_tegra_bo_reaper_start(struct drm_tegra *drm);
+
+int drm_tegra_mock_set_latency(struct drm_tegra *drm, unsigned int latency_us);
+
 struct drm_tegra_channel;
 struct drm_tegra_job;
 
@@ -158,6 +180,7 @@ int drm_tegra_fence_is_busy(struct drm_tegra_fence *fence);
 int drm_tegra_fence_wait_timeout(struct drm_tegra_fence *fence,
 				 unsigned long timeout);
 void drm_tegra_fence_free(struct drm_tegra_fence *fence);
+int drm_tegra_fence_export_sync_file(struct drm_tegra_fence *fence, int *fd);
 
 static inline int drm_tegra_fence_wait(struct drm_tegra_fence *fence)
 {
@@ -254,5 +277,7 @@ int drm_tegra_fence_is_busy_v3(struct drm_tegra_fence *fence);
 int drm_tegra_fence_wait_timeout_v3(struct drm_tegra_fence *fence,
 				    int timeout);
 void drm_tegra_fence_free_v3(struct drm_tegra_fence *fence);
+int drm_tegra_fence_export_sync_file_v3(struct drm_tegra_fence *fence,
+					int *fd);
 
 #endif /* __DRM_TEGRA_H__ */
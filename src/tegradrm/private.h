@@ -29,7 +29,9 @@
 #include "config.h"
 #endif
 
+#include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -38,6 +40,8 @@
 
 #include <sys/mman.h>
 
+#include <xf86drm.h>
+
 #include "atomic.h"
 #include "lists.h"
 #include "opentegra_lib.h"
@@ -66,7 +70,11 @@
 			"total BOs allocated %d (%dKB, "		\
 						 "%d BOs cached %dKB) "	\
 			"total BOs mapped %d (%d pages, "		\
-					      "%d pages cached of %d BOs)\n", \
+					      "%d pages cached of %d BOs) " \
+			"cache hits %d (%d exact) misses %d evicted %d " \
+					"(budget %uKB) "		\
+			"mmap cache %uKB hits %u misses %u evicted %u "	\
+					"(budget %uKB)\n",		\
 			__func__, __LINE__,				\
 			 drm->debug_bos_allocated,			\
 			 drm->debug_bos_total_size / 1000,		\
@@ -75,7 +83,17 @@
 			 drm->debug_bos_mapped,				\
 			 drm->debug_bos_total_pages,			\
 			 drm->debug_bos_cached_pages,			\
-			 drm->debug_bos_mappings_cached);		\
+			 drm->debug_bos_mappings_cached,		\
+			 drm->debug_bos_cache_hits,			\
+			 drm->debug_bos_cache_exact_hits,		\
+			 drm->debug_bos_cache_misses,			\
+			 drm->debug_bos_cache_evicted,			\
+			 drm->bo_cache.budget / 1000,			\
+			 drm->mmap_cache.mapped_size / 1000,		\
+			 drm->mmap_cache.hits,				\
+			 drm->mmap_cache.misses,			\
+			 drm->mmap_cache.evicted,			\
+			 drm->mmap_cache.budget / 1000);		\
 } while (0)
 
 #define VDBG_BO(BO, FMT, args...) do {					\
@@ -131,37 +149,113 @@ struct drm_tegra_fence {
 	struct drm_tegra *drm;
 	unsigned int version;
 
-	union {
-		/* v1 */
-		struct {
-			uint32_t syncpt;
-			uint32_t value;
-		};
-
-		/* v3 */
-		struct {
-			uint32_t syncobj;
-		};
-	};
+	/* syncpoint threshold, always known for v1 */
+	uint32_t syncpt;
+	uint32_t value;
+	bool syncpt_valid;
+
+	/* v3 */
+	uint32_t syncobj;
 };
 
 struct drm_tegra_bo_bucket {
 	uint32_t size;
 	drmMMListHead list;
 	uint32_t num_entries;
-	uint32_t num_mmap_entries;
+	uint32_t num_prefilled;	/* not used since cache prefill */
+	uint32_t demand;	/* recent requests, decays over time */
+	uint32_t hits;		/* recent lookups, decay as demand */
+	uint32_t misses;
 	bool sparse;
 };
 
+#define DRM_TEGRA_BO_CACHE_BUDGET	(32 * 1024 * 1024)
+
 struct drm_tegra_bo_cache {
 	struct drm_tegra_bo_bucket cache_bucket[14 * 4 * 2];
 	int num_buckets;
 	time_t time;
+	time_t decay_time;
+
+	drmMMListHead lru;	/* all cached BOs, least recently freed first */
+	uint32_t cached_size;
+	uint32_t budget;
+};
+
+#define DRM_TEGRA_BO_MMAP_CACHE_BUDGET	(64 * 1024 * 1024)
+
+#define DRM_TEGRA_BO_HISTOGRAM_SIZE	64
+
+/* sizes of BOs that were requested from kernel during startup */
+struct drm_tegra_bo_histogram {
+	struct drm_tegra_bo_size_stat entries[DRM_TEGRA_BO_HISTOGRAM_SIZE];
+	unsigned int num_entries;
+	time_t start;
 };
 
 struct drm_tegra_bo_mmap_cache {
-	drmMMListHead list;
+	drmMMListHead list;	/* least recently unmapped first */
 	time_t time;
+
+	uint32_t mapped_size;	/* total size of cached mappings */
+	uint32_t budget;
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evicted;
+};
+
+#define DRM_TEGRA_SYNCPT_CACHE_SIZE	16
+
+/* last known completed value of a syncpoint */
+struct drm_tegra_syncpt_cache {
+	uint32_t id;
+	uint32_t value;
+	bool valid;
+};
+
+#define DRM_TEGRA_BO_TABLE_SHARDS_SHIFT	4
+#define DRM_TEGRA_BO_TABLE_SHARDS	(1 << DRM_TEGRA_BO_TABLE_SHARDS_SHIFT)
+
+struct drm_tegra_bo_table_slot {
+	uint32_t key;
+	struct drm_tegra_bo *bo;
+};
+
+struct drm_tegra_bo_table_shard {
+	pthread_rwlock_t lock;
+	struct drm_tegra_bo_table_slot *entries;
+	uint32_t size;		/* power of two */
+	uint32_t used;		/* live entries and tombstones */
+	uint32_t live;
+};
+
+struct drm_tegra_bo_table {
+	struct drm_tegra_bo_table_shard shards[DRM_TEGRA_BO_TABLE_SHARDS];
+};
+
+#define DRM_TEGRA_BO_REAPER_QUEUE_SIZE	256
+
+struct drm_tegra_bo_reaper_entry {
+	uint32_t handle;
+	void *map;
+	size_t map_size;
+};
+
+#define DRM_TEGRA_BO_REAPER_BATCH_SIZE	16
+
+struct drm_tegra_bo_reaper {
+	struct drm_tegra_bo_reaper_entry queue[DRM_TEGRA_BO_REAPER_QUEUE_SIZE];
+	struct drm_tegra_bo_reaper_entry batch[DRM_TEGRA_BO_REAPER_BATCH_SIZE];
+	unsigned int num_batch;	/* dequeued BOs that are being released */
+	unsigned int head;
+	unsigned int count;
+	bool busy;		/* releasing dequeued BOs */
+	bool stop;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t idle_cond;
+	pthread_t thread;
 };
 
 struct drm_tegra {
@@ -176,14 +270,32 @@ struct drm_tegra {
 	 * returns a new handle.  So we need to figure out if the bo is already
 	 * open in the process first, before calling gem-open.
 	 */
-	void *handle_table, *name_table;
+	struct drm_tegra_bo_table handle_table, name_table;
+
+	/*
+	 * Locking order is import_lock -> cache_lock -> table shard lock.
+	 *
+	 *   import_lock: serializes creation of imported BOs
+	 *   cache_lock: protects BO caches and release of the last reference
+	 *
+	 * syncpt_lock protects the syncpoint cache, nothing else is taken
+	 * under it.
+	 */
+	pthread_mutex_t import_lock;
+	pthread_mutex_t cache_lock;
+	pthread_mutex_t syncpt_lock;
 
 	struct drm_tegra_bo_cache bo_cache;
 	struct drm_tegra_bo_mmap_cache mmap_cache;
+	struct drm_tegra_bo_histogram bo_histogram;
+	struct drm_tegra_syncpt_cache syncpt_cache[DRM_TEGRA_SYNCPT_CACHE_SIZE];
 	time_t drop_caches_time;	/* time when dropped page caches */
 	bool close;
 	int fd;
 
+	struct drm_tegra_mock *mock;	/* set if device is emulated */
+	struct drm_tegra_bo_reaper *reaper;	/* set if BOs are released async */
+
 #ifndef NDEBUG
 	bool debug_bo;
 	bool debug_bo_back_guard;
@@ -196,6 +308,10 @@ struct drm_tegra {
 	int32_t debug_bos_total_pages;
 	int32_t debug_bos_cached_pages;
 	int32_t debug_bos_mappings_cached;
+	int32_t debug_bos_cache_hits;
+	int32_t debug_bos_cache_exact_hits;
+	int32_t debug_bos_cache_misses;
+	int32_t debug_bos_cache_evicted;
 #endif
 };
 
@@ -231,11 +347,16 @@ struct drm_tegra_bo {
 	 * due to protection of the rest of the fields by valgrind.
 	 */
 	drmMMListHead bo_list;	/* bucket-list entry */
+	drmMMListHead lru_list;	/* cache LRU-list entry */
 	time_t free_time;	/* time when added to bucket-list */
+	uint32_t free_size;	/* size of BO in bucket-list */
+	struct drm_tegra_bo_bucket *bucket;
+	bool prefilled;		/* not used since cache prefill */
 
 	drmMMListHead mmap_list;	/* mmap cache-list entry */
 	time_t unmap_time;		/* time when added to cache-list */
 	void *map_cached;		/* holds cached mmap pointer */
+	uint32_t map_cached_size;	/* size of cached mapping */
 
 	bool custom_tiling;
 
@@ -247,14 +368,20 @@ struct drm_tegra_bo {
 #endif
 };
 
+int drm_tegra_bo_create(struct drm_tegra_bo **bop, struct drm_tegra *drm,
+			uint32_t flags, uint32_t size);
 int drm_tegra_bo_free(struct drm_tegra_bo *bo);
+int drm_tegra_bo_destroy(struct drm_tegra *drm, uint32_t handle,
+			 void *map, size_t map_size);
 int __drm_tegra_bo_map(struct drm_tegra_bo *bo, void **ptr);
 
 void drm_tegra_bo_cache_init(struct drm_tegra_bo_cache *cache,
 			     bool coarse, bool sparse);
+void __drm_tegra_bo_cache_cleanup(struct drm_tegra *drm, time_t time);
 struct drm_tegra_bo * drm_tegra_bo_cache_alloc(struct drm_tegra *drm,
 					       uint32_t *size, uint32_t flags);
 int drm_tegra_bo_cache_free(struct drm_tegra_bo *bo);
+void drm_tegra_bo_cache_remove(struct drm_tegra_bo *bo);
 void drm_tegra_bo_cache_unmap(struct drm_tegra_bo *bo);
 void *drm_tegra_bo_cache_map(struct drm_tegra_bo *bo);
 
@@ -264,6 +391,113 @@ drm_tegra_get_bucket(struct drm_tegra *drm, uint32_t size, uint32_t flags);
 void drm_tegra_reset_bo(struct drm_tegra_bo *bo, uint32_t flags,
 			bool set_flags);
 
+int drm_tegra_bo_table_init(struct drm_tegra_bo_table *table);
+void drm_tegra_bo_table_fini(struct drm_tegra_bo_table *table);
+struct drm_tegra_bo_table_shard *
+drm_tegra_bo_table_shard(struct drm_tegra_bo_table *table, uint32_t key);
+struct drm_tegra_bo *
+drm_tegra_bo_table_lookup(struct drm_tegra_bo_table_shard *shard,
+			  uint32_t key);
+int drm_tegra_bo_table_insert(struct drm_tegra_bo_table_shard *shard,
+			      uint32_t key, struct drm_tegra_bo *bo);
+void drm_tegra_bo_table_remove(struct drm_tegra_bo_table_shard *shard,
+			       uint32_t key, struct drm_tegra_bo *bo);
+
+void drm_tegra_bo_reaper_stop(struct drm_tegra *drm);
+bool drm_tegra_bo_reaper_queue(struct drm_tegra *drm, uint32_t handle,
+			       void *map, size_t map_size);
+bool drm_tegra_bo_reaper_flush(struct drm_tegra *drm);
+bool drm_tegra_bo_reaper_flush_handle(struct drm_tegra *drm, uint32_t handle);
+
+/* mock device is built only into the tools and tests, never the driver */
+#ifdef HAVE_TEGRA_MOCK
+int drm_tegra_mock_init(struct drm_tegra *drm);
+void drm_tegra_mock_fini(struct drm_tegra *drm);
+int drm_tegra_mock_command(struct drm_tegra *drm, unsigned long index,
+			   void *data, unsigned long size);
+int drm_tegra_mock_ioctl(struct drm_tegra *drm, unsigned long request,
+			 void *arg);
+void *drm_tegra_mock_mmap(struct drm_tegra *drm, size_t size,
+			  uint64_t offset);
+int drm_tegra_mock_prime_handle_to_fd(struct drm_tegra *drm, uint32_t handle,
+				      int *prime_fd);
+int drm_tegra_mock_prime_fd_to_handle(struct drm_tegra *drm, int prime_fd,
+				      uint32_t *handle);
+#else
+static inline int drm_tegra_mock_init(struct drm_tegra *drm)
+{
+	return -ENOTSUP;
+}
+
+static inline void drm_tegra_mock_fini(struct drm_tegra *drm)
+{
+}
+
+static inline int drm_tegra_mock_command(struct drm_tegra *drm,
+					 unsigned long index,
+					 void *data, unsigned long size)
+{
+	return -ENODEV;
+}
+
+static inline int drm_tegra_mock_ioctl(struct drm_tegra *drm,
+				       unsigned long request, void *arg)
+{
+	errno = ENODEV;
+	return -1;
+}
+
+static inline void *drm_tegra_mock_mmap(struct drm_tegra *drm, size_t size,
+					uint64_t offset)
+{
+	errno = ENODEV;
+	return MAP_FAILED;
+}
+
+static inline int drm_tegra_mock_prime_handle_to_fd(struct drm_tegra *drm,
+						    uint32_t handle,
+						    int *prime_fd)
+{
+	return -ENODEV;
+}
+
+static inline int drm_tegra_mock_prime_fd_to_handle(struct drm_tegra *drm,
+						    int prime_fd,
+						    uint32_t *handle)
+{
+	return -ENODEV;
+}
+#endif
+
+/* Device access, mock device is served by the userspace emulation */
+static inline int drm_tegra_command(struct drm_tegra *drm, unsigned long index,
+				    void *data, unsigned long size)
+{
+	if (drm->mock)
+		return drm_tegra_mock_command(drm, index, data, size);
+
+	return drmCommandWriteRead(drm->fd, index, data, size);
+}
+
+static inline int drm_tegra_ioctl(struct drm_tegra *drm,
+				  unsigned long request, void *arg)
+{
+	if (drm->mock)
+		return drm_tegra_mock_ioctl(drm, request, arg);
+
+	return drmIoctl(drm->fd, request, arg);
+}
+
+static inline void *drm_tegra_mmap(struct drm_tegra *drm, size_t size,
+				   uint64_t offset)
+{
+	if (drm->mock)
+		return drm_tegra_mock_mmap(drm, size, offset);
+
+	return mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    drm->fd, offset);
+}
+
 #if HAVE_VALGRIND
 #  include <memcheck.h>
 
@@ -36,38 +36,113 @@
 
 #include "private.h"
 
-static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+/* takes BO reference unless BO is unreferenced */
+static bool bo_get_unless_zero(struct drm_tegra_bo *bo)
+{
+	int ref = atomic_read(&bo->ref);
+	int old;
+
+	while (ref) {
+		old = atomic_cmpxchg(&bo->ref, ref, ref + 1);
+		if (old == ref)
+			return true;
+
+		ref = old;
+	}
+
+	return false;
+}
+
+/* drops BO reference unless it's the last one */
+static bool bo_put_unless_one(struct drm_tegra_bo *bo)
+{
+	int ref = atomic_read(&bo->ref);
+	int old;
+
+	while (ref > 1) {
+		old = atomic_cmpxchg(&bo->ref, ref, ref - 1);
+		if (old == ref)
+			return true;
+
+		ref = old;
+	}
+
+	return false;
+}
 
-/* lookup a buffer, call with table_lock mutex locked */
-static struct drm_tegra_bo * lookup_bo(void *table, uint32_t key)
+/*
+ * Lookup a buffer. BO that is in use is looked up under the read lock of
+ * the table shard only. BO that is unreferenced sits in the BO cache, it
+ * is taken out of the cache under cache_lock.
+ */
+static struct drm_tegra_bo * lookup_bo(struct drm_tegra *drm,
+				       struct drm_tegra_bo_table *table,
+				       uint32_t key)
 {
-	struct drm_tegra_bo_bucket *bucket;
+	struct drm_tegra_bo_table_shard *shard;
 	struct drm_tegra_bo *bo;
-	void *value;
+	bool cached = false;
 
-	if (drmHashLookup(table, key, &value))
-		return NULL;
+	shard = drm_tegra_bo_table_shard(table, key);
+
+	pthread_rwlock_rdlock(&shard->lock);
+	bo = drm_tegra_bo_table_lookup(shard, key);
+	if (bo && !bo_get_unless_zero(bo))
+		cached = true;
+	pthread_rwlock_unlock(&shard->lock);
 
-	bo = value;
+	if (!cached)
+		return bo;
+
+	/*
+	 * The last reference is dropped under cache_lock, hence BO can't
+	 * go away while lock is held.
+	 */
+	pthread_mutex_lock(&drm->cache_lock);
+	pthread_rwlock_rdlock(&shard->lock);
 
-	if (!DRMLISTEMPTY(&bo->bo_list)) {
+	bo = drm_tegra_bo_table_lookup(shard, key);
+	if (bo && !bo_get_unless_zero(bo)) {
 		/* mark BO as available for access under valgrind */
 		drm_tegra_reset_bo(bo, 0, false);
 
-		/* take out BO from the bucket */
-		DRMLISTDELINIT(&bo->bo_list);
-
-		/* update bucket stats */
-		bucket = drm_tegra_get_bucket(bo->drm, bo->size, bo->flags);
-		bucket->num_entries--;
+		/* take out BO from the cache */
+		drm_tegra_bo_cache_remove(bo);
 	}
 
-	/* found, increment reference count */
-	atomic_inc(&bo->ref);
+	pthread_rwlock_unlock(&shard->lock);
+	pthread_mutex_unlock(&drm->cache_lock);
 
 	return bo;
 }
 
+static int insert_bo(struct drm_tegra_bo_table *table, uint32_t key,
+		     struct drm_tegra_bo *bo)
+{
+	struct drm_tegra_bo_table_shard *shard;
+	int err;
+
+	shard = drm_tegra_bo_table_shard(table, key);
+
+	pthread_rwlock_wrlock(&shard->lock);
+	err = drm_tegra_bo_table_insert(shard, key, bo);
+	pthread_rwlock_unlock(&shard->lock);
+
+	return err;
+}
+
+static void remove_bo(struct drm_tegra_bo_table *table, uint32_t key,
+		      struct drm_tegra_bo *bo)
+{
+	struct drm_tegra_bo_table_shard *shard;
+
+	shard = drm_tegra_bo_table_shard(table, key);
+
+	pthread_rwlock_wrlock(&shard->lock);
+	drm_tegra_bo_table_remove(shard, key, bo);
+	pthread_rwlock_unlock(&shard->lock);
+}
+
 static void *drm_tegra_bo_do_mapping(struct drm_tegra_bo *bo,
 				     unsigned int size)
 {
@@ -80,13 +155,12 @@ static void *drm_tegra_bo_do_mapping(struct drm_tegra_bo *bo,
 	memset(&args, 0, sizeof(args));
 	args.handle = bo->handle;
 
-	err = drmCommandWriteRead(drm->fd, DRM_TEGRA_GEM_MMAP,
-				  &args, sizeof(args));
+	err = drm_tegra_command(drm, DRM_TEGRA_GEM_MMAP,
+				&args, sizeof(args));
 	if (err < 0 || !args.offset)
 		goto legacy_args_3_19;
 
-	map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED,
-		   drm->fd, args.offset);
+	map = drm_tegra_mmap(drm, size, args.offset);
 
 	if (map == MAP_FAILED) {
 		VDBG_BO(bo, "failed to map offset 0x%llX err %d (%s)\n",
@@ -102,8 +176,8 @@ legacy_args_3_19:
 	memset(&args_3_19, 0, sizeof(args_3_19));
 	args_3_19.handle = bo->handle;
 
-	err = drmCommandWriteRead(drm->fd, DRM_TEGRA_GEM_MMAP,
-				  &args_3_19, sizeof(args_3_19));
+	err = drm_tegra_command(drm, DRM_TEGRA_GEM_MMAP,
+				&args_3_19, sizeof(args_3_19));
 	if (err < 0) {
 		VDBG_BO(bo, "failed get mapping offset err %d (%s)\n",
 			err, strerror(-err));
@@ -111,8 +185,7 @@ legacy_args_3_19:
 		return MAP_FAILED;
 	}
 
-	map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED,
-		   drm->fd, args_3_19.offset);
+	map = drm_tegra_mmap(drm, size, args_3_19.offset);
 
 	if (map == MAP_FAILED) {
 		VDBG_BO(bo, "failed to map offset 0x%X err %d (%s)\n",
@@ -255,8 +328,8 @@ static int drm_tegra_bo_mapping_unref_v3(struct drm_tegra *drm,
 	unmap_args.context = mapping->channel_ctx;
 	unmap_args.mapping = mapping->id;
 
-	err = drmCommandWriteRead(drm->fd, DRM_TEGRA_CHANNEL_UNMAP,
-				  &unmap_args, sizeof(unmap_args));
+	err = drm_tegra_command(drm, DRM_TEGRA_CHANNEL_UNMAP,
+				&unmap_args, sizeof(unmap_args));
 
 	DRMLISTDELINIT(&mapping->ch_list);
 
@@ -265,12 +338,34 @@ static int drm_tegra_bo_mapping_unref_v3(struct drm_tegra *drm,
 	return err;
 }
 
+/* unmaps BO and closes its GEM handle */
+int drm_tegra_bo_destroy(struct drm_tegra *drm, uint32_t handle,
+			 void *map, size_t map_size)
+{
+	struct drm_gem_close args;
+	int err;
+
+	if (map)
+		munmap(map, map_size);
+
+	memset(&args, 0, sizeof(args));
+	args.handle = handle;
+
+	err = drm_tegra_ioctl(drm, DRM_IOCTL_GEM_CLOSE, &args);
+	if (err < 0)
+		err = -errno;
+
+	return err;
+}
+
 int drm_tegra_bo_free(struct drm_tegra_bo *bo)
 {
 	struct drm_tegra *drm = bo->drm;
-	struct drm_gem_close args;
+	uint32_t handle = bo->handle;
+	size_t map_size = bo->offset + bo->size;
 	void *map_cached;
-	int err;
+	void *map = NULL;
+	int err = 0;
 
 	DBG_BO(bo, "\n");
 
@@ -286,13 +381,13 @@ int drm_tegra_bo_free(struct drm_tegra_bo *bo)
 		if (RUNNING_ON_VALGRIND)
 			VG_BO_UNMMAP(bo);
 		else
-			munmap(bo->map, bo->offset + bo->size);
+			map = bo->map;
 
 	} else if (bo->map_cached) {
 		map_cached = drm_tegra_bo_cache_map(bo);
 
 		if (!RUNNING_ON_VALGRIND)
-			munmap(map_cached, bo->offset + bo->size);
+			map = map_cached;
 	} else {
 		goto vg_free;
 	}
@@ -307,7 +402,7 @@ vg_free:
 	VG_BO_FREE(bo);
 
 	if (bo->name)
-		drmHashDelete(drm->name_table, bo->name);
+		remove_bo(&drm->name_table, bo->name, bo);
 
 	while (!DRMLISTEMPTY(&bo->mapping_list_v3)) {
 		struct drm_tegra_bo_mapping_v3 *mapping;
@@ -322,14 +417,10 @@ vg_free:
 				err, strerror(-err), mapping->id, mapping->channel_ctx);
 	}
 
-	drmHashDelete(drm->handle_table, bo->handle);
+	remove_bo(&drm->handle_table, bo->handle, bo);
 
-	memset(&args, 0, sizeof(args));
-	args.handle = bo->handle;
-
-	err = drmIoctl(drm->fd, DRM_IOCTL_GEM_CLOSE, &args);
-	if (err < 0)
-		err = -errno;
+	if (!drm_tegra_bo_reaper_queue(drm, handle, map, map_size))
+		err = drm_tegra_bo_destroy(drm, handle, map, map_size);
 
 #ifndef NDEBUG
 	memset(bo, 0, sizeof(*bo));
@@ -341,6 +432,31 @@ vg_free:
 	return err;
 }
 
+static uint32_t drm_tegra_get_budget(const char *env, uint32_t budget)
+{
+	unsigned long budget_kb;
+	char *str;
+
+	str = getenv(env);
+	if (str) {
+		budget_kb = strtoul(str, NULL, 0);
+		if (budget_kb < UINT32_MAX / 1024)
+			budget = budget_kb * 1024;
+	}
+
+	return budget;
+}
+
+static void drm_tegra_setup_bo_cache_budget(struct drm_tegra *drm)
+{
+	drm->bo_cache.budget =
+		drm_tegra_get_budget("LIBDRM_TEGRA_BO_CACHE_BUDGET_KB",
+				     DRM_TEGRA_BO_CACHE_BUDGET);
+	drm->mmap_cache.budget =
+		drm_tegra_get_budget("LIBDRM_TEGRA_BO_MMAP_CACHE_BUDGET_KB",
+				     DRM_TEGRA_BO_MMAP_CACHE_BUDGET);
+}
+
 static void drm_tegra_setup_debug(struct drm_tegra *drm)
 {
 #ifndef NDEBUG
@@ -368,11 +484,12 @@ int drm_tegra_fd(struct drm_tegra *drm)
 }
 
 static int drm_tegra_wrap(struct drm_tegra **drmp, int fd, bool close,
-			  int version_major)
+			  int version_major, bool mock)
 {
 	struct drm_tegra *drm;
+	int err;
 
-	if (fd < 0 || !drmp)
+	if ((fd < 0 && !mock) || !drmp)
 		return -EINVAL;
 
 	drm = calloc(1, sizeof(*drm));
@@ -383,18 +500,35 @@ static int drm_tegra_wrap(struct drm_tegra **drmp, int fd, bool close,
 	drm->close = close;
 	drm->fd = fd;
 
+	if (mock) {
+		err = drm_tegra_mock_init(drm);
+		if (err) {
+			free(drm);
+			return err;
+		}
+	}
+
 	drm_tegra_bo_cache_init(&drm->bo_cache,
 				/* coarse */ false,
 				/* sparse */ false);
 	drm_tegra_bo_cache_init(&drm->bo_cache,
 				/* coarse */ false,
 				/* sparse */ true);
-	drm->handle_table = drmHashCreate();
-	drm->name_table = drmHashCreate();
+	DRMINITLISTHEAD(&drm->bo_cache.lru);
 	DRMINITLISTHEAD(&drm->mmap_cache.list);
-
-	if (!drm->handle_table || !drm->name_table)
+	drm_tegra_setup_bo_cache_budget(drm);
+	pthread_mutex_init(&drm->import_lock, NULL);
+	pthread_mutex_init(&drm->cache_lock, NULL);
+	pthread_mutex_init(&drm->syncpt_lock, NULL);
+
+	if (drm_tegra_bo_table_init(&drm->handle_table) ||
+	    drm_tegra_bo_table_init(&drm->name_table)) {
+		drm_tegra_bo_table_fini(&drm->handle_table);
+		drm_tegra_bo_table_fini(&drm->name_table);
+		drm_tegra_mock_fini(drm);
+		free(drm);
 		return -ENOMEM;
+	}
 
 	drm_tegra_setup_debug(drm);
 
@@ -409,6 +543,10 @@ int drm_tegra_new(struct drm_tegra **drmp, int fd)
 	drmVersionPtr version;
 	int version_major;
 
+	/* mock device implements the v1 (upstream kernel) job UAPI only */
+	if (fd == DRM_TEGRA_MOCK_FD)
+		return drm_tegra_wrap(drmp, fd, false, 1, true);
+
 	version = drmGetVersion(fd);
 	if (!version)
 		return -ENOMEM;
@@ -423,7 +561,7 @@ int drm_tegra_new(struct drm_tegra **drmp, int fd)
 	if (!supported)
 		return -ENOTSUP;
 
-	return drm_tegra_wrap(drmp, fd, false, version_major);
+	return drm_tegra_wrap(drmp, fd, false, version_major, false);
 }
 
 void drm_tegra_close(struct drm_tegra *drm)
@@ -432,8 +570,13 @@ void drm_tegra_close(struct drm_tegra *drm)
 		return;
 
 	drm_tegra_bo_cache_cleanup(drm, 0);
-	drmHashDestroy(drm->handle_table);
-	drmHashDestroy(drm->name_table);
+	drm_tegra_bo_reaper_stop(drm);
+	drm_tegra_bo_table_fini(&drm->handle_table);
+	drm_tegra_bo_table_fini(&drm->name_table);
+	pthread_mutex_destroy(&drm->import_lock);
+	pthread_mutex_destroy(&drm->cache_lock);
+	pthread_mutex_destroy(&drm->syncpt_lock);
+	drm_tegra_mock_fini(drm);
 
 	if (drm->close)
 		close(drm->fd);
@@ -441,26 +584,16 @@ void drm_tegra_close(struct drm_tegra *drm)
 	free(drm);
 }
 
-int drm_tegra_bo_new(struct drm_tegra_bo **bop, struct drm_tegra *drm,
-		     uint32_t flags, uint32_t size)
+/* allocates new BO, bypassing the cache */
+int drm_tegra_bo_create(struct drm_tegra_bo **bop, struct drm_tegra *drm,
+			uint32_t flags, uint32_t size)
 {
 	struct drm_tegra_gem_create args;
 	struct drm_tegra_bo *bo;
 	bool retried = false;
+	bool reaped = false;
 	int err;
 
-	if (!drm || size == 0 || !bop)
-		return -EINVAL;
-
-	pthread_mutex_lock(&table_lock);
-	bo = drm_tegra_bo_cache_alloc(drm, &size, flags);
-	pthread_mutex_unlock(&table_lock);
-
-	if (bo) {
-		DBG_BO(bo, "success from cache\n");
-		goto out;
-	}
-
 	bo = calloc(1, sizeof(*bo));
 	if (!bo)
 		return -ENOMEM;
@@ -468,6 +601,7 @@ int drm_tegra_bo_new(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	DRMINITLISTHEAD(&bo->mapping_list_v3);
 	DRMINITLISTHEAD(&bo->push_list);
 	DRMINITLISTHEAD(&bo->bo_list);
+	DRMINITLISTHEAD(&bo->lru_list);
 	atomic_set(&bo->ref, 1);
 	bo->reuse = true;
 	bo->flags = flags;
@@ -488,8 +622,8 @@ int drm_tegra_bo_new(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 		args.size += 4096;
 #endif
 retry:
-	err = drmCommandWriteRead(drm->fd, DRM_TEGRA_GEM_CREATE, &args,
-				  sizeof(args));
+	err = drm_tegra_command(drm, DRM_TEGRA_GEM_CREATE, &args,
+				sizeof(args));
 	if (err < 0) {
 		int drop_caches_fd, dropped;
 		struct timespec time;
@@ -497,6 +631,14 @@ retry:
 		VDBG_DRM(drm, "failed size %u bytes flags 0x%08X err %d (%s)\n",
 			 size, flags, err, strerror(-err));
 
+		/* memory of BOs queued for the release may be reused */
+		if (err == -ENOMEM && !reaped) {
+			reaped = true;
+
+			if (drm_tegra_bo_reaper_flush(drm))
+				goto retry;
+		}
+
 		clock_gettime(CLOCK_MONOTONIC, &time);
 
 		if (err == -ENOMEM && !retried &&
@@ -537,11 +679,31 @@ retry:
 	drm_tegra_bo_setup_guards(bo);
 	DBG_BO_STATS(drm);
 
-	pthread_mutex_lock(&table_lock);
 	/* add ourselves into the handle table */
-	drmHashInsert(drm->handle_table, args.handle, bo);
-	pthread_mutex_unlock(&table_lock);
-out:
+	insert_bo(&drm->handle_table, args.handle, bo);
+
+	*bop = bo;
+
+	return 0;
+}
+
+int drm_tegra_bo_new(struct drm_tegra_bo **bop, struct drm_tegra *drm,
+		     uint32_t flags, uint32_t size)
+{
+	struct drm_tegra_bo *bo;
+
+	if (!drm || size == 0 || !bop)
+		return -EINVAL;
+
+	pthread_mutex_lock(&drm->cache_lock);
+	bo = drm_tegra_bo_cache_alloc(drm, &size, flags);
+	pthread_mutex_unlock(&drm->cache_lock);
+
+	if (!bo)
+		return drm_tegra_bo_create(bop, drm, flags, size);
+
+	DBG_BO(bo, "success from cache\n");
+
 	*bop = bo;
 
 	return 0;
@@ -556,10 +718,15 @@ int drm_tegra_bo_wrap(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	if (!drm || !bop)
 		return -EINVAL;
 
-	pthread_mutex_lock(&table_lock);
-
 	/* check handle table to see if BO is already open */
-	bo = lookup_bo(drm->handle_table, handle);
+	bo = lookup_bo(drm, &drm->handle_table, handle);
+	if (bo)
+		goto out;
+
+	pthread_mutex_lock(&drm->import_lock);
+
+	/* re-check, BO could be imported meanwhile */
+	bo = lookup_bo(drm, &drm->handle_table, handle);
 	if (bo)
 		goto unlock;
 
@@ -572,6 +739,7 @@ int drm_tegra_bo_wrap(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	DRMINITLISTHEAD(&bo->mapping_list_v3);
 	DRMINITLISTHEAD(&bo->push_list);
 	DRMINITLISTHEAD(&bo->bo_list);
+	DRMINITLISTHEAD(&bo->lru_list);
 	atomic_set(&bo->ref, 1);
 	bo->handle = handle;
 	bo->flags = flags;
@@ -588,12 +756,12 @@ int drm_tegra_bo_wrap(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	}
 #endif
 	/* add ourselves into the handle table */
-	drmHashInsert(drm->handle_table, handle, bo);
+	insert_bo(&drm->handle_table, handle, bo);
 
 	DBG_BO(bo, "success\n");
 unlock:
-	pthread_mutex_unlock(&table_lock);
-
+	pthread_mutex_unlock(&drm->import_lock);
+out:
 	*bop = bo;
 
 	return err;
@@ -612,6 +780,7 @@ struct drm_tegra_bo *drm_tegra_bo_ref(struct drm_tegra_bo *bo)
 
 int drm_tegra_bo_unref(struct drm_tegra_bo *bo)
 {
+	struct drm_tegra *drm;
 	int err = 0;
 
 	if (!bo)
@@ -619,17 +788,25 @@ int drm_tegra_bo_unref(struct drm_tegra_bo *bo)
 
 	DBG_BO(bo, "\n");
 
-	if (!atomic_dec_and_test(&bo->ref))
+	if (bo_put_unless_one(bo))
 		return 0;
 
-	drm_tegra_bo_check_guards(bo);
+	drm = bo->drm;
+
+	/*
+	 * The last reference is dropped under cache_lock, lookup_bo()
+	 * could take a new reference meanwhile.
+	 */
+	pthread_mutex_lock(&drm->cache_lock);
 
-	pthread_mutex_lock(&table_lock);
+	if (atomic_dec_and_test(&bo->ref)) {
+		drm_tegra_bo_check_guards(bo);
 
-	if (!bo->reuse || drm_tegra_bo_cache_free(bo))
-		err = drm_tegra_bo_free(bo);
+		if (!bo->reuse || drm_tegra_bo_cache_free(bo))
+			err = drm_tegra_bo_free(bo);
+	}
 
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&drm->cache_lock);
 
 	return err;
 }
@@ -651,10 +828,16 @@ int __drm_tegra_bo_map(struct drm_tegra_bo *bo, void **ptr)
 
 	map = drm_tegra_bo_cache_map(bo);
 	if (map) {
+		if (ptr == &bo->map)
+			drm->mmap_cache.hits++;
+
 		DBG_BO(bo, "success from cache\n");
 		goto out;
 	}
 
+	if (ptr == &bo->map)
+		drm->mmap_cache.misses++;
+
 #if HAVE_VALGRIND
 	if (RUNNING_ON_VALGRIND && bo->map_vg) {
 		map = bo->map_vg;
@@ -700,7 +883,7 @@ int drm_tegra_bo_map(struct drm_tegra_bo *bo, void **ptr)
 		goto done;
 	}
 
-	pthread_mutex_lock(&table_lock);
+	pthread_mutex_lock(&bo->drm->cache_lock);
 
 	if (!bo->map) {
 		err = __drm_tegra_bo_map(bo, &bo->map);
@@ -710,7 +893,7 @@ int drm_tegra_bo_map(struct drm_tegra_bo *bo, void **ptr)
 		VG_BO_MMAP(bo);
 	}
 out:
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&bo->drm->cache_lock);
 
 done:
 	if (ptr)
@@ -729,7 +912,7 @@ int drm_tegra_bo_unmap(struct drm_tegra_bo *bo)
 	if (!bo->map || !atomic_dec_and_test(&bo->mmap_ref))
 		return 0;
 
-	pthread_mutex_lock(&table_lock);
+	pthread_mutex_lock(&bo->drm->cache_lock);
 
 	if (!atomic_read(&bo->mmap_ref)) {
 		VG_BO_UNMMAP(bo);
@@ -738,7 +921,7 @@ int drm_tegra_bo_unmap(struct drm_tegra_bo *bo)
 		bo->map = NULL;
 	}
 
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&bo->drm->cache_lock);
 
 	return 0;
 }
@@ -777,8 +960,8 @@ int drm_tegra_bo_get_flags(struct drm_tegra_bo *bo, uint32_t *flags)
 	memset(&args, 0, sizeof(args));
 	args.handle = bo->handle;
 
-	err = drmCommandWriteRead(bo->drm->fd, DRM_TEGRA_GEM_GET_FLAGS, &args,
-				  sizeof(args));
+	err = drm_tegra_command(bo->drm, DRM_TEGRA_GEM_GET_FLAGS, &args,
+				sizeof(args));
 	if (err < 0) {
 		VDBG_BO(bo, "failed err %d strerror(%s)\n",
 			err, strerror(-err));
@@ -805,8 +988,8 @@ int drm_tegra_bo_set_flags(struct drm_tegra_bo *bo, uint32_t flags)
 	args.handle = bo->handle;
 	args.flags = flags;
 
-	err = drmCommandWriteRead(bo->drm->fd, DRM_TEGRA_GEM_SET_FLAGS, &args,
-				  sizeof(args));
+	err = drm_tegra_command(bo->drm, DRM_TEGRA_GEM_SET_FLAGS, &args,
+				sizeof(args));
 	if (err < 0) {
 		VDBG_BO(bo, "failed err %d strerror(%s)\n",
 			err, strerror(-err));
@@ -830,8 +1013,8 @@ int drm_tegra_bo_get_tiling(struct drm_tegra_bo *bo,
 	memset(&args, 0, sizeof(args));
 	args.handle = bo->handle;
 
-	err = drmCommandWriteRead(bo->drm->fd, DRM_TEGRA_GEM_GET_TILING, &args,
-				  sizeof(args));
+	err = drm_tegra_command(bo->drm, DRM_TEGRA_GEM_GET_TILING, &args,
+				sizeof(args));
 	if (err < 0) {
 		VDBG_BO(bo, "failed err %d strerror(%s)\n",
 			err, strerror(-err));
@@ -862,8 +1045,8 @@ int drm_tegra_bo_set_tiling(struct drm_tegra_bo *bo,
 	args.mode = tiling->mode;
 	args.value = tiling->value;
 
-	err = drmCommandWriteRead(bo->drm->fd, DRM_TEGRA_GEM_SET_TILING,
-				  &args, sizeof(args));
+	err = drm_tegra_command(bo->drm, DRM_TEGRA_GEM_SET_TILING,
+				&args, sizeof(args));
 	if (err < 0) {
 		VDBG_BO(bo, "failed mode %u value %u err %d strerror(%s)\n",
 			tiling->mode, tiling->value, err, strerror(-err));
@@ -889,19 +1072,21 @@ int drm_tegra_bo_get_name(struct drm_tegra_bo *bo, uint32_t *name)
 		memset(&args, 0, sizeof(args));
 		args.handle = bo->handle;
 
-		err = drmIoctl(bo->drm->fd, DRM_IOCTL_GEM_FLINK, &args);
+		err = drm_tegra_ioctl(bo->drm, DRM_IOCTL_GEM_FLINK, &args);
 		if (err < 0) {
 			VDBG_BO(bo, "err %d strerror(%s)\n",
 				err, strerror(-err));
 			return -errno;
 		}
 
-		pthread_mutex_lock(&table_lock);
+		pthread_mutex_lock(&bo->drm->import_lock);
 
-		drmHashInsert(bo->drm->name_table, args.name, bo);
-		bo->name = args.name;
+		if (!bo->name) {
+			insert_bo(&bo->drm->name_table, args.name, bo);
+			bo->name = args.name;
+		}
 
-		pthread_mutex_unlock(&table_lock);
+		pthread_mutex_unlock(&bo->drm->import_lock);
 	}
 
 	*name = bo->name;
@@ -922,10 +1107,15 @@ int drm_tegra_bo_from_name(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	if (!drm || !name || !bop)
 		return -EINVAL;
 
-	pthread_mutex_lock(&table_lock);
-
 	/* check name table first, to see if BO is already open */
-	bo = lookup_bo(drm->name_table, name);
+	bo = lookup_bo(drm, &drm->name_table, name);
+	if (bo)
+		goto out;
+
+	pthread_mutex_lock(&drm->import_lock);
+
+	/* re-check, BO could be imported meanwhile */
+	bo = lookup_bo(drm, &drm->name_table, name);
 	if (bo)
 		goto unlock;
 
@@ -935,10 +1125,15 @@ int drm_tegra_bo_from_name(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 		goto unlock;
 	}
 
+	DRMINITLISTHEAD(&bo->mapping_list_v3);
+	DRMINITLISTHEAD(&bo->push_list);
+	DRMINITLISTHEAD(&bo->bo_list);
+	DRMINITLISTHEAD(&bo->lru_list);
+
 	memset(&args, 0, sizeof(args));
 	args.name = name;
 
-	err = drmIoctl(drm->fd, DRM_IOCTL_GEM_OPEN, &args);
+	err = drm_tegra_ioctl(drm, DRM_IOCTL_GEM_OPEN, &args);
 	if (err < 0) {
 		VDBG_DRM(drm, "failed name 0x%08X err %d strerror(%s)\n",
 			 name, err, strerror(-err));
@@ -949,7 +1144,7 @@ int drm_tegra_bo_from_name(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	}
 
 	/* check handle table second, to see if BO is already open */
-	dup = lookup_bo(drm->handle_table, args.handle);
+	dup = lookup_bo(drm, &drm->handle_table, args.handle);
 	if (dup) {
 		VDBG_BO(dup, "success reused name 0x%08X\n", name);
 		free(bo);
@@ -957,7 +1152,6 @@ int drm_tegra_bo_from_name(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 		goto unlock;
 	}
 
-	drmHashInsert(drm->name_table, name, bo);
 	atomic_set(&bo->ref, 1);
 	bo->name = name;
 	bo->handle = args.handle;
@@ -965,13 +1159,24 @@ int drm_tegra_bo_from_name(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	bo->size = args.size;
 	bo->drm = drm;
 
-	DBG_BO(bo, "success\n");
-
 	VG_BO_ALLOC(bo);
 
-unlock:
-	pthread_mutex_unlock(&table_lock);
+	/* lookup isn't locked, BO shall be published fully initialized */
+	err = insert_bo(&drm->name_table, name, bo);
+	if (err) {
+		VDBG_BO(bo, "failed to insert name 0x%08X err %d\n", name, err);
+		VG_BO_FREE(bo);
+		drm_tegra_bo_destroy(drm, args.handle, NULL, 0);
+		free(bo);
+		bo = NULL;
+		goto unlock;
+	}
+
+	DBG_BO(bo, "success\n");
 
+unlock:
+	pthread_mutex_unlock(&drm->import_lock);
+out:
 	*bop = bo;
 
 	return err;
@@ -985,8 +1190,12 @@ int drm_tegra_bo_to_dmabuf(struct drm_tegra_bo *bo, uint32_t *handle)
 	if (!bo || !handle)
 		return -EINVAL;
 
-	err = drmPrimeHandleToFD(bo->drm->fd, bo->handle, DRM_CLOEXEC,
-				 &prime_fd);
+	if (bo->drm->mock)
+		err = drm_tegra_mock_prime_handle_to_fd(bo->drm, bo->handle,
+							&prime_fd);
+	else
+		err = drmPrimeHandleToFD(bo->drm->fd, bo->handle, DRM_CLOEXEC,
+					 &prime_fd);
 	if (err) {
 		VDBG_BO(bo, "faile err %d strerror(%s)\n",
 			err, strerror(-err));
@@ -1012,7 +1221,7 @@ int drm_tegra_bo_from_dmabuf(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	if (!drm || !bop)
 		return -EINVAL;
 
-	pthread_mutex_lock(&table_lock);
+	pthread_mutex_lock(&drm->import_lock);
 
 	bo = calloc(1, sizeof(*bo));
 	if (!bo) {
@@ -1020,15 +1229,31 @@ int drm_tegra_bo_from_dmabuf(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 		goto unlock;
 	}
 
-	err = drmPrimeFDToHandle(drm->fd, fd, &handle);
+	DRMINITLISTHEAD(&bo->mapping_list_v3);
+	DRMINITLISTHEAD(&bo->push_list);
+	DRMINITLISTHEAD(&bo->bo_list);
+	DRMINITLISTHEAD(&bo->lru_list);
+
+retry:
+	if (drm->mock)
+		err = drm_tegra_mock_prime_fd_to_handle(drm, fd, &handle);
+	else
+		err = drmPrimeFDToHandle(drm->fd, fd, &handle);
 	if (err) {
 		free(bo);
 		bo = NULL;
 		goto unlock;
 	}
 
+	/*
+	 * Kernel returns handle of the BO if it's open already, the handle
+	 * may be queued for the release.  Reaper closes it, import again.
+	 */
+	if (drm_tegra_bo_reaper_flush_handle(drm, handle))
+		goto retry;
+
 	/* check handle table to see if BO is already open */
-	dup = lookup_bo(drm->handle_table, handle);
+	dup = lookup_bo(drm, &drm->handle_table, handle);
 	if (dup) {
 		DBG_BO(dup, "success reused\n");
 		free(bo);
@@ -1052,19 +1277,21 @@ int drm_tegra_bo_from_dmabuf(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	VG_BO_ALLOC(bo);
 
 	/* add ourself into the handle table: */
-	drmHashInsert(drm->handle_table, handle, bo);
+	insert_bo(&drm->handle_table, handle, bo);
 
 	/* handle lseek() error */
 	if (err) {
 		VDBG_BO(bo, "lseek failed %d (%s)\n", err, strerror(-err));
+		pthread_mutex_lock(&drm->cache_lock);
 		drm_tegra_bo_free(bo);
+		pthread_mutex_unlock(&drm->cache_lock);
 		bo = NULL;
 	} else {
 		DBG_BO(bo, "success\n");
 	}
 
 unlock:
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&drm->import_lock);
 
 	*bop = bo;
 
@@ -1107,8 +1334,8 @@ int drm_tegra_bo_cpu_prep(struct drm_tegra_bo *bo,
 	args.handle = bo->handle;
 	args.timeout = timeout_us;
 
-	ret = drmCommandWriteRead(bo->drm->fd, DRM_TEGRA_GEM_CPU_PREP, &args,
-				  sizeof(args));
+	ret = drm_tegra_command(bo->drm, DRM_TEGRA_GEM_CPU_PREP, &args,
+				sizeof(args));
 	if (ret && ret != -EBUSY && ret != -ETIMEDOUT)
 		VDBG_BO(bo, "failed flags 0x%08X timeout_us %u err %d (%s)\n",
 			flags, timeout_us, ret, strerror(-ret));
@@ -1127,9 +1354,7 @@ int drm_tegra_bo_from_handle(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	if (!drm || !bop)
 		return -EINVAL;
 
-	pthread_mutex_lock(&table_lock);
-	bo = lookup_bo(drm->handle_table, handle);
-	pthread_mutex_unlock(&table_lock);
+	bo = lookup_bo(drm, &drm->handle_table, handle);
 
 	if (!bo)
 		return -EINVAL;
@@ -1143,7 +1368,9 @@ int drm_tegra_channel_open(struct drm_tegra_channel **channelp,
 			   struct drm_tegra *drm,
 			   enum drm_tegra_class client)
 {
-	if (drm->version == 1 && !getenv("OPENTEGRA_FORCE_OLD_UAPI") &&
+	/* mock device doesn't emulate channels of the v3 UAPI */
+	if (drm->version == 1 && !drm->mock &&
+	    !getenv("OPENTEGRA_FORCE_OLD_UAPI") &&
 	    getenv("OPENTEGRA_FORCE_NEW_UAPI"))
 		return drm_tegra_channel_open_v3(channelp, drm, client);
 	else
@@ -1167,33 +1394,104 @@ int drm_tegra_channel_close(struct drm_tegra_channel *channel)
 	return 0;
 }
 
+static struct drm_tegra_syncpt_cache *
+drm_tegra_fence_syncpt_cache(struct drm_tegra_fence *fence)
+{
+	if (!fence->syncpt_valid)
+		return NULL;
+
+	return &fence->drm->syncpt_cache[fence->syncpt %
+					 DRM_TEGRA_SYNCPT_CACHE_SIZE];
+}
+
+/*
+ * Syncpoints are incremented by hardware in order, hence fence is known to
+ * be completed if its threshold is behind the syncpoint value observed by
+ * a previous check, this saves the ioctl.
+ */
+static bool drm_tegra_fence_cached_completed(struct drm_tegra_fence *fence)
+{
+	struct drm_tegra_syncpt_cache *entry;
+	bool completed = false;
+
+	entry = drm_tegra_fence_syncpt_cache(fence);
+	if (!entry)
+		return false;
+
+	pthread_mutex_lock(&fence->drm->syncpt_lock);
+
+	if (entry->valid && entry->id == fence->syncpt)
+		completed = (int32_t)(entry->value - fence->value) >= 0;
+
+	pthread_mutex_unlock(&fence->drm->syncpt_lock);
+
+	return completed;
+}
+
+static void drm_tegra_fence_cache_completed(struct drm_tegra_fence *fence)
+{
+	struct drm_tegra_syncpt_cache *entry;
+
+	entry = drm_tegra_fence_syncpt_cache(fence);
+	if (!entry)
+		return;
+
+	pthread_mutex_lock(&fence->drm->syncpt_lock);
+
+	/* cached value only moves forward */
+	if (!entry->valid || entry->id != fence->syncpt ||
+	    (int32_t)(entry->value - fence->value) < 0) {
+		entry->id = fence->syncpt;
+		entry->value = fence->value;
+		entry->valid = true;
+	}
+
+	pthread_mutex_unlock(&fence->drm->syncpt_lock);
+}
+
 int drm_tegra_fence_is_busy(struct drm_tegra_fence *fence)
 {
+	int ret = 0;
+
 	if (!fence)
 		return 0;
 
+	if (drm_tegra_fence_cached_completed(fence))
+		return 0;
+
 	if (fence->version == 0)
-		return drm_tegra_fence_is_busy_v1(fence);
+		ret = drm_tegra_fence_is_busy_v1(fence);
 
 	if (fence->version == 3)
-		return drm_tegra_fence_is_busy_v3(fence);
+		ret = drm_tegra_fence_is_busy_v3(fence);
 
-	return 0;
+	if (ret == 0)
+		drm_tegra_fence_cache_completed(fence);
+
+	return ret;
 }
 
 int drm_tegra_fence_wait_timeout(struct drm_tegra_fence *fence,
 				 unsigned long timeout)
 {
+	int ret = 0;
+
 	if (!fence)
 		return 0;
 
+	if (drm_tegra_fence_cached_completed(fence))
+		return 0;
+
 	if (fence->version == 0)
-		return drm_tegra_fence_wait_timeout_v1(fence, timeout);
+		ret = drm_tegra_fence_wait_timeout_v1(fence, timeout);
 
 	if (fence->version == 3)
-		return drm_tegra_fence_wait_timeout_v3(fence, timeout);
+		ret = drm_tegra_fence_wait_timeout_v3(fence, timeout);
 
-	return 0;
+	if (ret == 0)
+		drm_tegra_fence_cache_completed(fence);
+
+	return ret;
 }
 
 void drm_tegra_fence_free(struct drm_tegra_fence *fence)
@@ -1208,6 +1506,26 @@ void drm_tegra_fence_free(struct drm_tegra_fence *fence)
 		return drm_tegra_fence_free_v3(fence);
 }
 
+/*
+ * drm_tegra_fence_export_sync_file() - export fence as a sync_file
+ * @fence: fence
+ * @fd: returned sync_file file descriptor, owned by the caller
+ *
+ * The sync_file signals once the job associated with the fence is completed,
+ * it could be polled for POLLIN. Syncpoint-based fences of the legacy UAPI
+ * can't be exported.
+ */
+int drm_tegra_fence_export_sync_file(struct drm_tegra_fence *fence, int *fd)
+{
+	if (!fence || !fd)
+		return -EINVAL;
+
+	if (fence->version == 3)
+		return drm_tegra_fence_export_sync_file_v3(fence, fd);
+
+	return -EOPNOTSUPP;
+}
+
 static enum drm_tegra_soc_id read_chip_id(const char *path)
 {
 	FILE *file = fopen(path, "r");
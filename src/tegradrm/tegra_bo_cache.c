@@ -35,6 +35,43 @@
 
 #include "private.h"
 
+/*
+ * Cached BOs are kept for a time that depends on how often allocations
+ * of the bucket's size are requested, the request rate is tracked by a
+ * demand counter that is bumped on every cache lookup and halved every
+ * BO_CACHE_DECAY_PERIOD seconds. Hit and miss counters decay the same
+ * way, bucket that recently missed keeps BOs for longer, up to twice
+ * the time if every lookup missed. Total size of cached BOs is limited
+ * by the cache budget, least recently freed BOs of cold buckets are
+ * evicted first once budget is exceeded.
+ */
+#define BO_CACHE_MIN_RETENTION		2
+#define BO_CACHE_MAX_RETENTION		60
+#define BO_CACHE_DEMAND_RETENTION	2
+#define BO_CACHE_DECAY_PERIOD		5
+
+/*
+ * BOs are allocated with the exact (page-aligned) size and cached BO
+ * could be reused for a smaller allocation only if it is larger by no
+ * more than the tolerance, otherwise memory is wasted on rounding.
+ */
+#define BO_CACHE_FIT_TOLERANCE(size)	align((size) / 8, 4096)
+
+/*
+ * CPU mappings of unmapped BOs are kept in the LRU list, the mapping is
+ * reused if BO is mapped again. Mappings that weren't used for
+ * BO_MMAP_CACHE_RETENTION seconds are unmapped, least recently used
+ * mappings are unmapped once total size of cached mappings exceeds the
+ * virtual address space budget.
+ */
+#define BO_MMAP_CACHE_RETENTION		60
+
+/*
+ * Histogram of BO sizes covers allocations made during startup period,
+ * it tells what BOs should be preallocated by the next session.
+ */
+#define BO_HISTOGRAM_PERIOD		60
+
 static void
 add_bucket(struct drm_tegra_bo_cache *cache, int size, bool sparse)
 {
@@ -48,35 +85,134 @@ add_bucket(struct drm_tegra_bo_cache *cache, int size, bool sparse)
 	cache->num_buckets++;
 }
 
+static time_t bucket_retention(struct drm_tegra_bo_bucket *bucket)
+{
+	uint32_t lookups = bucket->hits + bucket->misses;
+	time_t retention = BO_CACHE_MIN_RETENTION +
+			   bucket->demand * BO_CACHE_DEMAND_RETENTION;
+
+	/* misses would turn into hits if BOs were kept for longer */
+	if (lookups)
+		retention += retention * bucket->misses / lookups;
+
+	if (retention > BO_CACHE_MAX_RETENTION)
+		retention = BO_CACHE_MAX_RETENTION;
+
+	return retention;
+}
+
 static bool
 bucket_free_up(struct drm_tegra *drm, struct drm_tegra_bo_bucket *bucket,
-	       bool mem_map)
+	       time_t delta, uint32_t num_entries)
 {
-	if (mem_map && bucket->num_mmap_entries )
-		VDBG_DRM(drm, "mem_map %d bucket->size %u bucket->num_mmap_entries %u\n",
-			 mem_map, bucket->size, bucket->num_mmap_entries);
-	else if (bucket->num_entries)
-		VDBG_DRM(drm, "mem_map %d bucket->size %u bucket->num_entries %u\n",
-			 mem_map, bucket->size, bucket->num_entries);
+	if (num_entries)
+		VDBG_DRM(drm, "bucket->size %u num_entries %u demand %u hits %u misses %u\n",
+			 bucket->size, num_entries, bucket->demand,
+			 bucket->hits, bucket->misses);
 
-	/*
-	 * Always keep a bunch of small BO's in cache because
-	 * they usually reallocated frequently. This reduces
-	 * stalls on starting commands stream generation.
-	 */
-	if (mem_map) {
-		if (bucket->size > 16384 ||
-		    bucket->size * bucket->num_mmap_entries > 65536)
-			return true;
-	} else {
-		if (bucket->size > 16384 ||
-		    bucket->size * bucket->num_entries > 65536)
-			return true;
-	}
+	if (delta < BO_CACHE_MIN_RETENTION)
+		return false;
+
+	/* cold bucket */
+	if (delta > bucket_retention(bucket))
+		return true;
+
+	/* keep as many entries as were recently asked for */
+	if (num_entries > bucket->demand + 1)
+		return true;
 
 	return false;
 }
 
+static void bucket_decay(struct drm_tegra_bo_cache *cache, time_t time)
+{
+	int i;
+
+	if (time - cache->decay_time < BO_CACHE_DECAY_PERIOD)
+		return;
+
+	for (i = 0; i < cache->num_buckets; i++) {
+		cache->cache_bucket[i].demand /= 2;
+		cache->cache_bucket[i].hits /= 2;
+		cache->cache_bucket[i].misses /= 2;
+	}
+
+	cache->decay_time = time;
+}
+
+/*
+ * Takes out BO from the cache, BO shall be accessible under valgrind.
+ * Called under cache_lock
+ */
+void drm_tegra_bo_cache_remove(struct drm_tegra_bo *bo)
+{
+	struct drm_tegra *drm = bo->drm;
+	struct drm_tegra_bo_cache *cache = &drm->bo_cache;
+	struct drm_tegra_bo_bucket *bucket = bo->bucket;
+
+	DRMLISTDELINIT(&bo->bo_list);
+	DRMLISTDELINIT(&bo->lru_list);
+
+	/* BO is used now, it's cached as a regular BO next time */
+	if (bo->prefilled) {
+		bucket->num_prefilled--;
+		bo->prefilled = false;
+	}
+
+	bucket->num_entries--;
+	cache->cached_size -= bo->size;
+	bo->bucket = NULL;
+#ifndef NDEBUG
+	if (drm->debug_bo) {
+		drm->debug_bos_cached--;
+		drm->debug_bos_cached_size -= bo->size;
+	}
+#endif
+}
+
+static void drm_tegra_bo_cache_evict(struct drm_tegra_bo *bo)
+{
+#ifndef NDEBUG
+	struct drm_tegra *drm;
+#endif
+
+	VG_BO_OBTAIN(bo);
+#ifndef NDEBUG
+	drm = bo->drm;
+
+	if (drm->debug_bo)
+		drm->debug_bos_cache_evicted++;
+#endif
+	drm_tegra_bo_cache_remove(bo);
+	drm_tegra_bo_free(bo);
+}
+
+/* Evicts cached buffers until cache fits the budget.  Called under cache_lock */
+static void drm_tegra_bo_cache_trim(struct drm_tegra *drm)
+{
+	struct drm_tegra_bo_cache *cache = &drm->bo_cache;
+	struct drm_tegra_bo *bo, *tmp;
+
+	if (cache->cached_size <= cache->budget)
+		return;
+
+	/* cold buckets go first */
+	DRMLISTFOREACHENTRYSAFE(bo, tmp, &cache->lru, lru_list) {
+		if (cache->cached_size <= cache->budget)
+			return;
+
+		if (!bo->bucket->demand)
+			drm_tegra_bo_cache_evict(bo);
+	}
+
+	while (cache->cached_size > cache->budget &&
+	       !DRMLISTEMPTY(&cache->lru)) {
+		bo = DRMLISTENTRY(struct drm_tegra_bo, cache->lru.next,
+				  lru_list);
+		drm_tegra_bo_cache_evict(bo);
+	}
+}
+
 /**
  * @coarse: if true, only power-of-two bucket sizes, otherwise
  *    fill in for a bit smoother size curve..
@@ -110,105 +246,106 @@ void drm_tegra_bo_cache_init(struct drm_tegra_bo_cache *cache,
 	}
 }
 
-/* Frees older cached buffers.  Called under table_lock */
-void drm_tegra_bo_cache_cleanup(struct drm_tegra *drm, time_t time)
+/* Frees older cached buffers.  Called under cache_lock */
+void __drm_tegra_bo_cache_cleanup(struct drm_tegra *drm, time_t time)
 {
 	struct drm_tegra_bo_cache *cache = &drm->bo_cache;
-	time_t delta;
 	int i;
-#ifndef NDEBUG
-	uint32_t size;
-#endif
 
 	if (cache->time == time)
 		return;
 
+	bucket_decay(cache, time);
+
 	for (i = 0; i < cache->num_buckets; i++) {
 		struct drm_tegra_bo_bucket *bucket = &cache->cache_bucket[i];
-		struct drm_tegra_bo *bo;
-
-		if (time && !bucket_free_up(drm, bucket, false))
-			continue;
-
-		while (!DRMLISTEMPTY(&bucket->list)) {
-			bo = DRMLISTENTRY(struct drm_tegra_bo,
-					bucket->list.next, bo_list);
-
-			delta = time - bo->free_time;
-
-			/* keep things in cache for at least 10 second: */
-			if (time && delta <= 10)
-				break;
+		struct drm_tegra_bo *bo, *tmp;
+
+		DRMLISTFOREACHENTRYSAFE(bo, tmp, &bucket->list, bo_list) {
+			/*
+			 * Prefilled BOs are kept until they are used for the
+			 * first time, only the budget trimming evicts them.
+			 */
+			if (time && bo->prefilled)
+				continue;
 
-			/* keep things in cache longer if not much */
-			if (time && delta < 60 && bucket->num_entries < 5)
+			if (time && !bucket_free_up(drm, bucket,
+						    time - bo->free_time,
+						    bucket->num_entries -
+						    bucket->num_prefilled))
 				break;
 
-			VG_BO_OBTAIN(bo);
-#ifndef NDEBUG
-			size = bo->size;
-#endif
-			DRMLISTDEL(&bo->bo_list);
-			drm_tegra_bo_free(bo);
-#ifndef NDEBUG
-			if (drm->debug_bo) {
-				drm->debug_bos_cached--;
-				drm->debug_bos_cached_size -= size;
-			}
-#endif
-			bucket->num_entries--;
+			drm_tegra_bo_cache_evict(bo);
 		}
 	}
 
 	cache->time = time;
 }
 
-struct drm_tegra_bo_bucket *
-drm_tegra_get_bucket(struct drm_tegra *drm, uint32_t size, uint32_t flags)
+void drm_tegra_bo_cache_cleanup(struct drm_tegra *drm, time_t time)
 {
-	struct drm_tegra_bo_cache *cache = &drm->bo_cache;
-	bool sparse;
-	int i;
+	pthread_mutex_lock(&drm->cache_lock);
+	__drm_tegra_bo_cache_cleanup(drm, time);
+	pthread_mutex_unlock(&drm->cache_lock);
+}
 
+static bool bo_sparse(struct drm_tegra *drm, uint32_t flags)
+{
 #ifndef GRATE_KERNEL_DRM_VERSION
 #define GRATE_KERNEL_DRM_VERSION	99991
 #endif
-	if (drm->version >= GRATE_KERNEL_DRM_VERSION &&
-	    (flags & DRM_TEGRA_GEM_CREATE_SPARSE))
-		sparse = true;
-	else
-		sparse = false;
-
-	/* check sparse bucket first */
-	if (sparse) {
-		for (i = 0; i < cache->num_buckets; i++) {
-			struct drm_tegra_bo_bucket *bucket = &cache->cache_bucket[i];
-			if (bucket->size >= size && bucket->sparse == true) {
-				return bucket;
-			}
-		}
-	}
+	return drm->version >= GRATE_KERNEL_DRM_VERSION &&
+	       (flags & DRM_TEGRA_GEM_CREATE_SPARSE);
+}
 
-	/* it's fine to fall back to contiguous bucket */
+/*
+ * Bucket holds BOs of sizes starting from the bucket's size and up to the
+ * size of the next bucket, returns index of the bucket for a given size.
+ */
+static int bucket_index(struct drm_tegra_bo_cache *cache, uint32_t size,
+			bool sparse)
+{
+	int i, index = -1;
 
-	/* hmm, this is what intel does, but I suppose we could calculate our
-	 * way to the correct bucket size rather than looping..
-	 */
 	for (i = 0; i < cache->num_buckets; i++) {
 		struct drm_tegra_bo_bucket *bucket = &cache->cache_bucket[i];
-		if (bucket->size >= size && bucket->sparse == false) {
-			return bucket;
-		}
+
+		if (bucket->sparse != sparse)
+			continue;
+
+		if (bucket->size > size)
+			return index;
+
+		index = i;
 	}
 
-	VDBG_DRM(drm, "failed size %u bytes\n",  size);
+	/* BOs larger than the largest bucket aren't cached */
+	if (index >= 0 && cache->cache_bucket[index].size < size)
+		return -1;
 
-	return NULL;
+	return index;
 }
 
-static struct drm_tegra_bo_bucket * bo_bucket(struct drm_tegra_bo *bo)
+struct drm_tegra_bo_bucket *
+drm_tegra_get_bucket(struct drm_tegra *drm, uint32_t size, uint32_t flags)
 {
-	return drm_tegra_get_bucket(bo->drm, bo->size, bo->flags);
+	struct drm_tegra_bo_cache *cache = &drm->bo_cache;
+	int i = -1;
+
+	/* check sparse bucket first */
+	if (bo_sparse(drm, flags))
+		i = bucket_index(cache, size, true);
+
+	/* it's fine to fall back to contiguous bucket */
+	if (i < 0)
+		i = bucket_index(cache, size, false);
+
+	if (i < 0) {
+		VDBG_DRM(drm, "failed size %u bytes\n",  size);
+		return NULL;
+	}
+
+	return &cache->cache_bucket[i];
 }
 
 static bool is_idle(struct drm_tegra_bo *bo)
@@ -224,11 +361,45 @@ static bool is_idle(struct drm_tegra_bo *bo)
 	return ret;
 }
 
-static struct drm_tegra_bo *find_in_bucket(struct drm_tegra_bo_bucket *bucket,
-					   uint32_t flags)
+/*
+ * Looks up cached BO of exactly the requested size, otherwise the smallest
+ * BO that fits into the tolerance. Suitable BO could reside only in the
+ * bucket of the requested size and in the few following buckets.
+ */
+static struct drm_tegra_bo *find_best_fit(struct drm_tegra_bo_cache *cache,
+					  uint32_t size, bool sparse)
 {
-	struct drm_tegra_bo *bo = NULL;
+	uint32_t max_size = size + BO_CACHE_FIT_TOLERANCE(size);
+	struct drm_tegra_bo_bucket *bucket;
+	struct drm_tegra_bo *bo, *best = NULL;
+	int i;
+
+	i = bucket_index(cache, size, sparse);
+	if (i < 0)
+		return NULL;
+
+	for (; i < cache->num_buckets; i++) {
+		bucket = &cache->cache_bucket[i];
+
+		if (bucket->sparse != sparse || bucket->size > max_size)
+			break;
 
+		/* bucket-list is sorted by free time, older BOs go first */
+		DRMLISTFOREACHENTRY(bo, &bucket->list, bo_list) {
+			if (bo->free_size < size || bo->free_size > max_size)
+				continue;
+
+			if (!best || bo->free_size < best->free_size)
+				best = bo;
+
+			if (best->free_size == size)
+				goto found;
+		}
+	}
+
+	if (!best)
+		return NULL;
+found:
 	/* TODO .. if we had an ALLOC_FOR_RENDER flag like intel, we could
 	 * skip the busy check.. if it is only going to be a render target
 	 * then we probably don't need to stall..
@@ -236,19 +407,10 @@ static struct drm_tegra_bo *find_in_bucket(struct drm_tegra_bo_bucket *bucket,
 	 * NOTE that intel takes ALLOC_FOR_RENDER bo's from the list tail
 	 * (MRU, since likely to be in GPU cache), rather than head (LRU)..
 	 */
-	if (!DRMLISTEMPTY(&bucket->list)) {
-		bo = DRMLISTENTRY(struct drm_tegra_bo, bucket->list.next,
-				  bo_list);
-		/* TODO check for compatible flags? */
-		if (is_idle(bo)) {
-			DRMLISTDELINIT(&bo->bo_list);
-			bucket->num_entries--;
-		} else {
-			bo = NULL;
-		}
-	}
+	if (!is_idle(best))
+		return NULL;
 
-	return bo;
+	return best;
 }
 
 void drm_tegra_reset_bo(struct drm_tegra_bo *bo, uint32_t flags,
@@ -286,11 +448,143 @@ void drm_tegra_reset_bo(struct drm_tegra_bo *bo, uint32_t flags,
 	}
 }
 
-/* NOTE: size is potentially rounded up to bucket size: */
+/*
+ * Counts allocation that had to be served by kernel, allocation served by
+ * a prefilled BO is counted too in order to keep histogram stable across
+ * sessions.  Called under cache_lock
+ */
+static void bo_histogram_record(struct drm_tegra *drm, uint32_t size,
+				uint32_t flags)
+{
+	struct drm_tegra_bo_histogram *histogram = &drm->bo_histogram;
+	struct drm_tegra_bo_size_stat *entry;
+	struct timespec time;
+	unsigned int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	if (!histogram->start)
+		histogram->start = time.tv_sec;
+
+	if (time.tv_sec - histogram->start > BO_HISTOGRAM_PERIOD)
+		return;
+
+	for (i = 0; i < histogram->num_entries; i++) {
+		entry = &histogram->entries[i];
+
+		if (entry->size == size && entry->flags == flags) {
+			entry->count++;
+			return;
+		}
+	}
+
+	if (histogram->num_entries == DRM_TEGRA_BO_HISTOGRAM_SIZE)
+		return;
+
+	entry = &histogram->entries[histogram->num_entries++];
+	entry->size = size;
+	entry->flags = flags;
+	entry->count = 1;
+}
+
+static int bo_size_stat_cmp(const void *p1, const void *p2)
+{
+	const struct drm_tegra_bo_size_stat *e1 = p1;
+	const struct drm_tegra_bo_size_stat *e2 = p2;
+
+	if (e1->count != e2->count)
+		return e1->count < e2->count ? 1 : -1;
+
+	return (int)e1->size - (int)e2->size;
+}
+
+/* Returns number of histogram entries, most demanded sizes go first */
+int drm_tegra_bo_cache_get_histogram(struct drm_tegra *drm,
+				     struct drm_tegra_bo_size_stat *stats,
+				     unsigned int max)
+{
+	unsigned int num;
+
+	if (!drm || !stats)
+		return -EINVAL;
+
+	pthread_mutex_lock(&drm->cache_lock);
+
+	qsort(drm->bo_histogram.entries, drm->bo_histogram.num_entries,
+	      sizeof(*stats), bo_size_stat_cmp);
+
+	num = drm->bo_histogram.num_entries;
+	if (num > max)
+		num = max;
+	memcpy(stats, drm->bo_histogram.entries, num * sizeof(*stats));
+
+	pthread_mutex_unlock(&drm->cache_lock);
+
+	return num;
+}
+
+/*
+ * Preallocates BOs into the cache. Prefilled BOs aren't evicted by the
+ * periodic cleanup until they are used, only if cache exceeds the budget.
+ * Returns number of preallocated BOs.
+ */
+int drm_tegra_bo_cache_prefill(struct drm_tegra *drm, uint32_t flags,
+			       uint32_t size, unsigned int count)
+{
+	struct drm_tegra_bo_cache *cache;
+	struct drm_tegra_bo_bucket *bucket;
+	struct drm_tegra_bo **bos;
+	unsigned int i, num = 0;
+	uint64_t cached_size;
+	uint32_t budget;
+
+	if (!drm || !size)
+		return -EINVAL;
+
+	cache = &drm->bo_cache;
+	size = align(size, 4096);
+
+	bucket = drm_tegra_get_bucket(drm, size, flags);
+	if (!bucket)
+		return -EINVAL;
+
+	bos = calloc(count, sizeof(*bos));
+	if (!bos)
+		return -ENOMEM;
+
+	pthread_mutex_lock(&drm->cache_lock);
+	cached_size = cache->cached_size;
+	budget = cache->budget;
+	pthread_mutex_unlock(&drm->cache_lock);
+
+	/* prefilled BOs shall not evict each other */
+	while (num < count && cached_size + size <= budget) {
+		if (drm_tegra_bo_create(&bos[num], drm, flags, size))
+			break;
+
+		cached_size += size;
+		num++;
+	}
+
+	for (i = 0; i < num; i++) {
+		bos[i]->prefilled = true;
+		drm_tegra_bo_unref(bos[i]);
+	}
+
+	free(bos);
+
+	VDBG_DRM(drm, "prefilled %u BOs of size %u flags 0x%08X\n",
+		 num, size, flags);
+
+	return num;
+}
+
+/* NOTE: size is rounded up to page size, reused BO may be slightly larger: */
 struct drm_tegra_bo *
 drm_tegra_bo_cache_alloc(struct drm_tegra *drm,
 			 uint32_t *size, uint32_t flags)
 {
+	struct drm_tegra_bo_cache *cache = &drm->bo_cache;
 	struct drm_tegra_bo *bo = NULL;
 	struct drm_tegra_bo_bucket *bucket;
 
@@ -299,10 +593,30 @@ drm_tegra_bo_cache_alloc(struct drm_tegra *drm,
 
 	/* see if we can be green and recycle: */
 	if (bucket) {
-		*size = bucket->size;
-		bo = find_in_bucket(bucket, flags);
-		if (bo) {
+		bucket->demand++;
+
+		if (bo_sparse(drm, flags))
+			bo = find_best_fit(cache, *size, true);
+
+		/* it's fine to fall back to contiguous BO */
+		if (!bo)
+			bo = find_best_fit(cache, *size, false);
+
+		if (!bo) {
+			bucket->misses++;
+			bo_histogram_record(drm, *size, flags);
+#ifndef NDEBUG
+			if (drm->debug_bo)
+				drm->debug_bos_cache_misses++;
+#endif
+		} else {
+			bucket->hits++;
+
+			if (bo->prefilled)
+				bo_histogram_record(drm, *size, flags);
+
 			drm_tegra_reset_bo(bo, flags, false);
+			drm_tegra_bo_cache_remove(bo);
 
 			if ((flags     & DRM_TEGRA_GEM_FLAGS) !=
 			    (bo->flags & DRM_TEGRA_GEM_FLAGS))
@@ -312,8 +626,10 @@ drm_tegra_bo_cache_alloc(struct drm_tegra *drm,
 			}
 #ifndef NDEBUG
 			if (drm->debug_bo) {
-				drm->debug_bos_cached--;
-				drm->debug_bos_cached_size -= bo->size;
+				drm->debug_bos_cache_hits++;
+
+				if (bo->size == *size)
+					drm->debug_bos_cache_exact_hits++;
 			}
 #endif
 			bo->reused = true;
@@ -326,6 +642,7 @@ drm_tegra_bo_cache_alloc(struct drm_tegra *drm,
 int drm_tegra_bo_cache_free(struct drm_tegra_bo *bo)
 {
 	struct drm_tegra *drm = bo->drm;
+	struct drm_tegra_bo_cache *cache = &drm->bo_cache;
 	struct drm_tegra_bo_bucket *bucket;
 	uint32_t size = bo->size;
 
@@ -333,6 +650,10 @@ int drm_tegra_bo_cache_free(struct drm_tegra_bo *bo)
 	if (drm->debug_bo)
 		assert(DRMLISTEMPTY(&bo->bo_list));
 #endif
+	/* BO that doesn't fit into the budget can't be cached */
+	if (size > cache->budget)
+		return -1;
+
 	/* see if we can be green and recycle: */
 	bucket = drm_tegra_get_bucket(drm, size, bo->flags);
 	if (bucket) {
@@ -343,17 +664,25 @@ int drm_tegra_bo_cache_free(struct drm_tegra_bo *bo)
 		clock_gettime(CLOCK_MONOTONIC, &time);
 
 		bo->free_time = time.tv_sec;
+		bo->free_size = size;
+		bo->bucket = bucket;
 		VG_BO_RELEASE(bo);
-		drm_tegra_bo_cache_cleanup(drm, time.tv_sec);
+		__drm_tegra_bo_cache_cleanup(drm, time.tv_sec);
 		DRMLISTADDTAIL(&bo->bo_list, &bucket->list);
+		DRMLISTADDTAIL(&bo->lru_list, &cache->lru);
+		cache->cached_size += size;
+		bucket->num_entries++;
+
+		if (bo->prefilled)
+			bucket->num_prefilled++;
 #ifndef NDEBUG
 		if (drm->debug_bo) {
 			drm->debug_bos_cached++;
 			drm->debug_bos_cached_size += size;
-			DBG_BO_STATS(drm);
 		}
 #endif
-		bucket->num_entries++;
+		drm_tegra_bo_cache_trim(drm);
+		DBG_BO_STATS(drm);
 
 		return 0;
 	}
@@ -361,59 +690,67 @@ int drm_tegra_bo_cache_free(struct drm_tegra_bo *bo)
 	return -1;
 }
 
+/* Called under cache_lock */
+static void drm_tegra_bo_mmap_cache_evict(struct drm_tegra_bo *bo)
+{
+	struct drm_tegra *drm = bo->drm;
+	struct drm_tegra_bo_mmap_cache *cache = &drm->mmap_cache;
+
+	if (!RUNNING_ON_VALGRIND)
+		munmap(bo->map_cached, bo->map_cached_size);
+
+	DRMLISTDEL(&bo->mmap_list);
+	cache->mapped_size -= bo->map_cached_size;
+	cache->evicted++;
+	bo->map_cached = NULL;
+#ifndef NDEBUG
+	if (drm->debug_bo) {
+		drm->debug_bos_mapped--;
+		drm->debug_bos_mappings_cached--;
+		drm->debug_bos_total_pages -= bo->debug_size / 4096;
+		drm->debug_bos_cached_pages -= bo->debug_size / 4096;
+	}
+#endif
+}
+
+/*
+ * Unmaps least recently used mappings until cache fits the budget.
+ * Called under cache_lock
+ */
+static void drm_tegra_bo_mmap_cache_trim(struct drm_tegra *drm)
+{
+	struct drm_tegra_bo_mmap_cache *cache = &drm->mmap_cache;
+	struct drm_tegra_bo *bo;
+
+	while (cache->mapped_size > cache->budget &&
+	       !DRMLISTEMPTY(&cache->list)) {
+		bo = DRMLISTENTRY(struct drm_tegra_bo, cache->list.next,
+				  mmap_list);
+		drm_tegra_bo_mmap_cache_evict(bo);
+	}
+}
+
+/* Unmaps mappings that weren't used recently.  Called under cache_lock */
 static void
 drm_tegra_bo_mmap_cache_cleanup(struct drm_tegra *drm,
 				struct drm_tegra_bo_mmap_cache *cache,
 				time_t time)
 {
-	struct drm_tegra_bo_bucket *bucket;
 	struct drm_tegra_bo *bo, *tmp;
-	time_t delta;
 
 	if (cache->time == time)
 		return;
 
-	DRMLISTFOREACHENTRYSAFE(bo, tmp, &cache->list, mmap_list) {
-		bucket = NULL;
+	VDBG_DRM(drm, "mmap cache %uKB hits %u misses %u evicted %u\n",
+		 cache->mapped_size / 1024, cache->hits, cache->misses,
+		 cache->evicted);
 
-		delta = time - bo->unmap_time;
-
-		/* keep things in cache for at least 30 seconds: */
-		if (time && delta <= 30)
+	/* list is sorted by the unmap time, oldest mappings go first */
+	DRMLISTFOREACHENTRYSAFE(bo, tmp, &cache->list, mmap_list) {
+		if (time && time - bo->unmap_time <= BO_MMAP_CACHE_RETENTION)
 			break;
 
-		if (time) {
-			if (!DRMLISTEMPTY(&bo->bo_list))
-				VG_BO_OBTAIN(bo);
-
-			bucket = bo_bucket(bo);
-
-			if (!DRMLISTEMPTY(&bo->bo_list))
-				VG_BO_RELEASE(bo);
-
-			if (bucket && !bucket_free_up(drm, bucket, true))
-				continue;
-
-			/* keep things in cache longer if not much */
-			if (delta < 60 && bucket->num_mmap_entries < 5)
-				continue;
-		}
-
-		if (!RUNNING_ON_VALGRIND)
-			munmap(bo->map_cached, bo->offset + bo->size);
-
-		DRMLISTDEL(&bo->mmap_list);
-		bo->map_cached = NULL;
-#ifndef NDEBUG
-		if (drm->debug_bo) {
-			drm->debug_bos_mapped--;
-			drm->debug_bos_mappings_cached--;
-			drm->debug_bos_total_pages -= bo->debug_size / 4096;
-			drm->debug_bos_cached_pages -= bo->debug_size / 4096;
-		}
-#endif
-		if (bucket)
-			bucket->num_mmap_entries--;
+		drm_tegra_bo_mmap_cache_evict(bo);
 	}
 
 	cache->time = time;
@@ -423,16 +760,17 @@ void drm_tegra_bo_cache_unmap(struct drm_tegra_bo *bo)
 {
 	struct drm_tegra *drm = bo->drm;
 	struct drm_tegra_bo_mmap_cache *cache = &drm->mmap_cache;
-	struct drm_tegra_bo_bucket *bucket;
 	struct timespec time;
 
 	clock_gettime(CLOCK_MONOTONIC, &time);
 
 	bo->unmap_time = time.tv_sec;
 	bo->map_cached = bo->map;
+	bo->map_cached_size = bo->offset + bo->size;
 
 	drm_tegra_bo_mmap_cache_cleanup(drm, cache, time.tv_sec);
 	DRMLISTADDTAIL(&bo->mmap_list, &cache->list);
+	cache->mapped_size += bo->map_cached_size;
 #ifndef NDEBUG
 	if (drm->debug_bo) {
 		drm->debug_bos_mappings_cached++;
@@ -440,34 +778,33 @@ void drm_tegra_bo_cache_unmap(struct drm_tegra_bo *bo)
 	}
 #endif
 	DBG_BO(bo, "mapping added to cache\n");
-	DBG_BO_STATS(drm);
 
-	bucket = bo_bucket(bo);
-	if (bucket)
-		bucket->num_mmap_entries++;
+	drm_tegra_bo_mmap_cache_trim(drm);
+
+	DBG_BO_STATS(drm);
 }
 
+/*
+ * Takes out mapping from the cache, returns NULL if BO has no cached
+ * mapping.  Called under cache_lock
+ */
 void * drm_tegra_bo_cache_map(struct drm_tegra_bo *bo)
 {
-#ifndef NDEBUG
 	struct drm_tegra *drm = bo->drm;
-#endif
-	struct drm_tegra_bo_bucket *bucket;
+	struct drm_tegra_bo_mmap_cache *cache = &drm->mmap_cache;
 	void *map_cached = bo->map_cached;
 
-	if (map_cached) {
-		DRMLISTDEL(&bo->mmap_list);
-		bo->map_cached = NULL;
+	if (!map_cached)
+		return NULL;
+
+	DRMLISTDEL(&bo->mmap_list);
+	cache->mapped_size -= bo->map_cached_size;
+	bo->map_cached = NULL;
 #ifndef NDEBUG
-		if (drm->debug_bo) {
-			drm->debug_bos_mappings_cached--;
-			drm->debug_bos_cached_pages -= bo->debug_size / 4096;
-		}
-#endif
-		bucket = bo_bucket(bo);
-		if (bucket)
-			bucket->num_mmap_entries--;
+	if (drm->debug_bo) {
+		drm->debug_bos_mappings_cached--;
+		drm->debug_bos_cached_pages -= bo->debug_size / 4096;
 	}
-
+#endif
 	return map_cached;
 }
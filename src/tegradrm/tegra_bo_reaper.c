@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "private.h"
+
+/*
+ * Reaper releases freed BOs asynchronously.  Closing a GEM handle may
+ * be expensive, kernel tears down IOMMU/GART mappings of the buffer, which
+ * stalls the caller for a long time when many BOs are freed at once.
+ * Handles are removed from the BO tables synchronously, reaper only does
+ * the munmap() and DRM_IOCTL_GEM_CLOSE.  Handles that are waiting to be
+ * closed are still valid from the kernel's point of view, hence importers
+ * shall check whether handle given by kernel is pending for the release
+ * and wait for it to be closed.
+ */
+
+/* Called with reaper lock taken, the lock is released while releasing BOs */
+static void reaper_release(struct drm_tegra *drm,
+			   struct drm_tegra_bo_reaper *reaper)
+{
+	struct drm_tegra_bo_reaper_entry *batch = reaper->batch;
+	unsigned int i, num;
+	int err;
+
+	for (num = 0; num < ARRAY_SIZE(reaper->batch) && reaper->count; num++) {
+		batch[num] = reaper->queue[reaper->head];
+		reaper->head = (reaper->head + 1) % ARRAY_SIZE(reaper->queue);
+		reaper->count--;
+	}
+
+	reaper->num_batch = num;
+	reaper->busy = true;
+	pthread_mutex_unlock(&reaper->lock);
+
+	for (i = 0; i < num; i++) {
+		err = drm_tegra_bo_destroy(drm, batch[i].handle,
+					   batch[i].map, batch[i].map_size);
+		if (err)
+			VDBG_DRM(drm, "handle %u close failed %d (%s)\n",
+				 batch[i].handle, err, strerror(-err));
+	}
+
+	pthread_mutex_lock(&reaper->lock);
+	reaper->num_batch = 0;
+	reaper->busy = false;
+
+	/* wake up waiters of the whole queue and of a particular handle */
+	pthread_cond_broadcast(&reaper->idle_cond);
+}
+
+static void *reaper_thread(void *arg)
+{
+	struct drm_tegra *drm = arg;
+	struct drm_tegra_bo_reaper *reaper = drm->reaper;
+
+	pthread_mutex_lock(&reaper->lock);
+
+	for (;;) {
+		while (!reaper->count && !reaper->stop)
+			pthread_cond_wait(&reaper->work_cond, &reaper->lock);
+
+		if (!reaper->count)
+			break;
+
+		reaper_release(drm, reaper);
+	}
+
+	pthread_mutex_unlock(&reaper->lock);
+
+	return NULL;
+}
+
+int drm_tegra_bo_reaper_start(struct drm_tegra *drm)
+{
+	struct drm_tegra_bo_reaper *reaper;
+	sigset_t set, old;
+	int err;
+
+	if (!drm)
+		return -EINVAL;
+
+	if (drm->reaper)
+		return 0;
+
+	/* valgrind tracks mappings of BOs, keep releasing them synchronous */
+	if (RUNNING_ON_VALGRIND)
+		return -ENOTSUP;
+
+	reaper = calloc(1, sizeof(*reaper));
+	if (!reaper)
+		return -ENOMEM;
+
+	pthread_mutex_init(&reaper->lock, NULL);
+	pthread_cond_init(&reaper->work_cond, NULL);
+	pthread_cond_init(&reaper->idle_cond, NULL);
+	drm->reaper = reaper;
+
+	/* signals shall be delivered to the threads of the application */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &old);
+	err = pthread_create(&reaper->thread, NULL, reaper_thread, drm);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (err) {
+		drm->reaper = NULL;
+		pthread_cond_destroy(&reaper->idle_cond);
+		pthread_cond_destroy(&reaper->work_cond);
+		pthread_mutex_destroy(&reaper->lock);
+		free(reaper);
+		return -err;
+	}
+
+	return 0;
+}
+
+void drm_tegra_bo_reaper_stop(struct drm_tegra *drm)
+{
+	struct drm_tegra_bo_reaper *reaper = drm->reaper;
+
+	if (!reaper)
+		return;
+
+	pthread_mutex_lock(&reaper->lock);
+	reaper->stop = true;
+	pthread_cond_signal(&reaper->work_cond);
+	pthread_mutex_unlock(&reaper->lock);
+
+	/* reaper releases all queued BOs before exiting */
+	pthread_join(reaper->thread, NULL);
+
+	drm->reaper = NULL;
+	pthread_cond_destroy(&reaper->idle_cond);
+	pthread_cond_destroy(&reaper->work_cond);
+	pthread_mutex_destroy(&reaper->lock);
+	free(reaper);
+}
+
+/*
+ * Queues BO's handle and mapping for the release.  Returns false if reaper
+ * isn't running or queue is full, caller shall release BO by itself then.
+ */
+bool drm_tegra_bo_reaper_queue(struct drm_tegra *drm, uint32_t handle,
+			       void *map, size_t map_size)
+{
+	struct drm_tegra_bo_reaper *reaper = drm->reaper;
+	struct drm_tegra_bo_reaper_entry *entry;
+	bool queued = false;
+
+	if (!reaper)
+		return false;
+
+	pthread_mutex_lock(&reaper->lock);
+
+	if (reaper->count < ARRAY_SIZE(reaper->queue)) {
+		entry = &reaper->queue[(reaper->head + reaper->count) %
+				       ARRAY_SIZE(reaper->queue)];
+		entry->handle = handle;
+		entry->map = map;
+		entry->map_size = map_size;
+
+		if (!reaper->count++)
+			pthread_cond_signal(&reaper->work_cond);
+
+		queued = true;
+	}
+
+	pthread_mutex_unlock(&reaper->lock);
+
+	return queued;
+}
+
+/*
+ * Waits for all queued BOs to be released.  Returns true if there was
+ * anything to wait for.
+ */
+bool drm_tegra_bo_reaper_flush(struct drm_tegra *drm)
+{
+	struct drm_tegra_bo_reaper *reaper = drm->reaper;
+	bool pending;
+
+	if (!reaper)
+		return false;
+
+	pthread_mutex_lock(&reaper->lock);
+
+	pending = reaper->count || reaper->busy;
+
+	while (reaper->count || reaper->busy)
+		pthread_cond_wait(&reaper->idle_cond, &reaper->lock);
+
+	pthread_mutex_unlock(&reaper->lock);
+
+	return pending;
+}
+
+/* Called with reaper lock taken */
+static bool reaper_pending(struct drm_tegra_bo_reaper *reaper,
+			   uint32_t handle)
+{
+	unsigned int i;
+
+	for (i = 0; i < reaper->num_batch; i++) {
+		if (reaper->batch[i].handle == handle)
+			return true;
+	}
+
+	for (i = 0; i < reaper->count; i++) {
+		if (reaper->queue[(reaper->head + i) %
+				  ARRAY_SIZE(reaper->queue)].handle == handle)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Waits for the release of the handle if it's queued, the rest of queue
+ * isn't waited for.  Returns true if handle was pending, it's closed now.
+ */
+bool drm_tegra_bo_reaper_flush_handle(struct drm_tegra *drm, uint32_t handle)
+{
+	struct drm_tegra_bo_reaper *reaper = drm->reaper;
+	bool pending;
+
+	if (!reaper)
+		return false;
+
+	pthread_mutex_lock(&reaper->lock);
+
+	pending = reaper_pending(reaper, handle);
+
+	while (reaper_pending(reaper, handle))
+		pthread_cond_wait(&reaper->idle_cond, &reaper->lock);
+
+	pthread_mutex_unlock(&reaper->lock);
+
+	return pending;
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "private.h"
+
+/*
+ * BO tables map GEM handles and flink names to BOs. Table is split into
+ * shards, each shard is an open-addressing hash table with linear probing
+ * that is protected by its own read-write lock. Lookups only take the read
+ * lock of a single shard and thus don't contend with each other.
+ */
+
+#define BO_TABLE_SHARD_MIN_SIZE	16
+#define BO_TABLE_TOMBSTONE	((struct drm_tegra_bo *) 1)
+
+static inline uint32_t bo_table_hash(uint32_t key)
+{
+	return key * 2654435761u;
+}
+
+int drm_tegra_bo_table_init(struct drm_tegra_bo_table *table)
+{
+	struct drm_tegra_bo_table_shard *shard;
+	unsigned int i;
+
+	for (i = 0; i < DRM_TEGRA_BO_TABLE_SHARDS; i++) {
+		shard = &table->shards[i];
+
+		shard->entries = calloc(BO_TABLE_SHARD_MIN_SIZE,
+					sizeof(*shard->entries));
+		if (!shard->entries)
+			goto err_free;
+
+		pthread_rwlock_init(&shard->lock, NULL);
+		shard->size = BO_TABLE_SHARD_MIN_SIZE;
+		shard->used = 0;
+		shard->live = 0;
+	}
+
+	return 0;
+
+err_free:
+	while (i--) {
+		shard = &table->shards[i];
+
+		pthread_rwlock_destroy(&shard->lock);
+		free(shard->entries);
+		shard->entries = NULL;
+	}
+
+	return -ENOMEM;
+}
+
+void drm_tegra_bo_table_fini(struct drm_tegra_bo_table *table)
+{
+	struct drm_tegra_bo_table_shard *shard;
+	unsigned int i;
+
+	for (i = 0; i < DRM_TEGRA_BO_TABLE_SHARDS; i++) {
+		shard = &table->shards[i];
+
+		if (!shard->entries)
+			continue;
+
+		pthread_rwlock_destroy(&shard->lock);
+		free(shard->entries);
+		shard->entries = NULL;
+	}
+}
+
+struct drm_tegra_bo_table_shard *
+drm_tegra_bo_table_shard(struct drm_tegra_bo_table *table, uint32_t key)
+{
+	uint32_t hash = bo_table_hash(key);
+
+	return &table->shards[hash >> (32 - DRM_TEGRA_BO_TABLE_SHARDS_SHIFT)];
+}
+
+/* Call with shard lock taken */
+struct drm_tegra_bo *
+drm_tegra_bo_table_lookup(struct drm_tegra_bo_table_shard *shard,
+			  uint32_t key)
+{
+	struct drm_tegra_bo_table_slot *entry;
+	uint32_t mask = shard->size - 1;
+	uint32_t i = bo_table_hash(key) & mask;
+
+	for (;;) {
+		entry = &shard->entries[i];
+
+		if (!entry->bo)
+			return NULL;
+
+		if (entry->bo != BO_TABLE_TOMBSTONE && entry->key == key)
+			return entry->bo;
+
+		i = (i + 1) & mask;
+	}
+}
+
+static int bo_table_resize(struct drm_tegra_bo_table_shard *shard,
+			   uint32_t size)
+{
+	struct drm_tegra_bo_table_slot *entries, *old = shard->entries;
+	uint32_t mask = size - 1;
+	uint32_t i, k, used = 0;
+
+	entries = calloc(size, sizeof(*entries));
+	if (!entries)
+		return -ENOMEM;
+
+	/* tombstones are dropped during rehashing */
+	for (i = 0; i < shard->size; i++) {
+		if (!old[i].bo || old[i].bo == BO_TABLE_TOMBSTONE)
+			continue;
+
+		k = bo_table_hash(old[i].key) & mask;
+
+		while (entries[k].bo)
+			k = (k + 1) & mask;
+
+		entries[k] = old[i];
+		used++;
+	}
+
+	shard->entries = entries;
+	shard->size = size;
+	shard->used = used;
+	shard->live = used;
+	free(old);
+
+	return 0;
+}
+
+/* Call with shard lock taken for writing */
+int drm_tegra_bo_table_insert(struct drm_tegra_bo_table_shard *shard,
+			      uint32_t key, struct drm_tegra_bo *bo)
+{
+	struct drm_tegra_bo_table_slot *entry;
+	uint32_t mask, size, i;
+	int err;
+
+	if (drm_tegra_bo_table_lookup(shard, key))
+		return -EEXIST;
+
+	/* keep at least a quarter of entries empty to keep probing short */
+	if ((shard->used + 1) * 4 > shard->size * 3) {
+		size = shard->size;
+
+		/* table may be just polluted by tombstones */
+		if ((shard->live + 1) * 2 > size)
+			size *= 2;
+
+		err = bo_table_resize(shard, size);
+		if (err)
+			return err;
+	}
+
+	mask = shard->size - 1;
+	i = bo_table_hash(key) & mask;
+
+	for (;;) {
+		entry = &shard->entries[i];
+
+		if (!entry->bo || entry->bo == BO_TABLE_TOMBSTONE)
+			break;
+
+		i = (i + 1) & mask;
+	}
+
+	if (!entry->bo)
+		shard->used++;
+
+	entry->key = key;
+	entry->bo = bo;
+	shard->live++;
+
+	return 0;
+}
+
+/* Call with shard lock taken for writing */
+void drm_tegra_bo_table_remove(struct drm_tegra_bo_table_shard *shard,
+			       uint32_t key, struct drm_tegra_bo *bo)
+{
+	struct drm_tegra_bo_table_slot *entry;
+	uint32_t mask = shard->size - 1;
+	uint32_t i = bo_table_hash(key) & mask;
+
+	for (;;) {
+		entry = &shard->entries[i];
+
+		if (!entry->bo)
+			return;
+
+		if (entry->bo == bo && entry->key == key) {
+			entry->bo = BO_TABLE_TOMBSTONE;
+			shard->live--;
+			return;
+		}
+
+		i = (i + 1) & mask;
+	}
+}
@@ -0,0 +1,798 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "private.h"
+
+/*
+ * Mock device emulates the upstream Tegra DRM UAPI in userspace, it is
+ * created by drm_tegra_new() for the DRM_TEGRA_MOCK_FD and allows to run
+ * BO management, job submission and fencing without Tegra hardware.
+ *
+ * Only the v1 job UAPI (DRM_TEGRA_SUBMIT with syncpoint fences) is
+ * emulated. The GRATE v2 submission and the v3 channel / syncobj UAPI are
+ * not, mock reports DRM version 1 and thus streams fall back to v1. Mock
+ * is linked only into tegra_replay and the check programs, the driver is
+ * built without it (HAVE_TEGRA_MOCK).
+ *
+ * GEM objects are backed by anonymous memory files. Jobs are accepted
+ * and validated, but not executed. Every channel has its own syncpoint,
+ * jobs of a channel complete in order after the programmable latency.
+ * Latency is set by drm_tegra_mock_set_latency() or by the
+ * LIBDRM_TEGRA_MOCK_LATENCY_US environment variable.
+ */
+
+#define MOCK_CHANNELS		32
+#define MOCK_PENDING_JOBS	64
+#define MOCK_MMAP_SHIFT		12
+
+struct mock_gem {
+	int fd;			/* -1 if handle is free */
+	uint32_t size;
+	uint32_t flags;
+	uint32_t name;
+	uint32_t tiling_mode;
+	uint32_t tiling_value;
+	uint32_t next_free;
+
+	/* the last job that used GEM */
+	uint32_t syncpt;
+	uint32_t thresh;
+};
+
+struct mock_job {
+	uint32_t thresh;
+	uint64_t deadline;
+};
+
+struct mock_syncpt {
+	bool used;
+	uint32_t client;
+	uint32_t value;
+	uint32_t max;
+
+	/* pending jobs, sorted by deadline */
+	struct mock_job jobs[MOCK_PENDING_JOBS];
+	unsigned int head;
+	unsigned int count;
+};
+
+struct drm_tegra_mock {
+	pthread_mutex_t lock;
+
+	struct mock_gem *gems;
+	uint32_t num_gems;
+	uint32_t free_gem;	/* head of free handles list, 0 if empty */
+	uint32_t next_name;
+
+	struct mock_syncpt syncpts[MOCK_CHANNELS];
+
+	uint32_t latency_us;
+
+	uint64_t submitted_jobs;
+	uint64_t submitted_words;
+};
+
+static uint64_t mock_time_us(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return time.tv_sec * 1000000ull + time.tv_nsec / 1000;
+}
+
+static void mock_sleep_us(uint64_t us)
+{
+	struct timespec time;
+
+	time.tv_sec = us / 1000000;
+	time.tv_nsec = (us % 1000000) * 1000;
+
+	while (nanosleep(&time, &time) < 0 && errno == EINTR)
+		;
+}
+
+static inline bool mock_thresh_reached(uint32_t value, uint32_t thresh)
+{
+	return (int32_t)(value - thresh) >= 0;
+}
+
+static struct mock_gem *mock_gem(struct drm_tegra_mock *mock, uint32_t handle)
+{
+	if (!handle || handle > mock->num_gems)
+		return NULL;
+
+	if (mock->gems[handle - 1].fd < 0)
+		return NULL;
+
+	return &mock->gems[handle - 1];
+}
+
+static int mock_gem_add(struct drm_tegra_mock *mock, int fd, uint32_t size,
+			uint32_t *handle)
+{
+	struct mock_gem *gems, *gem;
+	uint32_t i, num;
+
+	if (!mock->free_gem) {
+		num = mock->num_gems ? mock->num_gems * 2 : 64;
+
+		gems = realloc(mock->gems, num * sizeof(*gems));
+		if (!gems)
+			return -ENOMEM;
+
+		for (i = mock->num_gems; i < num; i++) {
+			gems[i].fd = -1;
+			gems[i].next_free = i + 2;
+		}
+		gems[num - 1].next_free = 0;
+
+		mock->free_gem = mock->num_gems + 1;
+		mock->num_gems = num;
+		mock->gems = gems;
+	}
+
+	*handle = mock->free_gem;
+	gem = &mock->gems[*handle - 1];
+	mock->free_gem = gem->next_free;
+
+	memset(gem, 0, sizeof(*gem));
+	gem->fd = fd;
+	gem->size = size;
+
+	return 0;
+}
+
+static void mock_gem_del(struct drm_tegra_mock *mock, uint32_t handle)
+{
+	struct mock_gem *gem = &mock->gems[handle - 1];
+
+	close(gem->fd);
+	gem->fd = -1;
+	gem->next_free = mock->free_gem;
+	mock->free_gem = handle;
+}
+
+/* retires jobs whose time has come, returns the current syncpoint value */
+static uint32_t mock_syncpt_update(struct mock_syncpt *syncpt, uint64_t time)
+{
+	struct mock_job *job;
+
+	while (syncpt->count) {
+		job = &syncpt->jobs[syncpt->head];
+
+		if (job->deadline > time)
+			break;
+
+		syncpt->value = job->thresh;
+		syncpt->head = (syncpt->head + 1) % MOCK_PENDING_JOBS;
+		syncpt->count--;
+	}
+
+	return syncpt->value;
+}
+
+/* returns time when syncpoint reaches the threshold */
+static uint64_t mock_syncpt_deadline(struct mock_syncpt *syncpt,
+				     uint32_t thresh)
+{
+	struct mock_job *job;
+	unsigned int i;
+
+	for (i = 0; i < syncpt->count; i++) {
+		job = &syncpt->jobs[(syncpt->head + i) % MOCK_PENDING_JOBS];
+
+		if (mock_thresh_reached(job->thresh, thresh))
+			return job->deadline;
+	}
+
+	return 0;
+}
+
+/*
+ * Waits for the syncpoint threshold, timeout is in microseconds.
+ * Called with mock lock taken, the lock is released while sleeping.
+ */
+static int mock_syncpt_wait(struct drm_tegra_mock *mock, uint32_t id,
+			    uint32_t thresh, uint64_t timeout,
+			    uint32_t *value)
+{
+	struct mock_syncpt *syncpt = &mock->syncpts[id];
+	uint64_t time = mock_time_us();
+	uint64_t end = time + timeout;
+	uint64_t deadline;
+
+	while (!mock_thresh_reached(mock_syncpt_update(syncpt, time), thresh)) {
+		if (time >= end)
+			return -EAGAIN;
+
+		/* threshold that is never reached should time out */
+		deadline = mock_syncpt_deadline(syncpt, thresh);
+		if (!deadline || deadline > end)
+			deadline = end;
+
+		pthread_mutex_unlock(&mock->lock);
+		mock_sleep_us(deadline - time);
+		pthread_mutex_lock(&mock->lock);
+
+		time = mock_time_us();
+	}
+
+	if (value)
+		*value = syncpt->value;
+
+	return 0;
+}
+
+static int mock_syncpt_get(struct drm_tegra_mock *mock, uint64_t context,
+			   struct mock_syncpt **syncpt)
+{
+	if (!context || context > MOCK_CHANNELS)
+		return -EINVAL;
+
+	if (!mock->syncpts[context - 1].used)
+		return -EINVAL;
+
+	*syncpt = &mock->syncpts[context - 1];
+
+	return 0;
+}
+
+static int mock_gem_create(struct drm_tegra_mock *mock,
+			   struct drm_tegra_gem_create *args)
+{
+	uint32_t size;
+	int err, fd;
+
+	if (!args->size || args->size > UINT32_MAX - 4095)
+		return -EINVAL;
+
+	size = align(args->size, 4096);
+
+	fd = memfd_create("tegra-mock-bo", MFD_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	if (ftruncate(fd, size) < 0) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+
+	err = mock_gem_add(mock, fd, size, &args->handle);
+	if (err) {
+		close(fd);
+		return err;
+	}
+
+	mock->gems[args->handle - 1].flags = args->flags;
+
+	return 0;
+}
+
+static int mock_submit(struct drm_tegra_mock *mock,
+		       struct drm_tegra_submit *args)
+{
+	struct drm_tegra_syncpt *syncpts = (void *)(uintptr_t)args->syncpts;
+	struct drm_tegra_cmdbuf *cmdbufs = (void *)(uintptr_t)args->cmdbufs;
+	struct drm_tegra_reloc *relocs = (void *)(uintptr_t)args->relocs;
+	struct mock_syncpt *syncpt;
+	struct mock_gem *gem;
+	struct mock_job *job;
+	uint32_t id, incrs;
+	uint64_t time;
+	unsigned int i;
+	int err;
+
+	err = mock_syncpt_get(mock, args->context, &syncpt);
+	if (err)
+		return err;
+
+	id = args->context - 1;
+
+	/* channel has a single syncpoint */
+	if (args->num_syncpts != 1 || syncpts[0].id != id)
+		return -EINVAL;
+
+	incrs = syncpts[0].incrs;
+
+	for (i = 0; i < args->num_cmdbufs; i++) {
+		gem = mock_gem(mock, cmdbufs[i].handle);
+		if (!gem || cmdbufs[i].offset + cmdbufs[i].words * 4 > gem->size)
+			return -EINVAL;
+
+		mock->submitted_words += cmdbufs[i].words;
+	}
+
+	for (i = 0; i < args->num_relocs; i++) {
+		if (!mock_gem(mock, relocs[i].cmdbuf.handle))
+			return -ENOENT;
+
+		gem = mock_gem(mock, relocs[i].target.handle);
+		if (!gem)
+			return -ENOENT;
+
+		if (relocs[i].target.offset >= gem->size)
+			return -EINVAL;
+	}
+
+	time = mock_time_us();
+	mock_syncpt_update(syncpt, time);
+
+	/* hardware queue is full, wait for the oldest job */
+	if (syncpt->count == MOCK_PENDING_JOBS) {
+		job = &syncpt->jobs[syncpt->head];
+		mock_syncpt_wait(mock, id, job->thresh, UINT32_MAX, NULL);
+		time = mock_time_us();
+	}
+
+	/* jobs are executed one after another */
+	if (syncpt->count) {
+		job = &syncpt->jobs[(syncpt->head + syncpt->count - 1) %
+				    MOCK_PENDING_JOBS];
+		if (job->deadline > time)
+			time = job->deadline;
+	}
+
+	syncpt->max += incrs;
+
+	job = &syncpt->jobs[(syncpt->head + syncpt->count) % MOCK_PENDING_JOBS];
+	job->thresh = syncpt->max;
+	job->deadline = time + mock->latency_us;
+	syncpt->count++;
+
+	for (i = 0; i < args->num_relocs; i++) {
+		gem = mock_gem(mock, relocs[i].target.handle);
+		gem->syncpt = id;
+		gem->thresh = syncpt->max;
+	}
+
+	args->fence = syncpt->max;
+	mock->submitted_jobs++;
+
+	return 0;
+}
+
+static int mock_cpu_prep(struct drm_tegra_mock *mock,
+			 struct drm_tegra_gem_cpu_prep *args)
+{
+	struct mock_gem *gem = mock_gem(mock, args->handle);
+	int err;
+
+	if (!gem)
+		return -ENOENT;
+
+	if (!gem->thresh || !mock->syncpts[gem->syncpt].used)
+		return 0;
+
+	err = mock_syncpt_wait(mock, gem->syncpt, gem->thresh,
+			       args->timeout, NULL);
+	if (err)
+		return args->timeout ? -ETIMEDOUT : -EBUSY;
+
+	return 0;
+}
+
+static int mock_command(struct drm_tegra_mock *mock, unsigned long index,
+			void *data)
+{
+	struct mock_syncpt *syncpt;
+	struct mock_gem *gem;
+	unsigned int i;
+	int err;
+
+	switch (index) {
+	case DRM_TEGRA_GEM_CREATE:
+		return mock_gem_create(mock, data);
+
+	case DRM_TEGRA_GEM_MMAP: {
+		struct drm_tegra_gem_mmap *args = data;
+
+		if (!mock_gem(mock, args->handle))
+			return -EINVAL;
+
+		args->offset = (uint64_t)args->handle << MOCK_MMAP_SHIFT;
+
+		return 0;
+	}
+
+	case DRM_TEGRA_SYNCPT_READ: {
+		struct drm_tegra_syncpt_read *args = data;
+
+		if (args->id >= MOCK_CHANNELS || !mock->syncpts[args->id].used)
+			return -EINVAL;
+
+		args->value = mock_syncpt_update(&mock->syncpts[args->id],
+						 mock_time_us());
+		return 0;
+	}
+
+	case DRM_TEGRA_SYNCPT_WAIT: {
+		struct drm_tegra_syncpt_wait *args = data;
+		uint64_t timeout = args->timeout;
+
+		if (args->id >= MOCK_CHANNELS || !mock->syncpts[args->id].used)
+			return -EINVAL;
+
+		if (args->timeout != DRM_TEGRA_NO_TIMEOUT)
+			timeout *= 1000;
+
+		return mock_syncpt_wait(mock, args->id, args->thresh, timeout,
+					&args->value);
+	}
+
+	case DRM_TEGRA_OPEN_CHANNEL: {
+		struct drm_tegra_open_channel *args = data;
+
+		for (i = 0; i < MOCK_CHANNELS; i++) {
+			syncpt = &mock->syncpts[i];
+
+			if (syncpt->used)
+				continue;
+
+			/* syncpoint value persists, like in hardware */
+			syncpt->used = true;
+			syncpt->client = args->client;
+
+			args->context = i + 1;
+			args->flags_out = 0;
+
+			return 0;
+		}
+
+		return -EBUSY;
+	}
+
+	case DRM_TEGRA_CLOSE_CHANNEL: {
+		struct drm_tegra_close_channel *args = data;
+
+		err = mock_syncpt_get(mock, args->context, &syncpt);
+		if (err)
+			return err;
+
+		/* channel is closed once all jobs are completed */
+		mock_syncpt_wait(mock, args->context - 1, syncpt->max,
+				 UINT32_MAX, NULL);
+		syncpt->used = false;
+
+		return 0;
+	}
+
+	case DRM_TEGRA_GET_SYNCPT: {
+		struct drm_tegra_get_syncpt *args = data;
+
+		err = mock_syncpt_get(mock, args->context, &syncpt);
+		if (err)
+			return err;
+
+		if (args->index)
+			return -EINVAL;
+
+		args->id = args->context - 1;
+
+		return 0;
+	}
+
+	case DRM_TEGRA_SUBMIT:
+		return mock_submit(mock, data);
+
+	case DRM_TEGRA_GEM_SET_TILING: {
+		struct drm_tegra_gem_set_tiling *args = data;
+
+		gem = mock_gem(mock, args->handle);
+		if (!gem)
+			return -ENOENT;
+
+		gem->tiling_mode = args->mode;
+		gem->tiling_value = args->value;
+
+		return 0;
+	}
+
+	case DRM_TEGRA_GEM_GET_TILING: {
+		struct drm_tegra_gem_get_tiling *args = data;
+
+		gem = mock_gem(mock, args->handle);
+		if (!gem)
+			return -ENOENT;
+
+		args->mode = gem->tiling_mode;
+		args->value = gem->tiling_value;
+
+		return 0;
+	}
+
+	case DRM_TEGRA_GEM_SET_FLAGS: {
+		struct drm_tegra_gem_set_flags *args = data;
+
+		gem = mock_gem(mock, args->handle);
+		if (!gem)
+			return -ENOENT;
+
+		gem->flags = args->flags;
+
+		return 0;
+	}
+
+	case DRM_TEGRA_GEM_GET_FLAGS: {
+		struct drm_tegra_gem_get_flags *args = data;
+
+		gem = mock_gem(mock, args->handle);
+		if (!gem)
+			return -ENOENT;
+
+		args->flags = gem->flags;
+
+		return 0;
+	}
+
+	case DRM_TEGRA_GEM_CPU_PREP:
+		return mock_cpu_prep(mock, data);
+	}
+
+	return -ENOTTY;
+}
+
+static int mock_ioctl(struct drm_tegra_mock *mock, unsigned long request,
+		      void *arg)
+{
+	struct mock_gem *gem;
+	uint32_t i;
+	int fd;
+
+	switch (request) {
+	case DRM_IOCTL_GEM_CLOSE: {
+		struct drm_gem_close *args = arg;
+
+		if (!mock_gem(mock, args->handle))
+			return -EINVAL;
+
+		mock_gem_del(mock, args->handle);
+
+		return 0;
+	}
+
+	case DRM_IOCTL_GEM_FLINK: {
+		struct drm_gem_flink *args = arg;
+
+		gem = mock_gem(mock, args->handle);
+		if (!gem)
+			return -ENOENT;
+
+		if (!gem->name)
+			gem->name = ++mock->next_name;
+
+		args->name = gem->name;
+
+		return 0;
+	}
+
+	case DRM_IOCTL_GEM_OPEN: {
+		struct drm_gem_open *args = arg;
+
+		for (i = 0; i < mock->num_gems; i++) {
+			gem = &mock->gems[i];
+
+			if (gem->fd < 0 || gem->name != args->name)
+				continue;
+
+			fd = fcntl(gem->fd, F_DUPFD_CLOEXEC, 0);
+			if (fd < 0)
+				return -errno;
+
+			/* like kernel, give out a new handle */
+			args->size = gem->size;
+
+			return mock_gem_add(mock, fd, args->size, &args->handle);
+		}
+
+		return -ENOENT;
+	}
+	}
+
+	return -ENOTTY;
+}
+
+int drm_tegra_mock_command(struct drm_tegra *drm, unsigned long index,
+			   void *data, unsigned long size)
+{
+	struct drm_tegra_mock *mock = drm->mock;
+	int err;
+
+	pthread_mutex_lock(&mock->lock);
+	err = mock_command(mock, index, data);
+	pthread_mutex_unlock(&mock->lock);
+
+	return err;
+}
+
+/* behaves like drmIoctl(), errors are returned via errno */
+int drm_tegra_mock_ioctl(struct drm_tegra *drm, unsigned long request,
+			 void *arg)
+{
+	struct drm_tegra_mock *mock = drm->mock;
+	int err;
+
+	pthread_mutex_lock(&mock->lock);
+	err = mock_ioctl(mock, request, arg);
+	pthread_mutex_unlock(&mock->lock);
+
+	if (err) {
+		errno = -err;
+		return -1;
+	}
+
+	return 0;
+}
+
+void *drm_tegra_mock_mmap(struct drm_tegra *drm, size_t size, uint64_t offset)
+{
+	struct drm_tegra_mock *mock = drm->mock;
+	struct mock_gem *gem;
+	void *map = MAP_FAILED;
+
+	pthread_mutex_lock(&mock->lock);
+
+	gem = mock_gem(mock, offset >> MOCK_MMAP_SHIFT);
+	if (!gem || size > gem->size)
+		errno = EINVAL;
+	else
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			   gem->fd, 0);
+
+	pthread_mutex_unlock(&mock->lock);
+
+	return map;
+}
+
+int drm_tegra_mock_prime_handle_to_fd(struct drm_tegra *drm, uint32_t handle,
+				      int *prime_fd)
+{
+	struct drm_tegra_mock *mock = drm->mock;
+	struct mock_gem *gem;
+	int err = 0;
+
+	pthread_mutex_lock(&mock->lock);
+
+	gem = mock_gem(mock, handle);
+	if (!gem) {
+		err = -ENOENT;
+	} else {
+		*prime_fd = fcntl(gem->fd, F_DUPFD_CLOEXEC, 0);
+		if (*prime_fd < 0)
+			err = -errno;
+	}
+
+	pthread_mutex_unlock(&mock->lock);
+
+	return err;
+}
+
+int drm_tegra_mock_prime_fd_to_handle(struct drm_tegra *drm, int prime_fd,
+				      uint32_t *handle)
+{
+	struct drm_tegra_mock *mock = drm->mock;
+	struct stat st, gem_st;
+	struct mock_gem *gem;
+	int err = 0, fd;
+	uint32_t i;
+
+	if (fstat(prime_fd, &st) < 0)
+		return -errno;
+
+	pthread_mutex_lock(&mock->lock);
+
+	/* like kernel, return the same handle for the same object */
+	for (i = 0; i < mock->num_gems; i++) {
+		gem = &mock->gems[i];
+
+		if (gem->fd < 0 || fstat(gem->fd, &gem_st) < 0)
+			continue;
+
+		if (gem_st.st_dev == st.st_dev && gem_st.st_ino == st.st_ino) {
+			*handle = i + 1;
+			goto unlock;
+		}
+	}
+
+	fd = fcntl(prime_fd, F_DUPFD_CLOEXEC, 0);
+	if (fd < 0) {
+		err = -errno;
+		goto unlock;
+	}
+
+	err = mock_gem_add(mock, fd, st.st_size, handle);
+	if (err)
+		close(fd);
+unlock:
+	pthread_mutex_unlock(&mock->lock);
+
+	return err;
+}
+
+int drm_tegra_mock_set_latency(struct drm_tegra *drm, unsigned int latency_us)
+{
+	if (!drm || !drm->mock)
+		return -EINVAL;
+
+	pthread_mutex_lock(&drm->mock->lock);
+	drm->mock->latency_us = latency_us;
+	pthread_mutex_unlock(&drm->mock->lock);
+
+	return 0;
+}
+
+int drm_tegra_mock_init(struct drm_tegra *drm)
+{
+	struct drm_tegra_mock *mock;
+	char *str;
+
+	mock = calloc(1, sizeof(*mock));
+	if (!mock)
+		return -ENOMEM;
+
+	str = getenv("LIBDRM_TEGRA_MOCK_LATENCY_US");
+	if (str)
+		mock->latency_us = strtoul(str, NULL, 0);
+
+	pthread_mutex_init(&mock->lock, NULL);
+	drm->mock = mock;
+
+	return 0;
+}
+
+void drm_tegra_mock_fini(struct drm_tegra *drm)
+{
+	struct drm_tegra_mock *mock = drm->mock;
+	uint32_t i;
+
+	if (!mock)
+		return;
+
+	VDBG_DRM(drm, "jobs submitted %" PRIu64 " words %" PRIu64 "\n",
+		 mock->submitted_jobs, mock->submitted_words);
+
+	for (i = 0; i < mock->num_gems; i++) {
+		if (mock->gems[i].fd >= 0)
+			close(mock->gems[i].fd);
+	}
+
+	pthread_mutex_destroy(&mock->lock);
+	free(mock->gems);
+	free(mock);
+
+	drm->mock = NULL;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Check of the library against the mock device: BO allocation, mapping,
+ * dma-buf round trip, a v1 job submission that is fenced by the mock
+ * syncpoint and import of a BO that is queued for the async release.  The v2 and v3 job UAPIs aren't emulated by the mock, hence
+ * they aren't covered here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "opentegra_lib.h"
+
+#include "host1x.h"
+
+#define MOCK_LATENCY_US		20000
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: check failed: %s\n",	\
+				__FILE__, __LINE__, #cond);		\
+			exit(EXIT_FAILURE);				\
+		}							\
+	} while (0)
+
+static void check_bo(struct drm_tegra *drm)
+{
+	struct drm_tegra_bo *bo, *imported;
+	uint32_t size, prime_fd;
+	uint8_t *map;
+
+	CHECK(drm_tegra_bo_new(&bo, drm, 0, 8192) == 0);
+	CHECK(drm_tegra_bo_get_size(bo, &size) == 0 && size >= 8192);
+
+	CHECK(drm_tegra_bo_map(bo, (void **)&map) == 0);
+	memset(map, 0x5a, size);
+	CHECK(drm_tegra_bo_unmap(bo) == 0);
+
+	/* import of own dma-buf gives back the same BO */
+	CHECK(drm_tegra_bo_to_dmabuf(bo, &prime_fd) == 0);
+	CHECK(drm_tegra_bo_from_dmabuf(&imported, drm, prime_fd, 0) == 0);
+	CHECK(imported == bo);
+	close(prime_fd);
+
+	CHECK(drm_tegra_bo_map(imported, (void **)&map) == 0);
+	CHECK(map[0] == 0x5a && map[size - 1] == 0x5a);
+	CHECK(drm_tegra_bo_unmap(imported) == 0);
+
+	drm_tegra_bo_unref(imported);
+	drm_tegra_bo_unref(bo);
+}
+
+/* importing dma-buf of a BO that is queued for the release */
+static void check_reaper(struct drm_tegra *drm)
+{
+	struct drm_tegra_bo *bo;
+	uint32_t prime_fd;
+	uint8_t *map;
+
+	CHECK(drm_tegra_bo_reaper_start(drm) == 0);
+
+	CHECK(drm_tegra_bo_new(&bo, drm, 0, 4096) == 0);
+	CHECK(drm_tegra_bo_forbid_caching(bo) == 0);
+	CHECK(drm_tegra_bo_map(bo, (void **)&map) == 0);
+	memset(map, 0xa5, 4096);
+	CHECK(drm_tegra_bo_to_dmabuf(bo, &prime_fd) == 0);
+	drm_tegra_bo_unref(bo);
+
+	CHECK(drm_tegra_bo_from_dmabuf(&bo, drm, prime_fd, 0) == 0);
+	close(prime_fd);
+
+	CHECK(drm_tegra_bo_map(bo, (void **)&map) == 0);
+	CHECK(map[0] == 0xa5 && map[4095] == 0xa5);
+	drm_tegra_bo_unref(bo);
+}
+
+static void check_submit(struct drm_tegra *drm)
+{
+	struct drm_tegra_channel *channel;
+	struct drm_tegra_pushbuf *pushbuf;
+	struct drm_tegra_fence *fence;
+	struct drm_tegra_job *job;
+	struct drm_tegra_bo *bo;
+
+	CHECK(drm_tegra_mock_set_latency(drm, MOCK_LATENCY_US) == 0);
+	CHECK(drm_tegra_bo_new(&bo, drm, 0, 4096) == 0);
+
+	CHECK(drm_tegra_channel_open(&channel, drm, DRM_TEGRA_GR2D) == 0);
+	CHECK(drm_tegra_job_new(&job, channel) == 0);
+	CHECK(drm_tegra_pushbuf_new(&pushbuf, job) == 0);
+
+	/* mock doesn't execute jobs, content of the job is arbitrary */
+	CHECK(drm_tegra_pushbuf_prepare(pushbuf, 1) == 0);
+	*pushbuf->ptr++ = HOST1X_OPCODE_NONINCR(0x2b, 1);
+	CHECK(drm_tegra_pushbuf_relocate(pushbuf, bo, 0, 0) == 0);
+	CHECK(drm_tegra_pushbuf_sync(pushbuf,
+				     DRM_TEGRA_SYNCPT_COND_OP_DONE) == 0);
+
+	CHECK(drm_tegra_job_submit(job, &fence) == 0);
+
+	/* job completes only after the programmed latency */
+	CHECK(drm_tegra_fence_is_busy(fence));
+	CHECK(drm_tegra_bo_cpu_prep(bo, 0, 0) != 0);
+
+	CHECK(drm_tegra_fence_wait(fence) == 0);
+	CHECK(!drm_tegra_fence_is_busy(fence));
+	CHECK(drm_tegra_bo_cpu_prep(bo, 0, 0) == 0);
+
+	drm_tegra_fence_free(fence);
+	drm_tegra_job_free(job);
+	drm_tegra_channel_close(channel);
+	drm_tegra_bo_unref(bo);
+}
+
+int main(void)
+{
+	struct drm_tegra *drm;
+
+	CHECK(drm_tegra_new(&drm, DRM_TEGRA_MOCK_FD) == 0);
+
+	check_bo(drm);
+	check_submit(drm);
+	check_reaper(drm);
+
+	drm_tegra_close(drm);
+
+	return EXIT_SUCCESS;
+}
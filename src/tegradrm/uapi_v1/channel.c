@@ -43,8 +43,8 @@ static int drm_tegra_channel_setup(struct drm_tegra_channel *channel)
 	args.context = channel->context;
 	args.index = 0;
 
-	err = drmCommandWriteRead(drm->fd, DRM_TEGRA_GET_SYNCPT, &args,
-				  sizeof(args));
+	err = drm_tegra_command(drm, DRM_TEGRA_GET_SYNCPT, &args,
+				sizeof(args));
 	if (err < 0)
 		return err;
 
@@ -87,8 +87,8 @@ int drm_tegra_channel_open_v1(struct drm_tegra_channel **channelp,
 	memset(&args, 0, sizeof(args));
 	args.client = class;
 
-	err = drmCommandWriteRead(drm->fd, DRM_TEGRA_OPEN_CHANNEL, &args,
-				  sizeof(args));
+	err = drm_tegra_command(drm, DRM_TEGRA_OPEN_CHANNEL, &args,
+				sizeof(args));
 	if (err < 0) {
 		free(channel);
 		return err;
@@ -123,8 +123,8 @@ int drm_tegra_channel_close_v1(struct drm_tegra_channel *channel)
 	memset(&args, 0, sizeof(args));
 	args.context = channel->context;
 
-	err = drmCommandWriteRead(drm->fd, DRM_TEGRA_CLOSE_CHANNEL, &args,
-				  sizeof(args));
+	err = drm_tegra_command(drm, DRM_TEGRA_CLOSE_CHANNEL, &args,
+				sizeof(args));
 	if (err < 0)
 		return err;
 
@@ -46,6 +46,10 @@ int drm_tegra_fence_is_busy_v1(struct drm_tegra_fence *fence)
 	args.id = fence->syncpt;
 	args.thresh = fence->value;
 
+	if (fence->drm->mock)
+		return drm_tegra_command(fence->drm, DRM_TEGRA_SYNCPT_WAIT,
+					 &args, sizeof(args));
+
 	/*
 	 * Kernel driver returns -EAGAIN if timeout=0 and fence
 	 * isn't reached, so we can't use drmCommandWriteRead()
@@ -72,8 +76,8 @@ int drm_tegra_fence_wait_timeout_v1(struct drm_tegra_fence *fence,
 	args.thresh = fence->value;
 	args.timeout = timeout;
 
-	return drmCommandWriteRead(fence->drm->fd, DRM_TEGRA_SYNCPT_WAIT,
-				   &args, sizeof(args));
+	return drm_tegra_command(fence->drm, DRM_TEGRA_SYNCPT_WAIT,
+				 &args, sizeof(args));
 }
 
 void drm_tegra_fence_free_v1(struct drm_tegra_fence *fence)
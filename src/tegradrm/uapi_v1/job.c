@@ -194,8 +194,8 @@ int drm_tegra_job_submit(struct drm_tegra_job *job,
 	args.waitchks = 0;
 
 	drm = job->channel->drm;
-	err = drmCommandWriteRead(drm->fd, DRM_TEGRA_SUBMIT, &args,
-				  sizeof(args));
+	err = drm_tegra_command(drm, DRM_TEGRA_SUBMIT, &args,
+				sizeof(args));
 	if (err < 0) {
 		free(syncpts);
 		free(fence);
@@ -205,6 +205,7 @@ int drm_tegra_job_submit(struct drm_tegra_job *job,
 	if (fence) {
 		fence->syncpt = job->syncpt;
 		fence->value = args.fence;
+		fence->syncpt_valid = true;
 		fence->drm = drm;
 		*fencep = fence;
 	}
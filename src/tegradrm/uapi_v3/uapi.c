@@ -88,6 +88,16 @@ void drm_tegra_fence_free_v3(struct drm_tegra_fence *fence)
 	free(fence);
 }
 
+int drm_tegra_fence_export_sync_file_v3(struct drm_tegra_fence *fence,
+					int *fd)
+{
+#ifdef HAVE_LIBDRM_SYNCOBJ_SUPPORT
+	return drmSyncobjExportSyncFile(fence->drm->fd, fence->syncobj, fd);
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
 int drm_tegra_channel_init_v3(struct drm_tegra_channel *channel,
 			      struct drm_tegra *drm,
 			      enum drm_tegra_class client)
@@ -628,5 +638,11 @@ int drm_tegra_job_submit_v3(struct drm_tegra_job_v3 *job,
 		return err;
 	}
 
+	if (pfence) {
+		(*pfence)->syncpt = args.syncpt.id;
+		(*pfence)->value = args.syncpt.value;
+		(*pfence)->syncpt_valid = true;
+	}
+
 	return 0;
 }
@@ -206,6 +206,43 @@ tegra_drm_queue_alloc(xf86CrtcPtr crtc,
     return q->seq;
 }
 
+/*
+ * Queue a vblank event that will be delivered after the given number of
+ * vblanks on the CRTC. The abort function is invoked on failure.
+ */
+Bool
+tegra_drm_queue_vblank_event(xf86CrtcPtr crtc,
+                             uint32_t count,
+                             void *data,
+                             tegra_drm_handler_proc handler,
+                             tegra_drm_abort_proc abort_proc)
+{
+    ScreenPtr screen = crtc->randr_crtc->pScreen;
+    ScrnInfoPtr scrn = xf86ScreenToScrn(screen);
+    TegraPtr tegra = TegraPTR(scrn);
+    drmmode_crtc_private_ptr drmmode_crtc = crtc->driver_private;
+    drmVBlank vbl;
+    uint32_t seq;
+
+    seq = tegra_drm_queue_alloc(crtc, data, handler, abort_proc);
+    if (!seq) {
+        abort_proc(data);
+        return FALSE;
+    }
+
+    vbl.request.type = DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT |
+                       drmmode_crtc_vblank_pipe(drmmode_crtc->crtc_pipe);
+    vbl.request.sequence = count;
+    vbl.request.signal = (unsigned long)seq;
+
+    if (drmWaitVBlank(tegra->fd, &vbl)) {
+        tegra_drm_abort_seq(scrn, seq);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 /**
  * Abort one queued DRM entry, removing it
  * from the list, calling the abort function and
@@ -48,6 +48,12 @@ uint32_t tegra_drm_queue_alloc(xf86CrtcPtr crtc,
                                tegra_drm_handler_proc handler,
                                tegra_drm_abort_proc abort);
 
+Bool tegra_drm_queue_vblank_event(xf86CrtcPtr crtc,
+                                  uint32_t count,
+                                  void *data,
+                                  tegra_drm_handler_proc handler,
+                                  tegra_drm_abort_proc abort);
+
 void tegra_drm_abort(ScrnInfoPtr scrn,
                      Bool (*match)(void *data, void *match_data),
                      void *match_data);
@@ -37,6 +37,12 @@
 
 #define DEFAULT_COLOR_KEY 0xFF4AF6
 
+#define PASSTHROUGH_CACHE_SIZE  8
+#define OVERLAY_FB_POOL_SIZE    4
+
+#define TEXTURED_VIDEO_PORTS_NUM    4
+#define TEXTURED_VIDEO_FRAMES_NUM   2
+
 #define FLOAT_TO_FIXED_s2_8(fp) \
     (((int32_t) (fp * 256.0f + 0.5f)) & ((1 << 11) - 1))
 
@@ -155,6 +161,18 @@ typedef struct TegraOverlay {
     struct drm_tegra_plane_csc_blob csc_blob;
 } TegraOverlay, *TegraOverlayPtr;
 
+typedef struct TegraPassthroughFB {
+    drm_overlay_fb *fb;
+    uint8_t data[PASSTHROUGH_DATA_SIZE_V2];
+    int passthrough;
+    uint32_t last_use;
+} TegraPassthroughFB;
+
+typedef struct TegraOverlayPoolFB {
+    drm_overlay_fb *fb;
+    unsigned int scanout_refs;
+} TegraOverlayPoolFB;
+
 typedef struct TegraVideo {
     TegraOverlay overlay[2];
     drm_overlay_fb *old_fb;
@@ -166,6 +184,33 @@ typedef struct TegraVideo {
     uint8_t passthrough_data[PASSTHROUGH_DATA_SIZE_V2];
     int passthrough;
 
+    /*
+     * Framebuffers of the client's buffers imported by passthrough,
+     * clients usually cycle through a small set of video surfaces and
+     * thus the imported GEMs and DRM framebuffers are kept around.
+     */
+    TegraPassthroughFB passthrough_cache[PASSTHROUGH_CACHE_SIZE];
+    uint32_t passthrough_stamp;
+
+    /*
+     * Framebuffers for the images uploaded by CPU, FB is reused once it
+     * left the screen, which is signalled by vblank event.
+     */
+    TegraOverlayPoolFB fb_pool[OVERLAY_FB_POOL_SIZE];
+
+    /*
+     * Queued presentation, image that is waiting for the next vblank
+     * to be put on the overlays. Image is dropped if a newer image
+     * arrives before the vblank.
+     */
+    ScrnInfoPtr scrn;
+    drm_overlay_fb *pending_fb;
+    Bool flip_pending;
+    short pending_src_x, pending_src_y;
+    short pending_dst_x, pending_dst_y;
+    short pending_src_w, pending_src_h;
+    short pending_dst_w, pending_dst_h;
+
     unsigned int overlays_num;
     unsigned int best_overlay_id;
 
@@ -182,10 +227,39 @@ typedef struct TegraVideo {
     Bool csc_blob_set;
 } TegraVideo, *TegraVideoPtr;
 
+typedef struct TegraTexturedFrame {
+    drm_overlay_fb *fb;
+    struct tegra_fence *fence;
+    struct tegra_fence_waiter *waiter;
+} TegraTexturedFrame;
+
+typedef struct TegraTexturedVideo {
+    /*
+     * Frames are alternated so that CPU could upload the next image
+     * while GR3D is still sampling the previous one.
+     */
+    TegraTexturedFrame frames[TEXTURED_VIDEO_FRAMES_NUM];
+    unsigned int frame_id;
+
+    int brightness;
+    float contrast;
+    float saturation;
+    float hue;
+    Bool bt709;
+} TegraTexturedVideo, *TegraTexturedVideoPtr;
+
+typedef struct TegraXvTexturedAdaptor {
+    XF86VideoAdaptorRec xv;
+    DevUnion dev_union[TEXTURED_VIDEO_PORTS_NUM];
+    TegraTexturedVideo private[TEXTURED_VIDEO_PORTS_NUM];
+} TegraXvTexturedAdaptor;
+
 typedef struct TegraXvAdaptor {
     XF86VideoAdaptorRec xv;
     DevUnion dev_union;
     TegraVideo private;
+
+    TegraXvTexturedAdaptor textured;
 } TegraXvAdaptor, *TegraXvAdaptorPtr;
 
 static XF86ImageRec XvImages[] = {
@@ -306,6 +380,64 @@ static XF86VideoEncodingRec XvEncoding[] = {
     },
 };
 
+static XF86ImageRec XvTexturedImages[] = {
+    XVIMAGE_YUY2,
+    XVIMAGE_YV12,
+    XVIMAGE_I420,
+    XVIMAGE_UYVY,
+};
+
+static XF86VideoFormatRec XvTexturedFormats[] = {
+    {
+        .depth = 24,
+        .class = TrueColor,
+    },
+};
+
+static XF86AttributeRec XvTexturedAttributes[] = {
+    {
+        .flags      = XvSettable | XvGettable,
+        .min_value  = -128,
+        .max_value  = 127,
+        .name       = (char *)"XV_BRIGHTNESS",
+    },
+    {
+        .flags      = XvSettable | XvGettable,
+        .min_value  = -100,
+        .max_value  = 100,
+        .name       = (char *)"XV_CONTRAST",
+    },
+    {
+        .flags      = XvSettable | XvGettable,
+        .min_value  = -100,
+        .max_value  = 100,
+        .name       = (char *)"XV_SATURATION",
+    },
+    {
+        .flags      = XvSettable | XvGettable,
+        .min_value  = -100,
+        .max_value  = 100,
+        .name       = (char *)"XV_HUE",
+    },
+    {
+        .flags      = XvSettable | XvGettable,
+        .min_value  = 0,
+        .max_value  = 1,
+        .name       = (char *)"XV_ITURBT_709",
+    },
+};
+
+static XF86VideoEncodingRec XvTexturedEncoding[] = {
+    {
+        .id               = 0,
+        .name             = "XV_IMAGE",
+        .width            = TEGRA_TEXTURED_VIDEO_MAX_WIDTH,
+        .height           = TEGRA_TEXTURED_VIDEO_MAX_HEIGHT,
+        .rate.numerator   = 1,
+        .rate.denominator = 1,
+    },
+};
+
 static Bool xv_fourcc_valid(int format_id)
 {
     switch (format_id) {
@@ -334,6 +466,28 @@ static Bool xv_fourcc_valid(int format_id)
     return FALSE;
 }
 
+static int xv_fourcc_passthrough(int format_id)
+{
+    switch (format_id) {
+    case FOURCC_PASSTHROUGH_YV12:
+    case FOURCC_PASSTHROUGH_RGB565:
+    case FOURCC_PASSTHROUGH_XRGB8888:
+    case FOURCC_PASSTHROUGH_XBGR8888:
+        return 1;
+
+    case FOURCC_PASSTHROUGH_YV12_V2:
+    case FOURCC_PASSTHROUGH_RGB565_V2:
+    case FOURCC_PASSTHROUGH_XRGB8888_V2:
+    case FOURCC_PASSTHROUGH_XBGR8888_V2:
+        return 2;
+
+    default:
+        break;
+    }
+
+    return 0;
+}
+
 static uint32_t xv_fourcc_to_drm(int format_id)
 {
     switch (format_id) {
@@ -581,6 +735,237 @@ static void TegraVideoDestroyFramebuffer(ScrnInfoPtr scrn,
     }
 }
 
+static Bool TegraVideoFramebufferCached(TegraVideoPtr priv,
+                                        drm_overlay_fb *fb)
+{
+    unsigned int i;
+
+    for (i = 0; i < PASSTHROUGH_CACHE_SIZE; i++) {
+        if (fb && priv->passthrough_cache[i].fb == fb)
+            return TRUE;
+    }
+
+    for (i = 0; i < OVERLAY_FB_POOL_SIZE; i++) {
+        if (fb && priv->fb_pool[i].fb == fb)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static drm_overlay_fb *TegraVideoPoolGetFB(TegraVideoPtr priv,
+                                           ScrnInfoPtr scrn,
+                                           uint32_t drm_format,
+                                           uint32_t width, uint32_t height)
+{
+    TegraOverlayPoolFB *victim = NULL;
+    TegraOverlayPoolFB *slot;
+    TegraPtr tegra = TegraPTR(scrn);
+    unsigned int i;
+
+    for (i = 0; i < OVERLAY_FB_POOL_SIZE; i++) {
+        slot = &priv->fb_pool[i];
+
+        /* FB is on the screen, leaving it or waiting to be shown */
+        if ((slot->fb && slot->fb == priv->fb) ||
+            (slot->fb && slot->fb == priv->pending_fb) ||
+            slot->scanout_refs)
+            continue;
+
+        if (slot->fb &&
+            slot->fb->format == drm_format &&
+            slot->fb->width  == width &&
+            slot->fb->height == height)
+            return slot->fb;
+
+        if (!victim || !slot->fb)
+            victim = slot;
+    }
+
+    /* all FBs are busy, fall back to a temporary FB */
+    if (!victim)
+        return drm_create_fb(tegra->drm, tegra->fd, drm_format,
+                             width, height);
+
+    TegraVideoDestroyFramebuffer(scrn, &victim->fb);
+
+    victim->fb = drm_create_fb(tegra->drm, tegra->fd, drm_format,
+                               width, height);
+
+    return victim->fb;
+}
+
+static void TegraVideoPoolFBRetired(uint64_t frame, uint64_t usec,
+                                    void *data)
+{
+    TegraOverlayPoolFB *slot = data;
+
+    slot->scanout_refs--;
+}
+
+static void TegraVideoPoolFBRetireAborted(void *data)
+{
+    TegraOverlayPoolFB *slot = data;
+
+    slot->scanout_refs--;
+}
+
+static void TegraVideoPoolRetireFB(TegraVideoPtr priv, ScrnInfoPtr scrn,
+                                   drm_overlay_fb *fb)
+{
+    xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(scrn);
+    TegraOverlayPoolFB *slot = NULL;
+    unsigned int i;
+    int id;
+
+    for (i = 0; i < OVERLAY_FB_POOL_SIZE && fb; i++) {
+        if (priv->fb_pool[i].fb == fb) {
+            slot = &priv->fb_pool[i];
+            break;
+        }
+    }
+
+    if (!slot)
+        return;
+
+    /*
+     * The non-blocking commit is applied on the next vblank, FB
+     * leaves the screen by the vblank after that one.
+     */
+    for (id = 0; id < priv->overlays_num; id++) {
+        if (!priv->overlay[id].visible)
+            continue;
+
+        slot->scanout_refs++;
+
+        tegra_drm_queue_vblank_event(xf86_config->crtc[id], 2, slot,
+                                     TegraVideoPoolFBRetired,
+                                     TegraVideoPoolFBRetireAborted);
+    }
+}
+
+static void TegraVideoPoolFlush(TegraVideoPtr priv, ScrnInfoPtr scrn)
+{
+    TegraOverlayPoolFB *slot;
+    unsigned int i;
+
+    for (i = 0; i < OVERLAY_FB_POOL_SIZE; i++) {
+        slot = &priv->fb_pool[i];
+
+        if (!slot->fb)
+            continue;
+
+        if (slot->fb == priv->fb)
+            priv->fb = NULL;
+
+        if (slot->fb == priv->old_fb)
+            priv->old_fb = NULL;
+
+        if (slot->fb == priv->pending_fb)
+            priv->pending_fb = NULL;
+
+        TegraVideoDestroyFramebuffer(scrn, &slot->fb);
+    }
+}
+
+static void TegraVideoReleaseFramebuffer(TegraVideoPtr priv,
+                                         ScrnInfoPtr scrn,
+                                         drm_overlay_fb **fb)
+{
+    if (TegraVideoFramebufferCached(priv, *fb))
+        *fb = NULL;
+    else
+        TegraVideoDestroyFramebuffer(scrn, fb);
+}
+
+static drm_overlay_fb *
+TegraVideoPassthroughCacheLookup(TegraVideoPtr priv,
+                                 uint32_t drm_format,
+                                 uint32_t width, uint32_t height,
+                                 int passthrough,
+                                 void *passthrough_data,
+                                 unsigned int data_size)
+{
+    TegraPassthroughFB *entry;
+    unsigned int i;
+
+    for (i = 0; i < PASSTHROUGH_CACHE_SIZE; i++) {
+        entry = &priv->passthrough_cache[i];
+
+        if (entry->fb &&
+            entry->fb->format == drm_format &&
+            entry->fb->width  == width &&
+            entry->fb->height == height &&
+            entry->passthrough == passthrough &&
+            memcmp(entry->data, passthrough_data, data_size) == 0)
+        {
+            entry->last_use = ++priv->passthrough_stamp;
+            return entry->fb;
+        }
+    }
+
+    return NULL;
+}
+
+static void TegraVideoPassthroughCacheAdd(TegraVideoPtr priv,
+                                          ScrnInfoPtr scrn,
+                                          drm_overlay_fb *fb,
+                                          int passthrough,
+                                          void *passthrough_data,
+                                          unsigned int data_size)
+{
+    TegraPassthroughFB *entry = NULL;
+    TegraPassthroughFB *e;
+    unsigned int i;
+
+    /* evict the least recently used FB that isn't on the screen */
+    for (i = 0; i < PASSTHROUGH_CACHE_SIZE; i++) {
+        e = &priv->passthrough_cache[i];
+
+        if (!e->fb) {
+            entry = e;
+            break;
+        }
+
+        if (e->fb == priv->fb || e->fb == priv->old_fb)
+            continue;
+
+        if (!entry || e->last_use < entry->last_use)
+            entry = e;
+    }
+
+    TegraVideoDestroyFramebuffer(scrn, &entry->fb);
+
+    memset(entry->data, 0, sizeof(entry->data));
+    memcpy(entry->data, passthrough_data, data_size);
+
+    entry->fb          = fb;
+    entry->passthrough = passthrough;
+    entry->last_use    = ++priv->passthrough_stamp;
+}
+
+static void TegraVideoPassthroughCacheFlush(TegraVideoPtr priv,
+                                            ScrnInfoPtr scrn)
+{
+    TegraPassthroughFB *entry;
+    unsigned int i;
+
+    for (i = 0; i < PASSTHROUGH_CACHE_SIZE; i++) {
+        entry = &priv->passthrough_cache[i];
+
+        if (!entry->fb)
+            continue;
+
+        if (entry->fb == priv->fb)
+            priv->fb = NULL;
+
+        if (entry->fb == priv->old_fb)
+            priv->old_fb = NULL;
+
+        TegraVideoDestroyFramebuffer(scrn, &entry->fb);
+    }
+}
+
 static void TegraVideoOverlayClose(TegraVideoPtr priv, ScrnInfoPtr scrn,
                                    int id)
 {
@@ -766,6 +1151,12 @@ static Bool TegraVideoOverlayCreateFB(TegraVideoPtr priv, ScrnInfoPtr scrn,
     }
 
     if (passthrough) {
+        fb = TegraVideoPassthroughCacheLookup(priv, drm_format,
+                                              width, height, passthrough,
+                                              passthrough_data, data_size);
+        if (fb)
+            goto done;
+
         switch (drm_format) {
         case DRM_FORMAT_YUV420:
             k = 3;
@@ -783,17 +1174,24 @@ static Bool TegraVideoOverlayCreateFB(TegraVideoPtr priv, ScrnInfoPtr scrn,
                                        width, height, bo_handles,
                                        pitches, offsets);
     } else {
-        fb = drm_create_fb(tegra->drm, tegra->fd, drm_format, width, height);
+        fb = TegraVideoPoolGetFB(priv, scrn, drm_format, width, height);
     }
 
     if (fb == NULL) {
         goto fail;
     }
 
+    if (passthrough)
+        TegraVideoPassthroughCacheAdd(priv, scrn, fb, passthrough,
+                                      passthrough_data, data_size);
+
+done:
     if (passthrough) {
         memcpy(priv->passthrough_data, passthrough_data, data_size);
     }
 
+    TegraVideoReleaseFramebuffer(priv, scrn, &priv->old_fb);
+
     priv->old_fb      = priv->fb;
     priv->fb          = fb;
     priv->passthrough = passthrough;
@@ -865,6 +1263,32 @@ static Bool TegraVideoOverlaySetColorKey(TegraVideoPtr priv,
     return TRUE;
 }
 
+static void TegraVideoComputeCSC(float cscmat[3][3], Bool bt709,
+                                 float contrast, float saturation, float hue)
+{
+    float uvcos, uvsin;
+    unsigned int i;
+
+    if (bt709)
+        memcpy(cscmat, CSC_BT_709, sizeof(CSC_BT_709));
+    else
+        memcpy(cscmat, CSC_BT_601, sizeof(CSC_BT_601));
+
+    if (hue != 0.0f || saturation != 1.0f || contrast != 1.0f) {
+        uvcos = saturation * cosf(hue * M_PI);
+        uvsin = saturation * sinf(hue * M_PI);
+
+        cscmat[0][0] *= contrast;
+
+        for (i = 0; i < 3; i++) {
+            float u = cscmat[i][1] * uvcos + cscmat[i][2] * uvsin;
+            float v = cscmat[i][1] * uvsin + cscmat[i][2] * uvcos;
+            cscmat[i][1] = u * contrast;
+            cscmat[i][2] = v * contrast;
+        }
+    }
+}
+
 static int TegraVideoOverlaySetAttribute(ScrnInfoPtr scrn, Atom attribute,
                                          INT32 value, void *data)
 {
@@ -914,9 +1338,7 @@ static int TegraVideoOverlaySetAttribute(ScrnInfoPtr scrn, Atom attribute,
         TegraPtr tegra = TegraPTR(scrn);
         uint32_t csc_blob_id;
         float cscmat[3][3];
-        float uvcos, uvsin;
         float fvalue;
-        unsigned int i;
         int ret = Success;
         int err;
 
@@ -957,27 +1379,8 @@ static int TegraVideoOverlaySetAttribute(ScrnInfoPtr scrn, Atom attribute,
             goto apply_blob;
         }
 
-        if (priv->bt709)
-            memcpy(cscmat, CSC_BT_709, sizeof(cscmat));
-        else
-            memcpy(cscmat, CSC_BT_601, sizeof(cscmat));
-
-        if (priv->hue != 0.0f ||
-                priv->saturation != 1.0f ||
-                    priv->contrast != 1.0f)
-        {
-            uvcos = priv->saturation * cosf(priv->hue * M_PI);
-            uvsin = priv->saturation * sinf(priv->hue * M_PI);
-
-            cscmat[0][0] *= priv->contrast;
-
-            for (i = 0; i < 3; i++) {
-                float u = cscmat[i][1] * uvcos + cscmat[i][2] * uvsin;
-                float v = cscmat[i][1] * uvsin + cscmat[i][2] * uvcos;
-                cscmat[i][1] = u * priv->contrast;
-                cscmat[i][2] = v * priv->contrast;
-            }
-        }
+        TegraVideoComputeCSC(cscmat, priv->bt709, priv->contrast,
+                             priv->saturation, priv->hue);
 
         priv->csc_blob.yof = priv->brightness;
         priv->csc_blob.kyrgb = FLOAT_TO_FIXED_s2_8( CLAMP(cscmat[0][0], 0.00f, 1.98f) );
@@ -1095,8 +1498,13 @@ static void TegraVideoOverlayStop(ScrnInfoPtr scrn, void *data, Bool cleanup)
     for (id = 0; id < priv->overlays_num; id++)
         TegraVideoOverlayClose(priv, scrn, id);
 
+    TegraVideoReleaseFramebuffer(priv, scrn, &priv->pending_fb);
+
     if (cleanup) {
-        TegraVideoDestroyFramebuffer(scrn, &priv->fb);
+        TegraVideoPassthroughCacheFlush(priv, scrn);
+        TegraVideoPoolFlush(priv, scrn);
+        TegraVideoReleaseFramebuffer(priv, scrn, &priv->old_fb);
+        TegraVideoReleaseFramebuffer(priv, scrn, &priv->fb);
 
         TegraVideoCloseGPU(priv);
 
@@ -1567,6 +1975,119 @@ static int TegraVideoUpdateOverlayCoverage(ScrnInfoPtr scrn,
     return visible;
 }
 
+static void TegraVideoOverlayPresent(TegraVideoPtr priv, ScrnInfoPtr scrn)
+{
+    int id;
+
+    if (!priv->pending_fb)
+        return;
+
+    TegraVideoReleaseFramebuffer(priv, scrn, &priv->old_fb);
+
+    priv->old_fb      = priv->fb;
+    priv->fb          = priv->pending_fb;
+    priv->pending_fb  = NULL;
+    priv->passthrough = 0;
+
+    if (TegraVideoOverlayPutImageOnOverlays(priv, scrn,
+                                            priv->pending_src_x,
+                                            priv->pending_src_y,
+                                            priv->pending_dst_x,
+                                            priv->pending_dst_y,
+                                            priv->pending_src_w,
+                                            priv->pending_src_h,
+                                            priv->pending_dst_w,
+                                            priv->pending_dst_h,
+                                            NULL))
+        TegraVideoPoolRetireFB(priv, scrn, priv->old_fb);
+
+    TegraVideoReleaseFramebuffer(priv, scrn, &priv->old_fb);
+
+    for (id = 0; id < priv->overlays_num; id++) {
+        TegraOverlayPtr overlay = &priv->overlay[id];
+        TegraVideoDestroyFramebuffer(scrn, &overlay->old_fb_rotated);
+    }
+}
+
+static void TegraVideoOverlayFlip(uint64_t frame, uint64_t usec, void *data)
+{
+    TegraVideoPtr priv = data;
+
+    priv->flip_pending = FALSE;
+
+    TegraVideoOverlayPresent(priv, priv->scrn);
+}
+
+static void TegraVideoOverlayFlipAborted(void *data)
+{
+    TegraVideoPtr priv = data;
+
+    priv->flip_pending = FALSE;
+}
+
+static int TegraVideoOverlayQueueImage(TegraVideoPtr priv,
+                                       ScrnInfoPtr scrn,
+                                       short src_x, short src_y,
+                                       short dst_x, short dst_y,
+                                       short src_w, short src_h,
+                                       short dst_w, short dst_h,
+                                       uint32_t drm_format,
+                                       uint32_t data_format,
+                                       Bool swap,
+                                       unsigned char *buf,
+                                       short width, short height,
+                                       DrawablePtr draw)
+{
+    xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(scrn);
+    drm_overlay_fb *fb = priv->pending_fb;
+    xf86CrtcPtr crtc;
+
+    /* image that didn't reach the screen is overwritten by the new one */
+    if (!fb ||
+        fb->format != drm_format ||
+        fb->width  != width ||
+        fb->height != height)
+    {
+        fb = TegraVideoPoolGetFB(priv, scrn, drm_format, width, height);
+        if (!fb) {
+            ErrorMsg("Failed to create framebuffer\n");
+            return BadAlloc;
+        }
+
+        TegraVideoReleaseFramebuffer(priv, scrn, &priv->pending_fb);
+        priv->pending_fb = fb;
+    }
+
+    if (!TegraVideoUpdateOverlayCoverage(scrn, priv, draw)) {
+        TegraVideoReleaseFramebuffer(priv, scrn, &priv->pending_fb);
+        return Success;
+    }
+
+    drm_copy_data_to_fb(fb, buf, data_format, swap);
+
+    priv->pending_src_x = src_x;
+    priv->pending_src_y = src_y;
+    priv->pending_dst_x = dst_x;
+    priv->pending_dst_y = dst_y;
+    priv->pending_src_w = src_w;
+    priv->pending_src_h = src_h;
+    priv->pending_dst_w = dst_w;
+    priv->pending_dst_h = dst_h;
+
+    if (priv->flip_pending)
+        return Success;
+
+    crtc = xf86_config->crtc[priv->best_overlay_id];
+    priv->flip_pending = TRUE;
+
+    if (!tegra_drm_queue_vblank_event(crtc, 1, priv,
+                                      TegraVideoOverlayFlip,
+                                      TegraVideoOverlayFlipAborted))
+        TegraVideoOverlayPresent(priv, scrn);
+
+    return Success;
+}
+
 static int TegraVideoOverlayPutImage(ScrnInfoPtr scrn,
                                      short src_x, short src_y,
                                      short dst_x, short dst_y,
@@ -1580,32 +2101,40 @@ static int TegraVideoOverlayPutImage(ScrnInfoPtr scrn,
                                      RegionPtr clipBoxes,
                                      void *data, DrawablePtr draw)
 {
+    TegraPtr tegra      = TegraPTR(scrn);
     TegraVideoPtr priv  = data;
     int passthrough     = 0;
     int ret             = Success;
+    uint32_t data_format;
+    uint32_t drm_format;
     int id;
     Bool visible;
 
     if (!xv_fourcc_valid(format))
         return BadImplementation;
 
-    switch (format) {
-    case FOURCC_PASSTHROUGH_YV12:
-    case FOURCC_PASSTHROUGH_RGB565:
-    case FOURCC_PASSTHROUGH_XRGB8888:
-    case FOURCC_PASSTHROUGH_XBGR8888:
-        passthrough = 1;
-        break;
+    data_format = xv_fourcc_to_drm(format);
+    drm_format  = data_format;
 
-    case FOURCC_PASSTHROUGH_YV12_V2:
-    case FOURCC_PASSTHROUGH_RGB565_V2:
-    case FOURCC_PASSTHROUGH_XRGB8888_V2:
-    case FOURCC_PASSTHROUGH_XBGR8888_V2:
-        passthrough = 2;
-        break;
-    }
+    if (tegra->xv_packed_to_planar &&
+        (format == FOURCC_YUY2 || format == FOURCC_UYVY))
+        drm_format = DRM_FORMAT_YUV420;
+
+    if (tegra->xv_queued_presentation && !xv_fourcc_passthrough(format))
+        return TegraVideoOverlayQueueImage(priv, scrn,
+                                           src_x, src_y,
+                                           dst_x, dst_y,
+                                           src_w, src_h,
+                                           dst_w, dst_h,
+                                           drm_format, data_format,
+                                           format == FOURCC_I420,
+                                           buf, width, height, draw);
+
+    TegraVideoReleaseFramebuffer(priv, scrn, &priv->pending_fb);
+
+    passthrough = xv_fourcc_passthrough(format);
 
-    if (!TegraVideoOverlayCreateFB(priv, scrn, xv_fourcc_to_drm(format),
+    if (!TegraVideoOverlayCreateFB(priv, scrn, drm_format,
                                    width, height, passthrough, buf) != Success)
         return BadImplementation;
 
@@ -1613,8 +2142,15 @@ static int TegraVideoOverlayPutImage(ScrnInfoPtr scrn,
     if (!visible)
         goto clean_up_old_fb;
 
+    /*
+     * Frames of XvShmPutImage are copied as well. Tegra DRM can't import
+     * SysV SHM memory (no userptr), hence only the passthrough frames,
+     * whose framebuffers are cached by TegraVideoOverlayCreateFB(), avoid
+     * the CPU copy.
+     */
     if (!passthrough)
-        drm_copy_data_to_fb(priv->fb, buf, format == FOURCC_I420);
+        drm_copy_data_to_fb(priv->fb, buf, data_format,
+                            format == FOURCC_I420);
 
     if (!TegraVideoOverlayPutImageOnOverlays(priv, scrn,
                                              src_x, src_y,
@@ -1623,9 +2159,11 @@ static int TegraVideoOverlayPutImage(ScrnInfoPtr scrn,
                                              dst_w, dst_h,
                                              draw))
         ret = BadImplementation;
+    else
+        TegraVideoPoolRetireFB(priv, scrn, priv->old_fb);
 
 clean_up_old_fb:
-    TegraVideoDestroyFramebuffer(scrn, &priv->old_fb);
+    TegraVideoReleaseFramebuffer(priv, scrn, &priv->old_fb);
 
     for (id = 0; id < priv->overlays_num; id++) {
         TegraOverlayPtr overlay = &priv->overlay[id];
@@ -1722,6 +2260,250 @@ static int TegraVideoOverlayQuery(ScrnInfoPtr scrn,
     return size;
 }
 
+static void TegraTexturedFrameRetire(struct tegra_fence *fence, void *data)
+{
+    TegraTexturedFrame *frame = data;
+
+    TEGRA_FENCE_PUT(frame->fence);
+    frame->fence = NULL;
+    frame->waiter = NULL;
+}
+
+static void TegraTexturedFrameWait(TegraTexturedFrame *frame)
+{
+    tegra_fence_waiter_cancel(frame->waiter);
+    frame->waiter = NULL;
+
+    TEGRA_WAIT_AND_PUT_FENCE(frame->fence);
+}
+
+static void TegraTexturedVideoStop(ScrnInfoPtr scrn, void *data, Bool cleanup)
+{
+    TegraPtr tegra             = TegraPTR(scrn);
+    TegraTexturedVideoPtr priv = data;
+    TegraTexturedFrame *frame;
+    unsigned int i;
+
+    if (!cleanup)
+        return;
+
+    for (i = 0; i < TEXTURED_VIDEO_FRAMES_NUM; i++) {
+        frame = &priv->frames[i];
+
+        TegraTexturedFrameWait(frame);
+
+        if (frame->fb) {
+            drm_free_overlay_fb(tegra->fd, frame->fb);
+            frame->fb = NULL;
+        }
+    }
+}
+
+static int TegraTexturedVideoSetAttribute(ScrnInfoPtr scrn, Atom attribute,
+                                          INT32 value, void *data)
+{
+    TegraTexturedVideoPtr priv = data;
+
+    if (attribute == xvBrightness) {
+        priv->brightness = CLAMP(value, -128, 127);
+        return Success;
+    }
+
+    if (attribute == xvContrast) {
+        priv->contrast = CLAMP(value, -100, 100) / 100.0f + 1.0f;
+        return Success;
+    }
+
+    if (attribute == xvSaturation) {
+        priv->saturation = CLAMP(value, -100, 100) / 100.0f + 1.0f;
+        return Success;
+    }
+
+    if (attribute == xvHue) {
+        priv->hue = CLAMP(value, -100, 100) / 100.0f;
+        return Success;
+    }
+
+    if (attribute == xvBt709) {
+        priv->bt709 = !!value;
+        return Success;
+    }
+
+    return BadMatch;
+}
+
+static int TegraTexturedVideoGetAttribute(ScrnInfoPtr scrn, Atom attribute,
+                                          INT32 *value, void *data)
+{
+    TegraTexturedVideoPtr priv = data;
+
+    if (attribute == xvBrightness) {
+        *value = priv->brightness;
+        return Success;
+    }
+
+    if (attribute == xvContrast) {
+        *value = (priv->contrast - 1.0f) * 100.0f;
+        return Success;
+    }
+
+    if (attribute == xvSaturation) {
+        *value = (priv->saturation - 1.0f) * 100.0f;
+        return Success;
+    }
+
+    if (attribute == xvHue) {
+        *value = priv->hue * 100.0f;
+        return Success;
+    }
+
+    if (attribute == xvBt709) {
+        *value = priv->bt709;
+        return Success;
+    }
+
+    return BadMatch;
+}
+
+static int TegraTexturedVideoPutImage(ScrnInfoPtr scrn,
+                                      short src_x, short src_y,
+                                      short dst_x, short dst_y,
+                                      short src_w, short src_h,
+                                      short dst_w, short dst_h,
+                                      int format,
+                                      unsigned char *buf,
+                                      short width,
+                                      short height,
+                                      Bool vblankSync,
+                                      RegionPtr clipBoxes,
+                                      void *data, DrawablePtr draw)
+{
+    TegraPtr tegra             = TegraPTR(scrn);
+    TegraTexturedVideoPtr priv = data;
+    TegraTexturedVideoFrame video;
+    TegraTexturedFrame *frame;
+    unsigned int i;
+
+    switch (format) {
+    case FOURCC_YUY2:
+    case FOURCC_YV12:
+    case FOURCC_I420:
+    case FOURCC_UYVY:
+        break;
+    default:
+        return BadMatch;
+    }
+
+    if (width > TEGRA_TEXTURED_VIDEO_MAX_WIDTH ||
+        height > TEGRA_TEXTURED_VIDEO_MAX_HEIGHT)
+        return BadValue;
+
+    if (src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0)
+        return Success;
+
+    /* prefer a frame that GR3D is done with */
+    for (i = 0; i < TEXTURED_VIDEO_FRAMES_NUM; i++) {
+        if (!priv->frames[priv->frame_id].fence)
+            break;
+
+        priv->frame_id = (priv->frame_id + 1) % TEXTURED_VIDEO_FRAMES_NUM;
+    }
+
+    frame = &priv->frames[priv->frame_id];
+
+    /* GR3D may be still sampling the frame */
+    TegraTexturedFrameWait(frame);
+
+    if (frame->fb && (frame->fb->width != width ||
+                      frame->fb->height != height)) {
+        drm_free_overlay_fb(tegra->fd, frame->fb);
+        frame->fb = NULL;
+    }
+
+    if (!frame->fb) {
+        frame->fb = drm_create_texture_fb(tegra->drm, width, height);
+        if (!frame->fb)
+            return BadAlloc;
+    }
+
+    /* packed formats are converted to YUV420 during the copy */
+    drm_copy_data_to_fb(frame->fb, buf, xv_fourcc_to_drm(format),
+                        format == FOURCC_I420);
+
+    TegraVideoComputeCSC(video.csc, priv->bt709, priv->contrast,
+                         priv->saturation, priv->hue);
+
+    video.fb    = frame->fb;
+    video.yof   = priv->brightness / 255.0f;
+    video.src_x = src_x;
+    video.src_y = src_y;
+    video.src_w = src_w;
+    video.src_h = src_h;
+    video.dst_x = dst_x;
+    video.dst_y = dst_y;
+    video.dst_w = dst_w;
+    video.dst_h = dst_h;
+    video.clip  = clipBoxes;
+
+    if (!TegraEXATexturedVideo(draw, &video, &frame->fence))
+        return BadAlloc;
+
+    /* notification may happen right away, clearing the fence */
+    if (frame->fence)
+        frame->waiter = tegra_fence_wait_async(frame->fence,
+                                               TegraTexturedFrameRetire,
+                                               frame);
+
+    /*
+     * Frame is drawn in the unrotated screen space. Rotated CRTCs scan
+     * out a shadow of the screen that the server's rotation code updates
+     * from the damage, hence no per-port rotated copy of the frame is
+     * needed unlike for the overlay.
+     */
+    DamageDamageRegion(draw, clipBoxes);
+
+    priv->frame_id = (priv->frame_id + 1) % TEXTURED_VIDEO_FRAMES_NUM;
+
+    return Success;
+}
+
+static void TegraXvTexturedInit(TegraXvTexturedAdaptor *adaptor)
+{
+    TegraTexturedVideoPtr priv;
+    unsigned int i;
+
+    adaptor->xv.type                 = XvWindowMask | XvInputMask | XvImageMask;
+    adaptor->xv.name                 = (char *)"Opentegra Textured Video";
+    adaptor->xv.nEncodings           = 1;
+    adaptor->xv.pEncodings           = XvTexturedEncoding;
+    adaptor->xv.pFormats             = XvTexturedFormats;
+    adaptor->xv.nFormats             = TEGRA_ARRAY_SIZE(XvTexturedFormats);
+    adaptor->xv.pAttributes          = XvTexturedAttributes;
+    adaptor->xv.nAttributes          = TEGRA_ARRAY_SIZE(XvTexturedAttributes);
+    adaptor->xv.pImages              = XvTexturedImages;
+    adaptor->xv.nImages              = TEGRA_ARRAY_SIZE(XvTexturedImages);
+    adaptor->xv.StopVideo            = TegraTexturedVideoStop;
+    adaptor->xv.SetPortAttribute     = TegraTexturedVideoSetAttribute;
+    adaptor->xv.GetPortAttribute     = TegraTexturedVideoGetAttribute;
+    adaptor->xv.QueryBestSize        = TegraVideoOverlayBestSize;
+    adaptor->xv.PutImage             = TegraTexturedVideoPutImage;
+    adaptor->xv.QueryImageAttributes = TegraVideoOverlayQuery;
+    adaptor->xv.nPorts               = TEXTURED_VIDEO_PORTS_NUM;
+    adaptor->xv.pPortPrivates        = adaptor->dev_union;
+
+    for (i = 0; i < TEXTURED_VIDEO_PORTS_NUM; i++) {
+        priv = &adaptor->private[i];
+
+        priv->brightness = -16;
+        priv->contrast   = 1.0f;
+        priv->saturation = 1.0f;
+        priv->hue        = 0.0f;
+        priv->bt709      = false;
+
+        adaptor->xv.pPortPrivates[i].ptr = priv;
+    }
+}
+
 static Bool
 TegraXvGetDrmPlaneProperty(ScrnInfoPtr scrn,
                            TegraVideoPtr priv,
@@ -1916,6 +2698,7 @@ static void TegraXvInit(TegraVideoPtr priv, ScrnInfoPtr scrn)
 {
     xf86CrtcConfigPtr xf86_config = XF86_CRTC_CONFIG_PTR(scrn);
 
+    priv->scrn         = scrn;
     priv->overlays_num = xf86_config->num_crtc;
     priv->color_key    = DEFAULT_COLOR_KEY;
     priv->brightness   = -16;
@@ -1929,8 +2712,9 @@ Bool TegraXvScreenInit(ScreenPtr pScreen)
 {
     ScrnInfoPtr scrn = xf86ScreenToScrn(pScreen);
     TegraPtr tegra   = TegraPTR(scrn);
-    XF86VideoAdaptorPtr xvAdaptor;
+    XF86VideoAdaptorPtr xvAdaptors[2];
     TegraXvAdaptorPtr adaptor;
+    unsigned int num_adaptors;
     TegraVideoPtr priv;
     int id;
 
@@ -1974,9 +2758,20 @@ Bool TegraXvScreenInit(ScreenPtr pScreen)
     xvHue           = MAKE_ATOM("XV_HUE");
     xvBt709         = MAKE_ATOM("XV_ITURBT_709");
 
-    xvAdaptor = &adaptor->xv;
+    xvAdaptors[0] = &adaptor->xv;
+    num_adaptors = 1;
     priv = &adaptor->private;
 
+    /*
+     * Textured video is offered as a second adaptor, it is used by clients
+     * once all ports of the overlay adaptor are taken. It also works on
+     * rotated CRTCs without rotated copies of the frames.
+     */
+    if (tegra->exa) {
+        TegraXvTexturedInit(&adaptor->textured);
+        xvAdaptors[num_adaptors++] = &adaptor->textured.xv;
+    }
+
     TegraXvInit(priv, scrn);
 
     for (id = 0; id < priv->overlays_num; id++) {
@@ -1987,7 +2782,7 @@ Bool TegraXvScreenInit(ScreenPtr pScreen)
     if (!TegraXvGetDrmProps(scrn, priv))
         goto err_free_adaptor;
 
-    if (!xf86XVScreenInit(pScreen, &xvAdaptor, 1)) {
+    if (!xf86XVScreenInit(pScreen, xvAdaptors, num_adaptors)) {
         ErrorMsg("xf86XVScreenInit failed\n");
         goto err_free_adaptor;
     }
@@ -28,6 +28,25 @@
 #define TEGRA_VIDEO_OVERLAY_MAX_WIDTH   4096
 #define TEGRA_VIDEO_OVERLAY_MAX_HEIGHT  4096
 
+#define TEGRA_TEXTURED_VIDEO_MAX_WIDTH  2048
+#define TEGRA_TEXTURED_VIDEO_MAX_HEIGHT 2048
+
+typedef struct TegraTexturedVideoFrame {
+    drm_overlay_fb *fb;
+
+    /* YUV to RGB matrix, rows are R,G,B and columns are Y,U,V */
+    float csc[3][3];
+    float yof;
+
+    short src_x, src_y;
+    short src_w, src_h;
+    short dst_x, dst_y;
+    short dst_w, dst_h;
+
+    /* in screen coordinates */
+    RegionPtr clip;
+} TegraTexturedVideoFrame;
+
 #define FOURCC_PASSTHROUGH_YV12     (('1' << 24) + ('2' << 16) + ('V' << 8) + 'Y')
 #define FOURCC_PASSTHROUGH_RGB565   (('1' << 24) + ('B' << 16) + ('G' << 8) + 'R')
 #define FOURCC_PASSTHROUGH_XRGB8888 (('X' << 24) + ('B' << 16) + ('G' << 8) + 'R')